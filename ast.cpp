@@ -2,31 +2,11 @@
 #include "scope.hpp"
 #include "error.hpp"
 #include "token.hpp"
+#include "context.hpp"
 #include "mempool.hpp"
 
 using namespace compiler;
 
-static mempool<ast_unary>    unary_pool{};
-static mempool<ast_binary>   binary_pool{};
-static mempool<ast_ternary>  ternary_pool{};
-static mempool<ast_constant> const_pool{};
-static mempool<ast_cast>     cast_pool{};
-static mempool<ast_call>     call_pool{};
-static mempool<ast_ident>    ident_pool{};
-static mempool<ast_object>   obj_pool{};
-static mempool<ast_func>     func_pool{};
-static mempool<ast_enum>     enum_pool{};
-
-static mempool<stmt_compound> compound_pool{};
-static mempool<stmt_if>       if_pool{};
-static mempool<stmt_jump>     jump_pool{};
-static mempool<stmt_return>   return_pool{};
-static mempool<stmt_expr>     expr_pool{};
-static mempool<stmt_decl>     decl_pool{};
-static mempool<stmt_label>    label_pool{};
-
-static qual_type usual_arith_conversion(qual_type&, qual_type&);
-
 static uint32_t integer_suffix(const std::string&);
 static uint32_t float_suffix(const std::string&);
 
@@ -36,19 +16,19 @@ ast_call::ast_call(token *tok, ast_func *f, arg_list &&l)
 
 ast_constant* compiler::make_bool(token *tok) {
     bool val = tok->m_attr == KeyTrue;
-    auto res = new (const_pool.malloc()) ast_constant(tok, qual_arith(Bool));
+    auto res = compilation_arena().make<ast_constant>(tok, qual_arith(Bool));
     res->ival = val;
     return res;
 }
 
 ast_constant* compiler::make_char(token *tok) {
-    return new (const_pool.malloc()) ast_constant(tok, qual_arith(Bool));
+    return compilation_arena().make<ast_constant>(tok, qual_arith(Bool));
 }
 
 ast_constant* compiler::make_string(token *tok) {
     auto ptr = make_pointer(make_arith(Char), Const);
     auto qual = make_qual(ptr);
-    auto res = new (const_pool.malloc()) ast_constant(tok, qual);
+    auto res = compilation_arena().make<ast_constant>(tok, qual);
     res->str = tok->to_string();
     return res;
 }
@@ -82,7 +62,7 @@ ast_constant* compiler::make_number(token *tok) {
     else // tok->m_attr == PPFloat
         tp = float_suffix(suffix);
     auto res_type = qual_arith(tp);
-    auto res = new (const_pool.malloc()) ast_constant(tok, res_type);
+    auto res = compilation_arena().make<ast_constant>(tok, res_type);
     try {
         switch(tp) {
             case Int: case Unsigned|Int: case Long: case Unsigned|Long:
@@ -93,11 +73,9 @@ ast_constant* compiler::make_number(token *tok) {
             case Long|Double: res->ldval = stold(str); break;
         }
     } catch(std::invalid_argument &e) {
-        const_pool.free(res);
         error(tok, "Malformed number");
         return nullptr;
     } catch(std::out_of_range &e) {
-        const_pool.free(res);
         error(tok, "Number is larger than what type %s can hold", res_type.to_string().c_str());
         return nullptr;
     }
@@ -114,7 +92,7 @@ ast_constant* compiler::make_sizeof(token *tok, qual_type tp) {
     if(tp->is_func() || !tp->is_complete())
         error(tok, "Cannot take size of function or incomplete type");
     
-    auto res = new (const_pool.malloc()) ast_constant(tok, qual_arith(Unsigned|Long));
+    auto res = compilation_arena().make<ast_constant>(tok, qual_arith(Unsigned|Long));
     res->ival = tp->size();
     
     return res;
@@ -125,33 +103,33 @@ ast_constant* compiler::make_sizeof(token *tok, ast_expr *expr) {
 }
 
 ast_constant* compiler::make_literal(unsigned long long l) {
-    auto res = new (const_pool.malloc()) ast_constant(nullptr, qual_arith(Int));
+    auto res = compilation_arena().make<ast_constant>(nullptr, qual_arith(Int));
     res->ival = l;
     return res;
 }
 
 ast_ident* compiler::make_ident(token *tok, qual_type tp) {
-    return new (ident_pool.malloc()) ast_ident(tok, tp);
+    return compilation_arena().make<ast_ident>(tok, tp);
 }
 
 ast_object* compiler::make_object(token *tok, qual_type tp, stmt_decl *d, uint8_t stor, uint32_t id, uint8_t bit_begin, uint8_t bit_width) {
-    return new (obj_pool.malloc()) ast_object(tok, tp, d, stor, id, bit_begin, bit_width);
+    return compilation_arena().make<ast_object>(tok, tp, d, stor, id, bit_begin, bit_width);
 }
 
 ast_func* compiler::make_func(token *tok, qual_type tp, stmt_decl *d, uint8_t s, stmt_compound *b) {
-    return new (func_pool.malloc()) ast_func(tok, tp, d, s, b);
+    return compilation_arena().make<ast_func>(tok, tp, d, s, b);
 }
 
 ast_enum* compiler::make_enum(token *tok, int val) {
-    return new (enum_pool.malloc()) ast_enum(tok, val);
+    return compilation_arena().make<ast_enum>(tok, val);
 }
 
 //ast_label* compiler::make_label(stmt *dest) {
-//    return new (label_pool.malloc()) ast_label(dest);
+//    return compilation_arena().make<ast_label>(dest);
 //}
 
 //ast_label* compiler::make_label(token *tok, stmt *dest) {
-//    return new (label_pool.malloc()) ast_label(tok, dest);
+//    return compilation_arena().make<ast_label>(tok, dest);
 //}
 
 /* C99 6.5.3.1 Prefix increment and decrement operators
@@ -221,7 +199,7 @@ ast_unary* compiler::make_unary(token *t, ast_expr *e, uint32_t op) {
             break;
     }
     #undef ERROR_MSG
-    return new (unary_pool.malloc()) ast_unary(t, tp, op, e);
+    return compilation_arena().make<ast_unary>(t, tp, op, e);
 }
 
 
@@ -240,7 +218,7 @@ ast_cast* compiler::make_cast(token *tok, qual_type tp, ast_expr *expr) {
     if(!tp->is_scalar())
         error(tok, "The type casted to should be scalar type");
     
-    return new (cast_pool.malloc()) ast_cast(tok, tp, expr);
+    return compilation_arena().make<ast_cast>(tok, tp, expr);
 }
 
 ast_expr* compiler::try_cast(ast_expr *expr, qual_type dest) {
@@ -359,7 +337,6 @@ ast_expr* compiler::make_init(qual_type tp, ast_expr *e) {
  */
 ast_binary* compiler::make_binary(token *tok, ast_expr *lhs, ast_expr *rhs, uint32_t op) {
     auto ltype = lhs->m_type.decay();
-    auto rtype = rhs->m_type.decay();
     
     auto tp = ltype;
     switch(op) {
@@ -369,12 +346,12 @@ ast_binary* compiler::make_binary(token *tok, ast_expr *lhs, ast_expr *rhs, uint
     if(ltype->is_pointer()) 
         rhs = make_binary(nullptr, make_literal(rhs->m_type->size()), rhs, Mul);
     
-    return new (binary_pool.malloc()) ast_binary(tok, tp, op, lhs, rhs);
+    return compilation_arena().make<ast_binary>(tok, tp, op, lhs, rhs);
 }
 
 ast_binary* compiler::make_member_access(token *tok, ast_expr *base, token *member) {
     // opcode `Member` 's token attribute `Dot`
-    uint32_t op = tok->is(MemberPtr) ? MemberPtr : Member;
+    uint32_t op = tok->is(MemberPtr) ? static_cast<uint32_t>(MemberPtr) : static_cast<uint32_t>(Member);
     
     auto stype = base->m_type;
     if(op == MemberPtr) {
@@ -401,7 +378,7 @@ ast_binary* compiler::make_member_access(token *tok, ast_expr *base, token *memb
     auto ret_type = id->m_type;
     ret_type.add_qual(stype.qual());
     
-    return new (binary_pool.malloc()) ast_binary(tok, ret_type, op, base, id);
+    return compilation_arena().make<ast_binary>(tok, ret_type, op, base, id);
 }
 
 /* C99 6.5.16 Assignment operators
@@ -469,7 +446,7 @@ ast_binary* compiler::make_assignment(token *tok, ast_expr *lhs, ast_expr *rhs,
         rhs = make_binary(tok, lhs, rhs, op);
     }
     
-    return new (binary_pool.malloc()) ast_binary(tok, lhs->m_type, Assign, lhs, rhs);
+    return compilation_arena().make<ast_binary>(tok, lhs->m_type, Assign, lhs, rhs);
 }
 
 /* C99 6.5.15 Conditional operator
@@ -495,7 +472,7 @@ ast_ternary* compiler::make_ternary(ast_expr *cond, ast_expr *yes, ast_expr *no)
     if(!no_t->compatible(yes_t))
         no = try_cast(no, yes_t);
     
-    return new (ternary_pool.malloc()) ast_ternary(yes->m_type, cond, yes, no);
+    return compilation_arena().make<ast_ternary>(yes->m_type, cond, yes, no);
 }
 
 
@@ -537,7 +514,7 @@ ast_call* compiler::make_call(token *tok, ast_func *func, arg_list &&args) {
         error(atok, "Too many arguments");
     }
     
-    return new (call_pool.malloc()) ast_call(tok, func, std::move(args));
+    return compilation_arena().make<ast_call>(tok, func, std::move(args));
 }
 
 stmt* compiler::make_stmt() {
@@ -546,80 +523,37 @@ stmt* compiler::make_stmt() {
 }
 
 stmt_decl* compiler::make_decl(ast_object *o) {
-    return new (decl_pool.malloc()) stmt_decl(o);
+    return compilation_arena().make<stmt_decl>(o);
 }
 
 stmt_expr* compiler::make_expr_stmt(ast_expr *expr) {
-    return new (expr_pool.malloc()) stmt_expr(expr);
+    return compilation_arena().make<stmt_expr>(expr);
 }
 
 stmt_if* compiler::make_if(ast_expr *cond, stmt *yes, stmt *no) {
     if(!cond->m_type->is_scalar())
         error(cond->m_tok, "Expecting a scalar type expression");
     
-    return new (if_pool.malloc()) stmt_if(cond, yes, no);
+    return compilation_arena().make<stmt_if>(cond, yes, no);
 }
 
 stmt_compound* compiler::make_compound(scope *s, stmt_list &&l) {
-    return new (compound_pool.malloc()) stmt_compound(s, std::move(l));
+    return compilation_arena().make<stmt_compound>(s, std::move(l));
 }
 
 stmt_jump* compiler::make_jump(stmt_label *dest) {
-    return new (jump_pool.malloc()) stmt_jump(dest);
+    return compilation_arena().make<stmt_jump>(dest);
 }
 
 stmt_label* compiler::make_label() {
-    return new (label_pool.malloc()) stmt_label();
+    return compilation_arena().make<stmt_label>(current_context().m_label_id++);
 }
 
 stmt_return* compiler::make_return(ast_func *func, ast_expr *ret) {
     auto ret_type = func->m_type->to_func()->return_type();
-    auto space = return_pool.malloc();
-    
     if(ret)
-        return new (space) stmt_return(try_cast(ret, ret_type));
-    return new (space) stmt_return(ret);
-}
-
-/* C99 6.3.1.8 Usual arithmetic conversions
- * 
- * First, if the corresponding real type of either operand is long double, the other
- * operand is converted, without change of type domain, to a type whose
- * corresponding real type is long double.
- * 
- * Otherwise, if the corresponding real type of either operand is double, the other
- * operand is converted, without change of type domain, to a type whose
- * corresponding real type is double.
- * 
- * Otherwise, if the corresponding real type of either operand is float, the other
- * operand is converted, without change of type domain, to a type whose
- * corresponding real type is float.
- * 
- * Otherwise, the integer promotions are performed on both operands. Then the
- * following rules are applied to the promoted operands:
- * 
- *     If both operands have the same type, then no further conversion is needed.
- * 
- *     Otherwise, if both operands have signed integer types or both have unsigned
- *     integer types, the operand with the type of lesser integer conversion rank is
- *     converted to the type of the operand with greater rank.
- * 
- *     Otherwise, if the operand that has unsigned integer type has rank greater or
- *     equal to the rank of the type of the other operand, then the operand with
- *     signed integer type is converted to the type of the operand with unsigned
- *     integer type.
- * 
- *     Otherwise, if the type of the operand with signed integer type can represent
- *     all of the values of the type of the operand with unsigned integer type, then
- *     the operand with unsigned integer type is converted to the type of the
- *     operand with signed integer type.
- * 
- *     Otherwise, both operands are converted to the unsigned integer type
- *     corresponding to the type of the operand with signed integer type.
- */
-qual_type usual_arith_conversion(qual_type &lhs, qual_type &rhs) {
-    
-    return lhs;
+        ret = try_cast(ret, ret_type);
+    return compilation_arena().make<stmt_return>(ret);
 }
 
 uint32_t integer_suffix(const std::string &str) {
@@ -633,7 +567,7 @@ uint32_t integer_suffix(const std::string &str) {
                 tp = apply_spec(tp, Long);
                 break;
             default: 
-                error(*epos, "Unknown integer suffix");
+                error(epos, "Unknown integer suffix");
         }
     }
     
@@ -658,7 +592,7 @@ uint32_t float_suffix(const std::string &str) {
                 tp = apply_spec(tp, Long);
                 break;
             default: 
-                error(*epos, "Unknown floating-point suffix");
+                error(epos, "Unknown floating-point suffix");
         }
     }
     if(!tp) tp = Double;
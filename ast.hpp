@@ -3,6 +3,7 @@
 
 #include "type.hpp"
 #include "token.hpp"
+#include "mempool.hpp"
 #include "visitor.hpp"
 
 #include <list>
@@ -73,9 +74,9 @@ struct stmt_decl;
 
 
 
-typedef std::list<ast_expr*> arg_list;
-typedef std::list<stmt*>     stmt_list;
-typedef std::list<ast_expr*> init_list;
+typedef std::list<ast_expr*, pool_allocator<ast_expr*>> arg_list;
+typedef std::list<stmt*, pool_allocator<stmt*>>         stmt_list;
+typedef std::list<ast_expr*, pool_allocator<ast_expr*>> init_list;
 
 // all other opcodes are inherited from token_attr
 enum opcode: uint32_t {
@@ -346,11 +347,8 @@ struct stmt: public ast_node {
 };
 
 struct stmt_label: public stmt {
-    unsigned id;
-    stmt_label() {
-        static unsigned _id = 1;
-        id = _id++;
-    }
+    unsigned id; // unique in the translation unit
+    explicit stmt_label(unsigned id):id(id) {}
     
     void accept(visitor *v) override {v->visit_label(this);}
 };
@@ -466,6 +464,24 @@ stmt_label*  make_label();
 
 stmt_return* make_return(ast_func*, ast_expr* = nullptr);
 
+// nodes of nothing but pointers and values, their destructors are only virtual
+#define NOT_DESTROYED(node) template <> struct arena_destroyed<node>: std::false_type {}
+NOT_DESTROYED(ast_constant);
+NOT_DESTROYED(ast_ident);
+NOT_DESTROYED(ast_object);
+NOT_DESTROYED(ast_enum);
+NOT_DESTROYED(ast_func);
+NOT_DESTROYED(ast_unary);
+NOT_DESTROYED(ast_cast);
+NOT_DESTROYED(ast_binary);
+NOT_DESTROYED(ast_ternary);
+NOT_DESTROYED(stmt_label);
+NOT_DESTROYED(stmt_if);
+NOT_DESTROYED(stmt_jump);
+NOT_DESTROYED(stmt_return);
+NOT_DESTROYED(stmt_expr);
+#undef NOT_DESTROYED
+
 } // namespace compiler
 
 #endif // __COMPILER_AST__
@@ -0,0 +1,170 @@
+// Concurrent compilation benchmark.
+//
+// usage: bench_contexts [threads...]
+// A number of independent units in the subset of C the parser handles is
+// generated. They are all parsed and their IR is written, to /dev/null, by
+// the given numbers of threads, 1 2 4 8 16 32 by default; each unit in a
+// compilation context of its own, taken by the first thread free.
+//
+// Every run is a child process of its own. Reports the best of a few runs in
+// wall-clock time, the speedup over one thread, and the peak RSS of the run.
+
+#include "parser.hpp"
+#include "context.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+using namespace compiler;
+
+static constexpr unsigned int units = 32;
+static constexpr unsigned int functions = 1000;
+static constexpr int runs = 3;
+
+// what a child sends back
+struct result {
+    double m_seconds; // negative on failure
+    long m_peak_rss;  // KB, filled in by the parent
+};
+
+static void write_file(const std::string &path, const std::string &text) {
+    auto file = std::fopen(path.c_str(), "w");
+    if(!file || std::fwrite(text.data(), 1, text.size(), file) != text.size()) {
+        std::perror(path.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    std::fclose(file);
+}
+
+// the directory of the units, "unit_N.c"
+static std::string generate_input() {
+    char dir[] = "/tmp/bench_contexts_XXXXXX";
+    if(!mkdtemp(dir)) {
+        std::perror("mkdtemp");
+        std::exit(EXIT_FAILURE);
+    }
+    
+    for(unsigned int u = 0; u < units; ++u) {
+        std::string text = "struct point { int x; int y; };\n"
+                           "int add(int a, int b) { return a + b; }\n";
+        for(unsigned int i = 0; i < functions; ++i) {
+            auto n = std::to_string(i);
+            text += "struct s" + n + " { int a; long b; char c[8]; };\n"
+                    "long f" + n + "(long a, long b, struct point *p) {\n"
+                    "    long s = " + n + ";\n"
+                    "    while(s < a) s = s + b;\n"
+                    "    do { s = s - 1; } while(s > b);\n"
+                    "    if(a > b) { long t = a * 2; s = t - b; } else s = b - a;\n"
+                    "    s = s * 3 + (p->x << 2) - add(p->y, 7);\n"
+                    "    return s > 100 ? s : -s;\n"
+                    "}\n";
+        }
+        write_file(std::string(dir) + "/unit_" + std::to_string(u) + ".c", text);
+    }
+    return dir;
+}
+
+static bool compile_all(const std::vector<std::string> &paths, unsigned int threads) {
+    std::atomic<std::size_t> next{0};
+    std::atomic<bool> failed{false};
+    auto work = [&]() {
+        for(auto i = next++; i < paths.size(); i = next++) {
+            compilation_context context{};
+            context_scope scope(context);
+            try {
+                parser p(paths[i].c_str());
+                p.process();
+                p.print("/dev/null");
+            } catch(int) {
+                failed = true;
+            }
+        }
+    };
+    
+    std::vector<std::thread> pool{};
+    for(unsigned int i = 1; i < threads; ++i)
+        pool.emplace_back(work);
+    work();
+    for(auto &&t: pool) t.join();
+    return !failed;
+}
+
+static result run(const std::vector<std::string> &paths, unsigned int threads) {
+    result r{-1, 0};
+    int fds[2];
+    if(pipe(fds)) return r;
+    auto pid = fork();
+    if(pid < 0) return r;
+    if(!pid) {
+        using clock = std::chrono::steady_clock;
+        close(fds[0]);
+        auto start = clock::now();
+        if(compile_all(paths, threads))
+            r.m_seconds = std::chrono::duration<double>(clock::now() - start).count();
+        if(write(fds[1], &r, sizeof(r)) != sizeof(r)) r.m_seconds = -1;
+        _exit(r.m_seconds < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    
+    close(fds[1]);
+    if(read(fds[0], &r, sizeof(r)) != sizeof(r)) r.m_seconds = -1;
+    close(fds[0]);
+    int status;
+    rusage usage;
+    if(wait4(pid, &status, 0, &usage) == pid)
+        r.m_peak_rss = usage.ru_maxrss;
+    return r;
+}
+
+static result best(const std::vector<std::string> &paths, unsigned int threads) {
+    result b{-1, 0};
+    for(int i = 0; i < runs; ++i) {
+        auto r = run(paths, threads);
+        if(r.m_seconds < 0) return r;
+        if(b.m_seconds < 0 || r.m_seconds < b.m_seconds) b = r;
+    }
+    return b;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<unsigned int> threads{};
+    for(int i = 1; i < argc; ++i)
+        threads.push_back(std::strtoul(argv[i], nullptr, 10));
+    if(threads.empty())
+        threads = {1, 2, 4, 8, 16, 32};
+    
+    auto dir = generate_input();
+    std::vector<std::string> paths{};
+    for(unsigned int u = 0; u < units; ++u)
+        paths.push_back(dir + "/unit_" + std::to_string(u) + ".c");
+    std::printf("%u units of %u functions, %ld CPUs\n", units, functions, sysconf(_SC_NPROCESSORS_ONLN));
+    std::printf("%-10s %9s %9s %12s\n", "threads", "ms", "speedup", "peak RSS MB");
+    
+    int status = EXIT_SUCCESS;
+    // the first run also brings the files into the page cache
+    run(paths, 1);
+    double serial = -1;
+    for(auto n: threads) {
+        auto r = best(paths, n);
+        if(r.m_seconds < 0) {
+            std::printf("%-10u failed\n", n);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        if(serial < 0) serial = r.m_seconds;
+        std::printf("%-10u %9.2f %9.2f %12.1f\n", n, r.m_seconds * 1e3, serial / r.m_seconds, r.m_peak_rss / 1024.0);
+    }
+    
+    for(auto &&path: paths)
+        unlink(path.c_str());
+    rmdir(dir.c_str());
+    return status;
+}
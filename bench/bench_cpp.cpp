@@ -0,0 +1,162 @@
+// Token cache benchmark.
+//
+// usage: bench_cpp [file.c]
+// Preprocesses a header-heavy translation unit three times: without the
+// token cache, with an empty cache (cold, every header is lexed and saved)
+// and with the cache filled by the cold run (warm, nothing is lexed).
+// Without arguments a unit including a few hundred generated headers is used.
+//
+// Every run is a child process, as separate compiler invocations would be:
+// macros, include guards and the string table start empty each time.
+
+#include "cpp.hpp"
+#include "token_cache.hpp"
+
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+using namespace compiler;
+
+static constexpr unsigned int generated_headers = 300;
+static constexpr unsigned int header_units = 150;
+static constexpr int warm_runs = 5;
+
+// declarations typical of a library header
+static std::string header_unit(unsigned int h, unsigned int i) {
+    auto n = std::to_string(h) + "_" + std::to_string(i);
+    return "/* entry " + n + " of a generated header */\n"
+           "struct record_" + n + " {\n"
+           "    unsigned long  key;\n"
+           "    const char    *name; // owned by the table\n"
+           "    double         weight[4];\n"
+           "};\n"
+           "extern int  lookup_" + n + "(const struct record_" + n + " *rec, unsigned long key);\n"
+           "extern void update_" + n + "(struct record_" + n + " *rec, double w, int flags);\n"
+           "static const unsigned int mask_" + n + " = 0x7fffu, shift_" + n + " = 12;\n\n";
+}
+
+static void write_file(const std::string &path, const std::string &text) {
+    std::ofstream file(path, std::ios::out|std::ios::binary);
+    if(!file.write(text.data(), text.size())) {
+        std::perror(path.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// returns the main file
+static std::string generate_unit(const std::string &dir) {
+    std::string unit{};
+    for(unsigned int h = 0; h < generated_headers; ++h) {
+        std::string text{};
+        for(unsigned int i = 0; i < header_units; ++i)
+            text += header_unit(h, i);
+        auto name = "header_" + std::to_string(h) + ".h";
+        write_file(dir + "/" + name, text);
+        unit += "#include \"" + name + "\"\n";
+    }
+    unit += "int main(void) { return 0; }\n";
+    write_file(dir + "/main.c", unit);
+    return dir + "/main.c";
+}
+
+static void remove_dir(const std::string &dir) {
+    if(auto d = opendir(dir.c_str())) {
+        while(auto e = readdir(d)) {
+            std::string name = e->d_name;
+            if(name != "." && name != "..")
+                unlink((dir + "/" + name).c_str());
+        }
+        closedir(d);
+    }
+    rmdir(dir.c_str());
+}
+
+struct result {
+    double        seconds; // negative on error
+    unsigned long tokens;
+};
+
+// preprocesses to the end in a child process
+static result run(const char *path) {
+    using clock = std::chrono::steady_clock;
+    
+    result r = {-1, 0};
+    int fds[2];
+    if(pipe(fds)) return r;
+    auto pid = fork();
+    if(pid == 0) {
+        close(fds[0]);
+        auto start = clock::now();
+        try {
+            cpp pp(path);
+            for(auto tok = pp.get(); tok && !tok->is(Eof); tok = pp.get())
+                ++r.tokens;
+            r.seconds = std::chrono::duration<double>(clock::now() - start).count();
+        } catch(int) {}
+        _exit(write(fds[1], &r, sizeof(r)) == sizeof(r) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    close(fds[1]);
+    if(pid > 0) {
+        if(read(fds[0], &r, sizeof(r)) != sizeof(r)) r.seconds = -1;
+        waitpid(pid, nullptr, 0);
+    }
+    close(fds[0]);
+    return r;
+}
+
+static double dir_size_kb(const std::string &dir) {
+    double size = 0;
+    if(auto d = opendir(dir.c_str())) {
+        while(auto e = readdir(d)) {
+            struct stat st;
+            if(!stat((dir + "/" + e->d_name).c_str(), &st) && S_ISREG(st.st_mode))
+                size += st.st_size;
+        }
+        closedir(d);
+    }
+    return size / 1024;
+}
+
+int main(int argc, char *argv[]) {
+    char temp[] = "/tmp/bench_cpp_XXXXXX";
+    if(!mkdtemp(temp)) {
+        std::perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    std::string dir = temp, cache = dir + "/cache";
+    auto source_dir = dir + "/src";
+    mkdir(source_dir.c_str(), 0755);
+    auto path = argc > 1 ? std::string(argv[1]) : generate_unit(source_dir);
+    
+    static const char *names[] = {"no cache", "cold", "warm"};
+    std::printf("%-10s %9s %9s %9s\n", "run", "ms", "Mtok/s", "cache KB");
+    int status = EXIT_SUCCESS;
+    for(int i = 0; i < 3; ++i) {
+        set_token_cache(i ? cache : std::string());
+        auto best = run(path.c_str());
+        for(int k = 1; i == 2 && k < warm_runs && best.seconds >= 0; ++k) {
+            auto r = run(path.c_str());
+            if(r.seconds < best.seconds) best = r;
+        }
+        if(best.seconds < 0) {
+            std::printf("%-10s failed\n", names[i]);
+            status = EXIT_FAILURE;
+            break;
+        }
+        std::printf("%-10s %9.2f %9.2f %9.0f\n", names[i], best.seconds * 1e3,
+                    best.tokens / best.seconds / 1e6, i ? dir_size_kb(cache) : 0.0);
+    }
+    
+    remove_dir(cache);
+    remove_dir(source_dir);
+    rmdir(dir.c_str());
+    return status;
+}
@@ -0,0 +1,275 @@
+// Flat AST traversal benchmark.
+//
+// usage: bench_flat_ast [statements]
+// A unit of one large function, 100000 statements by default, is generated
+// and parsed. Its AST is walked whole, in the pointer layout through the
+// virtual visitor and in the flat layout through flat_visitor, by walkers
+// that do the same work: count the nodes and sum their operators and
+// constants. Reports the best of a few runs of each in nanoseconds per
+// node, and the bytes of each layout; those of the pointer one are the
+// nodes and list nodes the walk reaches.
+
+#include "parser.hpp"
+#include "flat_ast.hpp"
+
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+using namespace compiler;
+
+static constexpr int runs = 5;
+static constexpr int walks = 20; // a run
+
+// the bytes of an element of arg_list, stmt_list and init_list
+static constexpr std::size_t list_node = 3 * sizeof(void*);
+
+namespace {
+
+struct totals {
+    std::size_t m_nodes;
+    uint64_t    m_sum;
+};
+
+class pointer_walker: public visitor {
+    public:
+        totals m_totals;
+        std::size_t m_bytes;
+    private:
+        void count(std::size_t size, uint64_t value) {
+            ++m_totals.m_nodes;
+            m_totals.m_sum += value;
+            m_bytes += size;
+        }
+        void walk(ast_node *node) {if(node) node->accept(this);}
+        template <class List> void walk_list(const List &list) {
+            for(auto node: list) {
+                m_bytes += list_node;
+                walk(node);
+            }
+        }
+    public:
+        pointer_walker():m_totals{0, 0}, m_bytes(0) {}
+        
+        void visit_constant(ast_constant *a) override {count(sizeof(*a), a->ival);}
+        void visit_object(ast_object *a) override {count(sizeof(*a), 1);}
+        void visit_enum(ast_enum *a) override {count(sizeof(*a), 2);}
+        // a designator, functions are walked from their declarations
+        void visit_func(ast_func *a) override {count(sizeof(*a), 1);}
+        void visit_unary(ast_unary *a) override {
+            count(sizeof(*a), a->op);
+            walk(a->operand);
+        }
+        void visit_cast(ast_cast *a) override {
+            count(sizeof(*a), 3);
+            walk(a->operand);
+        }
+        void visit_binary(ast_binary *a) override {
+            count(sizeof(*a), a->op);
+            walk(a->lhs);
+            walk(a->rhs);
+        }
+        void visit_ternary(ast_ternary *a) override {
+            count(sizeof(*a), 4);
+            walk(a->cond);
+            walk(a->yes);
+            walk(a->no);
+        }
+        void visit_call(ast_call *a) override {
+            count(sizeof(*a), 5);
+            walk_list(a->args);
+        }
+        
+        void visit_stmt(stmt*) override {}
+        void visit_compound(stmt_compound *a) override {
+            count(sizeof(*a), 6);
+            walk_list(a->m_stmt);
+        }
+        void visit_jump(stmt_jump *a) override {count(sizeof(*a), a->label->id);}
+        void visit_label(stmt_label *a) override {count(sizeof(*a), a->id);}
+        void visit_return(stmt_return *a) override {
+            count(sizeof(*a), 7);
+            walk(a->val);
+        }
+        void visit_if(stmt_if *a) override {
+            count(sizeof(*a), 8);
+            walk(a->cond);
+            walk(a->yes);
+            walk(a->no);
+        }
+        void visit_expr(stmt_expr *a) override {
+            count(sizeof(*a), 9);
+            walk(a->expr);
+        }
+        void visit_decl(stmt_decl *a) override {
+            if(auto func = a->obj->to_func()) {
+                count(sizeof(*func), 10);
+                walk(func->body);
+                return;
+            }
+            count(sizeof(*a), 11);
+            walk_list(a->inits);
+        }
+};
+
+class flat_walker: public flat_visitor<flat_walker> {
+    public:
+        totals m_totals;
+    private:
+        void count(uint64_t value) {
+            ++m_totals.m_nodes;
+            m_totals.m_sum += value;
+        }
+    public:
+        explicit flat_walker(const flat_ast &ast):flat_visitor(ast), m_totals{0, 0} {}
+        
+        void visit_constant(const flat_constant &n) {count(n.ival);}
+        void visit_object(const flat_object&) {count(1);}
+        void visit_enum(const flat_enum&) {count(2);}
+        void visit_unary(const flat_unary &n) {
+            count(n.m_op);
+            flat_visitor::visit_unary(n);
+        }
+        void visit_cast(const flat_cast &n) {
+            count(3);
+            flat_visitor::visit_cast(n);
+        }
+        void visit_binary(const flat_binary &n) {
+            count(n.m_op);
+            flat_visitor::visit_binary(n);
+        }
+        void visit_ternary(const flat_ternary &n) {
+            count(4);
+            flat_visitor::visit_ternary(n);
+        }
+        void visit_call(const flat_call &n) {
+            count(5);
+            flat_visitor::visit_call(n);
+        }
+        void visit_compound(const flat_compound &n) {
+            count(6);
+            flat_visitor::visit_compound(n);
+        }
+        void visit_jump(const flat_jump &n) {count(n.m_label);}
+        void visit_label(const flat_label &n) {count(n.m_id);}
+        void visit_return(const flat_return &n) {
+            count(7);
+            flat_visitor::visit_return(n);
+        }
+        void visit_if(const flat_if &n) {
+            count(8);
+            flat_visitor::visit_if(n);
+        }
+        void visit_expr(const flat_expr &n) {
+            count(9);
+            flat_visitor::visit_expr(n);
+        }
+        void visit_func(const flat_func &n) {
+            count(10);
+            flat_visitor::visit_func(n);
+        }
+        void visit_decl(const flat_decl &n) {
+            count(11);
+            flat_visitor::visit_decl(n);
+        }
+};
+
+} // anonymous namespace
+
+static std::string generate_input(unsigned int statements) {
+    char path[] = "/tmp/bench_flat_ast_XXXXXX.c";
+    auto fd = mkstemps(path, 2);
+    if(fd < 0) {
+        std::perror("mkstemps");
+        std::exit(EXIT_FAILURE);
+    }
+    
+    std::string text = "struct point { int x; int y; };\n"
+                       "int add(int a, int b) { return a + b; }\n"
+                       "long big(long a, long b, struct point *p) {\n"
+                       "    long s = 0;\n";
+    for(unsigned int i = 0; i < statements; i += 4) {
+        auto n = std::to_string(i);
+        text += "    s = s * 3 + (p->x << 2) - add(p->y, " + n + ");\n"
+                "    if(s > a) { long t = s * 2; s = t - b; } else s = b - a;\n"
+                "    while(s < a) s = s + b;\n"
+                "    s = s > 100 ? s : -s;\n";
+    }
+    text += "    return s;\n}\n";
+    if(write(fd, text.data(), text.size()) != static_cast<ssize_t>(text.size())) {
+        std::perror(path);
+        std::exit(EXIT_FAILURE);
+    }
+    close(fd);
+    return path;
+}
+
+// the best of a few runs, in seconds a walk
+template <class Walk> static double best(Walk walk) {
+    using clock = std::chrono::steady_clock;
+    double result = -1;
+    for(int i = 0; i < runs; ++i) {
+        auto start = clock::now();
+        for(int j = 0; j < walks; ++j)
+            walk();
+        auto seconds = std::chrono::duration<double>(clock::now() - start).count() / walks;
+        if(result < 0 || seconds < result) result = seconds;
+    }
+    return result;
+}
+
+int main(int argc, char *argv[]) try {
+    auto statements = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    auto unit = generate_input(statements);
+    
+    parser p(unit.c_str());
+    p.process();
+    auto &&tu = p.unit();
+    
+    flat_ast flat{};
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    flatten(flat, tu);
+    auto convert = std::chrono::duration<double>(clock::now() - start).count();
+    
+    pointer_walker pointers{};
+    for(auto s: tu)
+        s->accept(&pointers);
+    flat_walker flats(flat);
+    flats.visit_top();
+    if(pointers.m_totals.m_nodes != flats.m_totals.m_nodes || pointers.m_totals.m_sum != flats.m_totals.m_sum) {
+        std::printf("the layouts differ: %zu nodes against %zu\n", pointers.m_totals.m_nodes, flats.m_totals.m_nodes);
+        unlink(unit.c_str());
+        return EXIT_FAILURE;
+    }
+    auto nodes = pointers.m_totals.m_nodes;
+    
+    uint64_t sink = 0;
+    auto pointer_time = best([&]() {
+        pointer_walker w{};
+        for(auto s: tu)
+            s->accept(&w);
+        sink += w.m_totals.m_sum;
+    });
+    auto flat_time = best([&]() {
+        flat_walker w(flat);
+        w.visit_top();
+        sink += w.m_totals.m_sum;
+    });
+    
+    std::printf("%lu statements, %zu nodes, converted in %.2f ms (%llx)\n", statements, nodes, convert * 1e3,
+                static_cast<unsigned long long>(sink));
+    std::printf("%-10s %12s %12s %12s\n", "layout", "ms a walk", "ns a node", "MB");
+    std::printf("%-10s %12.3f %12.2f %12.1f\n", "pointers", pointer_time * 1e3, pointer_time * 1e9 / nodes,
+                pointers.m_bytes / double(1 << 20));
+    std::printf("%-10s %12.3f %12.2f %12.1f\n", "flat", flat_time * 1e3, flat_time * 1e9 / nodes,
+                flat.bytes() / double(1 << 20));
+    std::printf("speedup %.2f\n", pointer_time / flat_time);
+    unlink(unit.c_str());
+    return EXIT_SUCCESS;
+} catch(int) {
+    return EXIT_FAILURE;
+}
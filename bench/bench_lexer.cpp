@@ -0,0 +1,231 @@
+// Lexer throughput benchmark.
+//
+// usage: bench_lexer [file...]
+// Without arguments a corpus of multi-megabyte translation units is generated:
+// ordinary code, identifier-heavy, numeric-heavy, comment-heavy, long string
+// literals and UTF-8 identifiers. Given files are lexed one by one and summed
+// up, e.g. `bench_lexer $(find /usr/include -name '*.h')`.
+//
+// For every input reports bytes/sec, tokens/sec, operator new calls per 1000
+// tokens and peak RSS of the process so far. Allocations of the string table
+// arena go through malloc and are not counted, they are one per 64KB.
+
+#include "lexer.hpp"
+
+#include <new>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+using namespace compiler;
+
+static constexpr unsigned int generated_size = 16 << 20;
+
+static unsigned long allocations = 0;
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if(auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+static long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// a piece of ordinary code
+static std::string mixed_unit(unsigned int i) {
+    auto n = std::to_string(i);
+    return "/* function " + n + ", generated for benchmarking */\n"
+           "static int func_" + n + "(int arg, const char *name) {\n"
+           "    int result = arg * " + n + " + 0x1f;\n"
+           "    // accumulate\n"
+           "    for(int k = 0; k < arg; ++k) result += k << 2;\n"
+           "    if(result >= 42 && name != 0) return result - 1;\n"
+           "    return name[0] == 'x' ? result : -result;\n"
+           "}\n\n";
+}
+
+// mostly identifiers, a quarter of them seen for the first time
+static std::string ident_unit(unsigned int i) {
+    auto n = std::to_string(i);
+    auto m = std::to_string(i & 0xfff);
+    return "extern struct context_" + m + " *global_state_" + n + ";\n"
+           "typedef unsigned long handle_type_" + m + ";\n"
+           "static handle_type_" + m + " lookup_" + n + "(struct context_" + m + " *ctx, handle_type_" + m + " key) {\n"
+           "    return ctx->table_entries[key & ctx->table_mask].value_field;\n"
+           "}\n";
+}
+
+// constant tables in every notation of integers and floats
+static std::string numeric_unit(unsigned int i) {
+    auto n = std::to_string(i);
+    return "static const double table_" + n + "[] = {\n"
+           "    " + n + ", 0x" + std::to_string(i * 7 % 100000) + "fu, 0777, 42ull, 1234567890L,\n"
+           "    3.14159265358979, 2.5e+10, .5f, 1e-9L, 0x1.8p3, 6.02214076e23, 1.f,\n"
+           "    " + n + ".25, " + n + "e-3, 0xdeadbeef, 0x7fffffffffffffffLL, 100000u, 0,\n"
+           "};\n";
+}
+
+// comments outweigh code
+static std::string comment_unit(unsigned int i) {
+    auto n = std::to_string(i);
+    return "/**\n"
+           " * @brief entry number " + n + " of the generated comment-heavy corpus.\n"
+           " *        Block comments like this one are typical of documented headers,\n"
+           " *        they are skipped by the lexer without producing any token.\n"
+           " * @param value the value to be checked ** not a closing star/slash **\n"
+           " */\n"
+           "int check_" + n + "(int value); // returns non-zero on success\n"
+           "// a line comment that runs for quite a while before ending at the newline\n"
+           "/* short */ /* comments */ /* in a row */\n\n";
+}
+
+// long string literals with escapes
+static std::string string_unit(unsigned int i) {
+    auto n = std::to_string(i);
+    return "static const char *message_" + n + " =\n"
+           "    \"The quick brown fox jumps over the lazy dog, message " + n + " of a long series of string literals.\\n\"\n"
+           "    \"\\tSecond line with \\\"quotes\\\", a backslash \\\\ and octal \\101\\102\\103 and hex \\x44\\x45.\\n\"\n"
+           "    \"Third line is plain text again, long enough to dominate the time spent per token here.\";\n"
+           "static const char initial_" + n + " = 'x', escaped_" + n + " = '\\n';\n";
+}
+
+// identifiers and text in UTF-8
+static std::string utf8_unit(unsigned int i) {
+    auto n = std::to_string(i);
+    return "/* Größe und Länge, café " + n + " */\n"
+           "static double größe_" + n + " = 1.0, länge_" + n + " = 2.0;\n"
+           "static const char *straße_" + n + " = \"naïve façade, 東京, Ελληνικά\";\n"
+           "double fläche_" + n + "(double breite, double höhe) {\n"
+           "    return größe_" + n + " * breite * höhe / länge_" + n + ";\n"
+           "}\n";
+}
+
+static std::string generate_input(std::string (*unit)(unsigned int)) {
+    char path[] = "/tmp/bench_lexer_XXXXXX.c";
+    int fd = mkstemps(path, 2);
+    if(fd < 0) {
+        std::perror("mkstemps");
+        std::exit(EXIT_FAILURE);
+    }
+    
+    std::string text{};
+    for(unsigned int i = 0; text.size() < generated_size; ++i)
+        text += unit(i);
+    if(write(fd, text.data(), text.size()) != static_cast<ssize_t>(text.size())) {
+        std::perror("write");
+        std::exit(EXIT_FAILURE);
+    }
+    close(fd);
+    return path;
+}
+
+struct result {
+    double        bytes;
+    double        seconds;
+    unsigned long tokens;
+    unsigned long allocations;
+};
+
+static void print_header() {
+    std::printf("%-24s %9s %9s %9s %9s %11s %10s\n",
+                "input", "MB", "ms", "MB/s", "Mtok/s", "allocs/ktok", "peak RSS");
+}
+
+static void print_row(const char *name, const result &r) {
+    auto mb = r.bytes / (1 << 20);
+    std::printf("%-24s %9.2f %9.2f %9.2f %9.2f %11.2f %7ld KB\n",
+                name, mb, r.seconds * 1e3, mb / r.seconds, r.tokens / r.seconds / 1e6,
+                r.tokens ? r.allocations * 1e3 / r.tokens : 0.0, peak_rss_kb());
+}
+
+// lexes a file to the end, false if the lexer reports an error
+static bool run(const char *path, result &r) {
+    using clock = std::chrono::steady_clock;
+    
+    struct stat st;
+    if(stat(path, &st)) {
+        std::perror(path);
+        return false;
+    }
+    
+    r = {static_cast<double>(st.st_size), 0, 0, 0};
+    auto allocs = allocations;
+    auto start = clock::now();
+    try {
+        lexer lex(path);
+        for(auto tok = lex.get(); !tok->is(Eof); tok = lex.get())
+            ++r.tokens;
+    } catch(int) {
+        return false;
+    }
+    r.seconds = std::chrono::duration<double>(clock::now() - start).count();
+    r.allocations = allocations - allocs;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    print_header();
+    if(argc < 2) {
+        static const struct {
+            const char *name;
+            std::string (*unit)(unsigned int);
+        } corpus[] = {
+            {"mixed", mixed_unit},
+            {"identifiers", ident_unit},
+            {"numbers", numeric_unit},
+            {"comments", comment_unit},
+            {"strings", string_unit},
+            {"utf-8", utf8_unit},
+        };
+        
+        int status = EXIT_SUCCESS;
+        for(auto &&c: corpus) {
+            auto path = generate_input(c.unit);
+            result r;
+            if(run(path.c_str(), r))
+                print_row(c.name, r);
+            else {
+                std::printf("%-24s failed\n", c.name);
+                status = EXIT_FAILURE;
+            }
+            unlink(path.c_str());
+        }
+        return status;
+    }
+    
+    result total = {0, 0, 0, 0};
+    int failed = 0;
+    for(int i = 1; i < argc; ++i) {
+        result r;
+        if(!run(argv[i], r)) {
+            std::printf("%-24s failed\n", argv[i]);
+            ++failed;
+            continue;
+        }
+        print_row(argv[i], r);
+        total.bytes += r.bytes;
+        total.seconds += r.seconds;
+        total.tokens += r.tokens;
+        total.allocations += r.allocations;
+    }
+    if(argc > 2) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "total (%d failed)", failed);
+        print_row(name, total);
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,213 @@
+// Macro expansion benchmark.
+//
+// usage: bench_macro [file...]
+// Without arguments generated units are preprocessed, each stressing one
+// shape of macro-heavy code: constants, nested function-like calls, X-macros,
+// chains of macros calling each other, and # / ## heavy field generators.
+// Given files are preprocessed one by one instead.
+//
+// For every input reports time, tokens out of the preprocessor per second
+// and operator new calls per 1000 tokens out. Macro names of different
+// units do not clash, they all run in one process.
+
+#include "cpp.hpp"
+
+#include <new>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace compiler;
+
+static constexpr unsigned int generated_size = 4 << 20;
+
+static unsigned long allocations = 0;
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if(auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+// object-like macros only
+static std::string constant_defs() {
+    std::string text{};
+    for(unsigned int i = 0; i < 256; ++i)
+        text += "#define CONST_" + std::to_string(i) + " " + std::to_string(i * 3) + "\n";
+    text += "#define CONST_SUM (CONST_1 + CONST_2 + CONST_3)\n";
+    return text;
+}
+
+static std::string constant_unit(unsigned int i) {
+    auto n = std::to_string(i & 0xff);
+    return "int c_" + std::to_string(i) + " = CONST_" + n + " * CONST_SUM + CONST_" + n + ";\n";
+}
+
+// function-like macros nested in their own arguments
+static std::string nested_defs() {
+    return "#define MAX(a, b) ((a) > (b) ? (a) : (b))\n"
+           "#define MIN(a, b) ((a) < (b) ? (a) : (b))\n"
+           "#define CLAMP(x, lo, hi) MIN(MAX(x, lo), hi)\n"
+           "#define SQR(x) ((x) * (x))\n";
+}
+
+static std::string nested_unit(unsigned int i) {
+    auto n = std::to_string(i);
+    return "int n_" + n + " = CLAMP(SQR(MAX(a, " + n + ")), MIN(b, SQR(c)), MAX(MAX(d, e), MIN(f, " + n + ")));\n";
+}
+
+// one list, expanded by a different X each time
+static std::string xmacro_defs() {
+    std::string text = "#define COLORS(X) \\\n";
+    for(unsigned int i = 0; i < 32; ++i)
+        text += "    X(color_" + std::to_string(i) + ", " + std::to_string(i * 0x10101) + ") \\\n";
+    text += "\n"
+            "#define AS_ENUM(name, value) name = value,\n"
+            "#define AS_NAME(name, value) #name,\n"
+            "#define AS_CASE(name, value) case name: return value;\n";
+    return text;
+}
+
+static std::string xmacro_unit(unsigned int i) {
+    auto n = std::to_string(i);
+    return "enum colors_" + n + " { COLORS(AS_ENUM) };\n"
+           "static const char *names_" + n + "[] = { COLORS(AS_NAME) };\n"
+           "int value_" + n + "(int c) { switch(c) { COLORS(AS_CASE) } return 0; }\n";
+}
+
+// each macro calls the next one, and two of them look recursive
+static std::string chain_defs() {
+    std::string text{};
+    for(unsigned int i = 0; i < 16; ++i)
+        text += "#define STEP_" + std::to_string(i) + "(x) STEP_" + std::to_string(i + 1) + "((x) + " + std::to_string(i) + ")\n";
+    text += "#define STEP_16(x) (x)\n"
+            "#define PING(x) PONG(x) + 1\n"
+            "#define PONG(x) PING(x) * 2\n";
+    return text;
+}
+
+static std::string chain_unit(unsigned int i) {
+    auto n = std::to_string(i);
+    return "int s_" + n + " = STEP_0(" + n + ") + PING(STEP_8(y));\n";
+}
+
+// # and ## in every expansion
+static std::string paste_defs() {
+    return "#define FIELD(type, name) type field_##name; const char *name_##name = #name;\n"
+           "#define FIELDS(prefix) FIELD(int, prefix##_id) FIELD(double, prefix##_weight) FIELD(char, prefix##_tag)\n";
+}
+
+static std::string paste_unit(unsigned int i) {
+    return "struct record_" + std::to_string(i) + " { FIELDS(r" + std::to_string(i) + ") };\n";
+}
+
+static std::string generate_input(const std::string &defs, std::string (*unit)(unsigned int)) {
+    char path[] = "/tmp/bench_macro_XXXXXX.c";
+    int fd = mkstemps(path, 2);
+    if(fd < 0) {
+        std::perror("mkstemps");
+        std::exit(EXIT_FAILURE);
+    }
+    
+    auto text = defs;
+    for(unsigned int i = 0; text.size() < generated_size; ++i)
+        text += unit(i);
+    if(write(fd, text.data(), text.size()) != static_cast<ssize_t>(text.size())) {
+        std::perror("write");
+        std::exit(EXIT_FAILURE);
+    }
+    close(fd);
+    return path;
+}
+
+struct result {
+    double        bytes;
+    double        seconds;
+    unsigned long tokens;
+    unsigned long allocations;
+};
+
+static void print_header() {
+    std::printf("%-24s %9s %9s %9s %11s\n", "input", "MB", "ms", "Mtok/s", "allocs/ktok");
+}
+
+static void print_row(const char *name, const result &r) {
+    std::printf("%-24s %9.2f %9.2f %9.2f %11.2f\n", name, r.bytes / (1 << 20), r.seconds * 1e3,
+                r.tokens / r.seconds / 1e6, r.tokens ? r.allocations * 1e3 / r.tokens : 0.0);
+}
+
+// preprocesses a file to the end, false if an error is reported
+static bool run(const char *path, result &r) {
+    using clock = std::chrono::steady_clock;
+    
+    struct stat st;
+    if(stat(path, &st)) {
+        std::perror(path);
+        return false;
+    }
+    
+    r = {static_cast<double>(st.st_size), 0, 0, 0};
+    auto allocs = allocations;
+    auto start = clock::now();
+    try {
+        cpp pp(path);
+        for(auto tok = pp.get(); tok && !tok->is(Eof); tok = pp.get())
+            ++r.tokens;
+    } catch(int) {
+        return false;
+    }
+    r.seconds = std::chrono::duration<double>(clock::now() - start).count();
+    r.allocations = allocations - allocs;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    print_header();
+    int status = EXIT_SUCCESS;
+    if(argc < 2) {
+        static const struct {
+            const char *name;
+            std::string (*defs)();
+            std::string (*unit)(unsigned int);
+        } corpus[] = {
+            {"constants", constant_defs, constant_unit},
+            {"nested calls", nested_defs, nested_unit},
+            {"x-macros", xmacro_defs, xmacro_unit},
+            {"chains", chain_defs, chain_unit},
+            {"# and ##", paste_defs, paste_unit},
+        };
+        
+        for(auto &&c: corpus) {
+            auto path = generate_input(c.defs(), c.unit);
+            result r;
+            if(run(path.c_str(), r))
+                print_row(c.name, r);
+            else {
+                std::printf("%-24s failed\n", c.name);
+                status = EXIT_FAILURE;
+            }
+            unlink(path.c_str());
+        }
+        return status;
+    }
+    
+    for(int i = 1; i < argc; ++i) {
+        result r;
+        if(run(argv[i], r))
+            print_row(argv[i], r);
+        else {
+            std::printf("%-24s failed\n", argv[i]);
+            status = EXIT_FAILURE;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,147 @@
+// Parser benchmark.
+//
+// usage: bench_parse [file.c]
+// A large unit of structs and functions in the subset of C the parser
+// handles is generated, or the given one is used. It is parsed into an AST
+// in a child process, which reports the wall-clock time and what the
+// compilation arena and pool hold; the parent reports the peak RSS of the child.
+// Reports the best time of a few runs.
+
+#include "parser.hpp"
+#include "context.hpp"
+#include "mempool.hpp"
+
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+using namespace compiler;
+
+static constexpr unsigned int functions = 20000;
+static constexpr int runs = 3;
+
+// what a child sends back
+struct result {
+    double m_seconds; // negative on failure
+    std::size_t m_chunks;
+    std::size_t m_allocated;
+    std::size_t m_reserved;
+    // of the pool
+    std::size_t m_used[sizepool::classes];
+    std::size_t m_large;
+    std::size_t m_high_water;
+    std::size_t m_pool_reserved;
+    long m_peak_rss; // KB, filled in by the parent
+};
+
+static std::string generate_input() {
+    char path[] = "/tmp/bench_parse_XXXXXX.c";
+    auto fd = mkstemps(path, 2);
+    if(fd < 0) {
+        std::perror("mkstemps");
+        std::exit(EXIT_FAILURE);
+    }
+    
+    std::string text = "struct point { int x; int y; };\n"
+                       "int add(int a, int b) { return a + b; }\n";
+    for(unsigned int i = 0; i < functions; ++i) {
+        auto n = std::to_string(i);
+        text += "struct s" + n + " { int a; long b; char c[8]; };\n"
+                "long f" + n + "(long a, long b, struct point *p) {\n"
+                "    long s = " + n + ";\n"
+                "    while(s < a) s = s + b;\n"
+                "    do { s = s - 1; } while(s > b);\n"
+                "    if(a > b) { long t = a * 2; s = t - b; } else s = b - a;\n"
+                "    s = s * 3 + (p->x << 2) - add(p->y, 7);\n"
+                "    return s > 100 ? s : -s;\n"
+                "}\n";
+    }
+    if(write(fd, text.data(), text.size()) != static_cast<ssize_t>(text.size())) {
+        std::perror(path);
+        std::exit(EXIT_FAILURE);
+    }
+    close(fd);
+    return path;
+}
+
+static result run(const std::string &unit) {
+    result r{};
+    r.m_seconds = -1;
+    int fds[2];
+    if(pipe(fds)) return r;
+    auto pid = fork();
+    if(pid < 0) return r;
+    if(!pid) {
+        using clock = std::chrono::steady_clock;
+        close(fds[0]);
+        auto start = clock::now();
+        try {
+            parser p(unit.c_str());
+            p.process();
+            r.m_seconds = std::chrono::duration<double>(clock::now() - start).count();
+            auto &&memory = compilation_arena();
+            r.m_chunks = memory.chunks();
+            r.m_allocated = memory.allocated();
+            r.m_reserved = memory.reserved();
+            auto &&pool = compilation_pool();
+            for(std::size_t i = 0; i < sizepool::classes; ++i)
+                r.m_used[i] = pool.used(i);
+            r.m_large = pool.large();
+            r.m_high_water = pool.high_water();
+            r.m_pool_reserved = pool.reserved();
+        } catch(int) {}
+        if(write(fds[1], &r, sizeof(r)) != sizeof(r)) r.m_seconds = -1;
+        // nothing is freed, as in a compiler about to exit
+        _exit(r.m_seconds < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    
+    close(fds[1]);
+    if(read(fds[0], &r, sizeof(r)) != sizeof(r)) r.m_seconds = -1;
+    close(fds[0]);
+    int status;
+    rusage usage;
+    if(wait4(pid, &status, 0, &usage) == pid)
+        r.m_peak_rss = usage.ru_maxrss;
+    return r;
+}
+
+int main(int argc, char *argv[]) {
+    auto unit = argc > 1 ? std::string(argv[1]) : generate_input();
+    
+    // the first run also brings the file into the page cache
+    run(unit);
+    result best{};
+    best.m_seconds = -1;
+    for(int i = 0; i < runs; ++i) {
+        auto r = run(unit);
+        if(r.m_seconds < 0) {
+            std::printf("%s: failed\n", unit.c_str());
+            best.m_seconds = -1;
+            break;
+        }
+        if(best.m_seconds < 0 || r.m_seconds < best.m_seconds) best = r;
+    }
+    
+    if(best.m_seconds >= 0) {
+        std::printf("%s\n", unit.c_str());
+        std::printf("%-12s %9.2f\n", "ms", best.m_seconds * 1e3);
+        std::printf("%-12s %9.1f\n", "peak RSS MB", best.m_peak_rss / 1024.0);
+        std::printf("%-12s %9.1f in %zu chunks, %.1f MB used\n", "arena MB", best.m_reserved / double(1 << 20),
+                    best.m_chunks, best.m_allocated / double(1 << 20));
+        std::printf("%-12s %9.1f, %.1f MB at most in use\n", "pool MB", best.m_pool_reserved / double(1 << 20),
+                    best.m_high_water / double(1 << 20));
+        for(std::size_t i = 0; i < sizepool::classes; ++i) {
+            if(best.m_used[i])
+                std::printf("  %4zu bytes %9.1f KB in use\n", sizepool::class_size(i), best.m_used[i] / 1024.0);
+        }
+        if(best.m_large)
+            std::printf("  %10s %9.1f KB in use\n", "larger", best.m_large / 1024.0);
+    }
+    if(argc < 2) unlink(unit.c_str());
+    return best.m_seconds < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+// Include prefetch benchmark.
+//
+// usage: bench_prefetch [threads...]
+// A translation unit including many large, independent, guarded headers is
+// generated, headers written the way glibc headers are: declarations with
+// comments and attributes behind macros. It is preprocessed serially, then
+// with the given numbers of prefetch threads, 1 2 4 8 16 by default.
+//
+// Every run is a child process of its own, so guards, macros and the files
+// lexed ahead of one run are not seen by the next. Reports the best of a few
+// runs in wall-clock time and the speedup over the serial one.
+
+#include "cpp.hpp"
+#include "include_prefetch.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace compiler;
+
+static constexpr unsigned int headers = 64;
+static constexpr unsigned int header_size = 256 << 10;
+static constexpr int runs = 3;
+
+static std::string declaration(const std::string &name) {
+    return "/* Write formatted output to S from the format string FORMAT.\n"
+           "   This function is a possible cancellation point. */\n"
+           "extern int " + name + " (char *__restrict __s, size_t __maxlen,\n"
+           "\t\t     const char *__restrict __format, ...)\n"
+           "     __THROWNL __attribute__ ((__format__ (__printf__, 3, 4)));\n";
+}
+
+static void write_file(const std::string &path, const std::string &text) {
+    auto file = std::fopen(path.c_str(), "w");
+    if(!file || std::fwrite(text.data(), 1, text.size(), file) != text.size()) {
+        std::perror(path.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    std::fclose(file);
+}
+
+// the directory of the headers and the unit, the unit is "unit.c"
+static std::string generate_input() {
+    char dir[] = "/tmp/bench_prefetch_XXXXXX";
+    if(!mkdtemp(dir)) {
+        std::perror("mkdtemp");
+        std::exit(EXIT_FAILURE);
+    }
+    
+    std::string unit = "#define __THROWNL __attribute__ ((__nothrow__))\n";
+    for(unsigned int i = 0; i < headers; ++i) {
+        auto n = std::to_string(i);
+        std::string text = "#ifndef HEADER_" + n + "_H\n#define HEADER_" + n + "_H 1\n";
+        for(unsigned int j = 0; text.size() < header_size; ++j)
+            text += declaration("f" + n + "_" + std::to_string(j));
+        write_file(std::string(dir) + "/header_" + n + ".h", text + "#endif\n");
+        unit += "#include \"header_" + n + ".h\"\n";
+    }
+    write_file(std::string(dir) + "/unit.c", unit);
+    return dir;
+}
+
+// wall-clock seconds to preprocess the unit in a child, negative on failure
+static double run(const std::string &unit, unsigned int threads) {
+    int fds[2];
+    if(pipe(fds)) return -1;
+    auto pid = fork();
+    if(pid < 0) return -1;
+    if(!pid) {
+        using clock = std::chrono::steady_clock;
+        close(fds[0]);
+        double seconds = -1;
+        set_include_prefetch(threads);
+        auto start = clock::now();
+        try {
+            cpp pp(unit.c_str());
+            for(auto tok = pp.get(); tok && !tok->is(Eof); tok = pp.get())
+                ;
+            seconds = std::chrono::duration<double>(clock::now() - start).count();
+        } catch(int) {}
+        if(write(fds[1], &seconds, sizeof(seconds)) != sizeof(seconds)) seconds = -1;
+        // the threads are not waited for
+        _exit(seconds < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    
+    close(fds[1]);
+    double seconds = -1;
+    if(read(fds[0], &seconds, sizeof(seconds)) != sizeof(seconds)) seconds = -1;
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return seconds;
+}
+
+static double best(const std::string &unit, unsigned int threads) {
+    double result = -1;
+    for(int i = 0; i < runs; ++i) {
+        auto seconds = run(unit, threads);
+        if(seconds < 0) return -1;
+        if(result < 0 || seconds < result) result = seconds;
+    }
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<unsigned int> threads{};
+    for(int i = 1; i < argc; ++i)
+        threads.push_back(std::strtoul(argv[i], nullptr, 10));
+    if(threads.empty())
+        threads = {1, 2, 4, 8, 16};
+    
+    auto dir = generate_input();
+    auto unit = dir + "/unit.c";
+    std::printf("%u headers, %.1f MB, %ld CPUs\n", headers, headers * (header_size / double(1 << 20)),
+                sysconf(_SC_NPROCESSORS_ONLN));
+    std::printf("%-10s %9s %9s\n", "threads", "ms", "speedup");
+    
+    int status = EXIT_SUCCESS;
+    // the first run also brings the files into the page cache
+    run(unit, 0);
+    auto serial = best(unit, 0);
+    if(serial < 0) {
+        std::printf("%-10s failed\n", "serial");
+        status = EXIT_FAILURE;
+    } else {
+        std::printf("%-10s %9.2f %9.2f\n", "serial", serial * 1e3, 1.0);
+        for(auto n: threads) {
+            auto seconds = best(unit, n);
+            if(seconds < 0) {
+                std::printf("%-10u failed\n", n);
+                status = EXIT_FAILURE;
+            } else
+                std::printf("%-10u %9.2f %9.2f\n", n, seconds * 1e3, serial / seconds);
+        }
+    }
+    
+    for(unsigned int i = 0; i < headers; ++i)
+        unlink((dir + "/header_" + std::to_string(i) + ".h").c_str());
+    unlink(unit.c_str());
+    rmdir(dir.c_str());
+    return status;
+}
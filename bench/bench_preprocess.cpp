@@ -0,0 +1,194 @@
+// Preprocess-only benchmark.
+//
+// usage: bench_preprocess [file.c] [cpp]
+// A unit with macro-heavy code and a few headers is generated, or the given
+// one is used. It is preprocessed to /dev/null as -E does, printing every
+// token, and by the system preprocessor, `cpp` or the given command, with the
+// output going to /dev/null as well.
+//
+// Every run is a child process of its own. Reports the best of a few runs in
+// wall-clock time, the output in MB/s, and the time of the system
+// preprocessor relative to ours.
+
+#include "cpp.hpp"
+#include "token_printer.hpp"
+
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace compiler;
+
+static constexpr unsigned int headers = 8;
+static constexpr unsigned int unit_size = 4 << 20;
+static constexpr unsigned int header_size = 256 << 10;
+static constexpr int runs = 3;
+
+typedef std::chrono::steady_clock bench_clock;
+
+static void write_file(const std::string &path, const std::string &text) {
+    auto file = std::fopen(path.c_str(), "w");
+    if(!file || std::fwrite(text.data(), 1, text.size(), file) != text.size()) {
+        std::perror(path.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    std::fclose(file);
+}
+
+// the directory of the headers and the unit, the unit is "unit.c"
+static std::string generate_input() {
+    char dir[] = "/tmp/bench_preprocess_XXXXXX";
+    if(!mkdtemp(dir)) {
+        std::perror("mkdtemp");
+        std::exit(EXIT_FAILURE);
+    }
+    
+    std::string unit{};
+    for(unsigned int i = 0; i < headers; ++i) {
+        auto n = std::to_string(i);
+        std::string text = "#ifndef HEADER_" + n + "_H\n#define HEADER_" + n + "_H 1\n"
+                           "#define MAX_" + n + "(a, b) ((a) > (b) ? (a) : (b))\n";
+        for(unsigned int j = 0; text.size() < header_size; ++j) {
+            auto name = "f" + n + "_" + std::to_string(j);
+            text += "/* Returns the larger of A and B. */\n"
+                    "extern int " + name + " (const char *__restrict __s,\n"
+                    "\t\t     unsigned long __n) __attribute__ ((__nothrow__));\n";
+        }
+        write_file(std::string(dir) + "/header_" + n + ".h", text + "#endif\n");
+        unit += "#include \"header_" + n + ".h\"\n";
+    }
+    unit += "#define FIELDS(X) X(int, id) X(long, size) X(char *, name)\n"
+            "#define DECLARE(type, name) type name;\n"
+            "#define CAT(a, b) a ## b\n"
+            "#define STR(a) #a\n";
+    for(unsigned int i = 0; unit.size() < unit_size; ++i) {
+        auto n = std::to_string(i);
+        unit += "struct CAT(s, " + n + ") {\n    FIELDS(DECLARE)\n};\n"
+                "static int g" + n + "(int a, int b) {\n"
+                "    const char *s = STR(a + b);\n"
+                "    return MAX_" + std::to_string(i % headers) + "(a, b) + " + n + ";\n"
+                "}\n";
+    }
+    write_file(std::string(dir) + "/unit.c", unit);
+    return dir;
+}
+
+static bool redirect_output() {
+    auto null = open("/dev/null", O_WRONLY);
+    return null >= 0 && dup2(null, STDOUT_FILENO) >= 0;
+}
+
+// wall-clock seconds to preprocess the unit in a child, negative on failure;
+// the system preprocessor with `command`, ours without
+static double run(const std::string &unit, const char *command) {
+    int fds[2];
+    if(pipe(fds)) return -1;
+    auto start = bench_clock::now();
+    auto pid = fork();
+    if(pid < 0) return -1;
+    if(!pid) {
+        close(fds[0]);
+        if(!redirect_output()) _exit(EXIT_FAILURE);
+        if(command) {
+            close(fds[1]);
+            execlp(command, command, unit.c_str(), static_cast<char*>(nullptr));
+            _exit(EXIT_FAILURE);
+        }
+        double seconds = -1;
+        auto begin = bench_clock::now();
+        try {
+            cpp pp(unit.c_str());
+            token_printer out(STDOUT_FILENO);
+            for(auto tok = pp.get(); !tok->is(Eof); tok = pp.get())
+                out.print(tok, pp.origin());
+            out.flush();
+            seconds = std::chrono::duration<double>(bench_clock::now() - begin).count();
+        } catch(int) {}
+        if(write(fds[1], &seconds, sizeof(seconds)) != sizeof(seconds)) seconds = -1;
+        _exit(seconds < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    
+    close(fds[1]);
+    double seconds = -1;
+    if(!command && read(fds[0], &seconds, sizeof(seconds)) != sizeof(seconds)) seconds = -1;
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    // a command is timed from the fork, it starts a process of its own anyway
+    if(command)
+        seconds = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS ?
+                  std::chrono::duration<double>(bench_clock::now() - start).count() : -1;
+    return seconds;
+}
+
+static double best(const std::string &unit, const char *command) {
+    double result = -1;
+    for(int i = 0; i < runs; ++i) {
+        auto seconds = run(unit, command);
+        if(seconds < 0) return -1;
+        if(result < 0 || seconds < result) result = seconds;
+    }
+    return result;
+}
+
+// size of the output of our -E, to report a throughput
+static std::size_t output_size(const std::string &unit) {
+    std::size_t size = 0;
+    try {
+        cpp pp(unit.c_str());
+        char path[] = "/tmp/bench_preprocess_out_XXXXXX";
+        auto fd = mkstemp(path);
+        if(fd < 0) return 0;
+        {
+            token_printer out(fd);
+            for(auto tok = pp.get(); !tok->is(Eof); tok = pp.get())
+                out.print(tok, pp.origin());
+            out.flush();
+        }
+        size = lseek(fd, 0, SEEK_END);
+        close(fd);
+        unlink(path);
+    } catch(int) {}
+    return size;
+}
+
+int main(int argc, char *argv[]) {
+    auto generated = argc < 2;
+    auto dir = generated ? generate_input() : std::string();
+    auto unit = generated ? dir + "/unit.c" : std::string(argv[1]);
+    auto command = argc > 2 ? argv[2] : "cpp";
+    
+    // the first run also brings the files into the page cache
+    run(unit, nullptr);
+    auto size = output_size(unit);
+    std::printf("%s, %.1f MB out\n", unit.c_str(), size / double(1 << 20));
+    std::printf("%-10s %9s %9s %9s\n", "", "ms", "MB/s", "relative");
+    
+    int status = EXIT_SUCCESS;
+    auto ours = best(unit, nullptr);
+    if(ours < 0) {
+        std::printf("%-10s failed\n", "-E");
+        status = EXIT_FAILURE;
+    } else {
+        std::printf("%-10s %9.2f %9.1f %9.2f\n", "-E", ours * 1e3, size / ours / (1 << 20), 1.0);
+        auto system = best(unit, command);
+        if(system < 0)
+            std::printf("%-10s failed\n", command);
+        else
+            std::printf("%-10s %9.2f %9.1f %9.2f\n", command, system * 1e3, size / system / (1 << 20),
+                        system / ours);
+    }
+    
+    if(generated) {
+        for(unsigned int i = 0; i < headers; ++i)
+            unlink((dir + "/header_" + std::to_string(i) + ".h").c_str());
+        unlink(unit.c_str());
+        rmdir(dir.c_str());
+    }
+    return status;
+}
@@ -0,0 +1,168 @@
+// Skipped conditional group benchmark.
+//
+// usage: bench_skip [file...]
+// Without arguments generated headers are preprocessed, written the way
+// glibc headers are: long declarations with comments and attributes inside
+// large #if 0 blocks, #if/#elif chains of which one platform is taken, and
+// feature test blocks nested a few levels deep. Given files are preprocessed
+// one by one instead.
+//
+// For every input reports the best of a few runs, with the text skipped or
+// read per second and the tokens out of the preprocessor.
+
+#include "cpp.hpp"
+
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace compiler;
+
+static constexpr unsigned int generated_size = 8 << 20;
+static constexpr int runs = 5;
+
+// a declaration as glibc writes it
+static std::string declaration(const std::string &name) {
+    return "/* Write formatted output to S from the format string FORMAT.\n"
+           "   This function is a possible cancellation point. */\n"
+           "extern int " + name + " (char *__restrict __s, size_t __maxlen,\n"
+           "\t\t     const char *__restrict __format, ...)\n"
+           "     __THROWNL __attribute__ ((__format__ (__printf__, 3, 4))); // \"note\"\n";
+}
+
+static std::string block(const std::string &prefix, unsigned int n) {
+    std::string text{};
+    for(unsigned int i = 0; i < n; ++i)
+        text += declaration(prefix + std::to_string(i));
+    return text;
+}
+
+static std::string if0_unit(unsigned int i) {
+    auto n = std::to_string(i);
+    return "#if 0\n" + block("old_" + n + "_", 50) + "#endif\n"
+           "extern int live_" + n + " (void);\n";
+}
+
+static std::string platform_unit(unsigned int i) {
+    static const char *arches[] = {"__aarch64__", "__arm__", "__powerpc64__", "__s390x__", "__mips__", "__riscv"};
+    auto n = std::to_string(i);
+    std::string text = "#if defined __i386__\n" + block("i386_" + n + "_", 6);
+    for(auto arch: arches)
+        text += "#elif defined " + std::string(arch) + "\n" + block(arch + n + "_", 6);
+    return text + "#else\nextern int generic_" + n + " (void);\n#endif\n";
+}
+
+static std::string nested_unit(unsigned int i) {
+    auto n = std::to_string(i);
+    return "#ifdef __USE_GNU\n"
+           "# ifdef __USE_XOPEN2K8\n" + block("gnu_xopen_" + n + "_", 8) +
+           "# else\n" + block("gnu_" + n + "_", 8) + "# endif\n"
+           "# if __WORDSIZE == 64 && !defined __NO_LONG_DOUBLE_MATH\n" + block("gnu64_" + n + "_", 8) + "# endif\n"
+           "#endif /* __USE_GNU */\n"
+           "extern int base_" + n + " (void);\n";
+}
+
+static std::string generate_input(std::string (*unit)(unsigned int)) {
+    char path[] = "/tmp/bench_skip_XXXXXX.h";
+    int fd = mkstemps(path, 2);
+    if(fd < 0) {
+        std::perror("mkstemps");
+        std::exit(EXIT_FAILURE);
+    }
+    
+    std::string text{};
+    for(unsigned int i = 0; text.size() < generated_size; ++i)
+        text += unit(i);
+    if(write(fd, text.data(), text.size()) != static_cast<ssize_t>(text.size())) {
+        std::perror("write");
+        std::exit(EXIT_FAILURE);
+    }
+    close(fd);
+    return path;
+}
+
+struct result {
+    double        bytes;
+    double        seconds;
+    unsigned long tokens;
+};
+
+static void print_header() {
+    std::printf("%-24s %9s %9s %9s %9s\n", "input", "MB", "ms", "MB/s", "Ktok out");
+}
+
+static void print_row(const char *name, const result &r) {
+    std::printf("%-24s %9.2f %9.2f %9.1f %9.1f\n", name, r.bytes / (1 << 20), r.seconds * 1e3,
+                r.bytes / (1 << 20) / r.seconds, r.tokens / 1e3);
+}
+
+// preprocesses a file to the end, best of `runs`; false if an error is reported
+static bool run(const char *path, result &r) {
+    using clock = std::chrono::steady_clock;
+    
+    struct stat st;
+    if(stat(path, &st)) {
+        std::perror(path);
+        return false;
+    }
+    
+    r = {static_cast<double>(st.st_size), 0, 0};
+    for(int i = 0; i < runs; ++i) {
+        unsigned long tokens = 0;
+        auto start = clock::now();
+        try {
+            cpp pp(path);
+            for(auto tok = pp.get(); tok && !tok->is(Eof); tok = pp.get())
+                ++tokens;
+        } catch(int) {
+            return false;
+        }
+        auto seconds = std::chrono::duration<double>(clock::now() - start).count();
+        if(!i || seconds < r.seconds) r.seconds = seconds;
+        r.tokens = tokens;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    print_header();
+    int status = EXIT_SUCCESS;
+    if(argc < 2) {
+        static const struct {
+            const char *name;
+            std::string (*unit)(unsigned int);
+        } corpus[] = {
+            {"#if 0 blocks", if0_unit},
+            {"platform blocks", platform_unit},
+            {"nested features", nested_unit},
+        };
+        
+        for(auto &&c: corpus) {
+            auto path = generate_input(c.unit);
+            result r;
+            if(run(path.c_str(), r))
+                print_row(c.name, r);
+            else {
+                std::printf("%-24s failed\n", c.name);
+                status = EXIT_FAILURE;
+            }
+            unlink(path.c_str());
+        }
+        return status;
+    }
+    
+    for(int i = 1; i < argc; ++i) {
+        result r;
+        if(run(argv[i], r))
+            print_row(argv[i], r);
+        else {
+            std::printf("%-24s failed\n", argv[i]);
+            status = EXIT_FAILURE;
+        }
+    }
+    return status;
+}
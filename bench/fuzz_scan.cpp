@@ -0,0 +1,123 @@
+// Scanner equivalence fuzzer.
+//
+// usage: fuzz_scan [rounds [seed]]
+// Checks the scanners of scan.cpp against byte-by-byte reference loops on
+// random texts, 10000 rounds by default. The kernels are chosen when scan.cpp
+// is compiled, so build it again with -mavx2 or -DCC_SCALAR_SCAN to check
+// the AVX2 or the portable ones; the default build checks SSE2.
+//
+// Texts are drawn mostly from the bytes the scanners stop at, and end with
+// the '\0' at the last byte of a page followed by an inaccessible one, so a
+// kernel loading past the terminator's page crashes. Every scanner is run
+// from every position of the text, which covers every alignment. Prints the
+// first mismatch of each round and exits with failure if there is any.
+
+#include "scan.hpp"
+
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace compiler;
+
+namespace {
+
+typedef const char* (*scanner)(const char*);
+
+const char* reference_line(const char *p) {
+    for(;; ++p) {
+        auto ch = static_cast<unsigned char>(*p);
+        if(ch == '\n' || ch == '\\' || ch == '\0' || ch >= 0x80) return p;
+    }
+}
+
+const char* reference_comment(const char *p) {
+    for(;; ++p) {
+        auto ch = static_cast<unsigned char>(*p);
+        if(ch == '*' || ch == '\n' || ch == '\\' || ch == '\0' || ch >= 0x80) return p;
+    }
+}
+
+const char* reference_skipped(const char *p) {
+    for(;; ++p) {
+        if(std::strchr("\n\\/\"'", *p)) return p; // also stops at '\0'
+    }
+}
+
+const char* reference_space(const char *p) {
+    while(*p && std::strchr(" \t\v\f\r", *p)) ++p;
+    return p;
+}
+
+struct scanner_pair {
+    const char *m_name;
+    scanner     m_scan;
+    scanner     m_reference;
+};
+
+const scanner_pair scanners[] = {
+    {"scan_line", scan_line, reference_line},
+    {"scan_comment", scan_comment, reference_comment},
+    {"scan_skipped", scan_skipped, reference_skipped},
+    {"scan_space", scan_space, reference_space},
+};
+
+// bytes some scanner stops at or steps over, and a few it does not care about
+const char alphabet[] = " \t\v\f\r\n\\*/\"'#az09\x80\xc3\xa9\xff";
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+    auto rounds = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    auto seed = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1;
+    
+    // the text ends on the first page, the second cannot be read
+    auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    auto pages = static_cast<char*>(mmap(nullptr, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if(pages == MAP_FAILED || mprotect(pages + page, page, PROT_NONE)) {
+        std::perror("mmap");
+        return EXIT_FAILURE;
+    }
+    
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<std::size_t> length(0, 300);
+    std::uniform_int_distribution<std::size_t> pick(0, sizeof(alphabet) - 2);
+    std::uniform_int_distribution<int> any_byte(1, 255);
+    
+    unsigned long failures = 0;
+    for(unsigned long round = 0; round < rounds; ++round) {
+        auto size = length(random);
+        auto text = pages + page - size - 1;
+        for(std::size_t i = 0; i < size; ++i) {
+            // runs of a single byte, as in indentation and comment banners
+            if(i && random() % 4 == 0) text[i] = text[i - 1];
+            else if(random() % 8 == 0) text[i] = static_cast<char>(any_byte(random));
+            else text[i] = alphabet[pick(random)];
+        }
+        text[size] = '\0';
+        
+        for(std::size_t start = 0; start <= size; ++start) {
+            for(auto &s: scanners) {
+                auto got = s.m_scan(text + start), expected = s.m_reference(text + start);
+                if(got == expected) continue;
+                std::printf("round %lu: %s from %zu of %zu bytes stops at %td, expected %td\n",
+                            round, s.m_name, start, size, got - text, expected - text);
+                ++failures;
+                goto next_round;
+            }
+        }
+    next_round:;
+    }
+    
+    munmap(pages, 2 * page);
+    if(failures) {
+        std::printf("%lu of %lu rounds failed\n", failures, rounds);
+        return EXIT_FAILURE;
+    }
+    std::printf("%lu rounds passed\n", rounds);
+    return EXIT_SUCCESS;
+}
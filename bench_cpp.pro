@@ -0,0 +1,43 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+QMAKE_CXXFLAGS = -std=c++11 -O2
+LIBS += -pthread
+
+INCLUDEPATH += $$PWD
+
+SOURCES += bench/bench_cpp.cpp \
+    error.cpp \
+    token.cpp \
+    mempool.cpp \
+    context.cpp \
+    interner.cpp \
+    cpp.cpp \
+    trace.cpp \
+    memory_stats.cpp \
+    token_cache.cpp \
+    include_prefetch.cpp \
+    include_path.cpp \
+    lexer.cpp \
+    source.cpp \
+    scan.cpp
+
+HEADERS += \
+    error.hpp \
+    token.hpp \
+    token_list.hpp \
+    interner.hpp \
+    cpp.hpp \
+    trace.hpp \
+    memory_stats.hpp \
+    token_cache.hpp \
+    include_prefetch.hpp \
+    include_path.hpp \
+    lexer.hpp \
+    source.hpp \
+    scan.hpp \
+    mempool.hpp \
+    context.hpp \
+    concepts/non_copyable.hpp
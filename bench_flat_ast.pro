@@ -0,0 +1,60 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+QMAKE_CXXFLAGS = -std=c++11 -O2
+LIBS += -pthread
+
+INCLUDEPATH += $$PWD
+
+SOURCES += bench/bench_flat_ast.cpp \
+    error.cpp \
+    token.cpp \
+    mempool.cpp \
+    context.cpp \
+    interner.cpp \
+    cpp.cpp\
+    trace.cpp \
+    memory_stats.cpp \
+    token_printer.cpp \
+    evaluator.cpp \
+    parser.cpp \
+    type.cpp \
+    scope.cpp \
+    ast.cpp \
+    lexer.cpp \
+    source.cpp \
+    token_cache.cpp \
+    include_prefetch.cpp \
+    include_path.cpp \
+    scan.cpp \
+    codegen.cpp \
+    flat_ast.cpp
+
+HEADERS += \ 
+    error.hpp \
+    token.hpp \
+    token_list.hpp \
+    interner.hpp \
+    cpp.hpp\
+    trace.hpp \
+    memory_stats.hpp \
+    token_printer.hpp \
+    evaluator.hpp \
+    parser.hpp \
+    ast.hpp \
+    type.hpp \
+    scope.hpp \
+    mempool.hpp \
+    context.hpp \
+    lexer.hpp \
+    source.hpp \
+    token_cache.hpp \
+    include_prefetch.hpp \
+    include_path.hpp \
+    scan.hpp \
+    visitor.hpp \
+    codegen.hpp \
+    flat_ast.hpp \
+    concepts/non_copyable.hpp
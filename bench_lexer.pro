@@ -0,0 +1,39 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+QMAKE_CXXFLAGS = -std=c++11 -O2
+LIBS += -pthread
+
+INCLUDEPATH += $$PWD
+
+SOURCES += bench/bench_lexer.cpp \
+    error.cpp \
+    token.cpp \
+    mempool.cpp \
+    context.cpp \
+    interner.cpp \
+    memory_stats.cpp \
+    lexer.cpp \
+    source.cpp \
+    token_cache.cpp \
+    include_prefetch.cpp \
+    include_path.cpp \
+    scan.cpp
+
+HEADERS += \
+    error.hpp \
+    token.hpp \
+    token_list.hpp \
+    interner.hpp \
+    memory_stats.hpp \
+    lexer.hpp \
+    source.hpp \
+    token_cache.hpp \
+    include_prefetch.hpp \
+    include_path.hpp \
+    scan.hpp \
+    mempool.hpp \
+    context.hpp \
+    concepts/non_copyable.hpp
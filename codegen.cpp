@@ -4,14 +4,8 @@
 #include "error.hpp"
 #include "codegen.hpp"
 
-#include <set>
-
 using namespace compiler;
 
-static unsigned ret_count;
-
-std::set<ast_func*> func_set{}; // for printing uniqueness
-
 std::string IR::pop() {
     if(stack.empty()) error("IR error: stack empty");
     auto res = stack.back();
@@ -19,24 +13,20 @@ std::string IR::pop() {
     return res;
 }
 
-static std::string make_temp() {
-    static unsigned id = 1;
-    return 't' + std::to_string(id++);
+std::string IR::make_temp() {
+    return 't' + std::to_string(temp_count++);
 }
 
-static std::tuple<std::string, std::string, std::string> make_if_id() {
-    static unsigned id = 1;
-    auto num = std::to_string(id++);
+std::tuple<std::string, std::string, std::string> IR::make_if_id() {
+    auto num = std::to_string(if_count++);
     return {".IF" + num, ".ELSE" + num, ".ENDIF" + num};
 }
 
-static std::string make_obj_id(stmt_decl *d) {
+std::string IR::make_obj_id(stmt_decl *d) {
     // used for recognizing different variables with same name
-    static unsigned id = 1;
-    static std::map<stmt_decl*, unsigned> ids{};
-    auto it = ids.find(d);
-    if(it == ids.end())
-        it = ids.emplace(d, id++).first;
+    auto it = obj_ids.find(d);
+    if(it == obj_ids.end())
+        it = obj_ids.emplace(d, obj_ids.size() + 1).first;
     std::string name{};
     auto tok = d->obj->m_tok;
     if(tok) 
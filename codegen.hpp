@@ -2,9 +2,12 @@
 #define __COMPILER_CODE_GENERATOR__
 
 #include "visitor.hpp"
+#include "mempool.hpp"
 
 #include <map>
+#include <set>
 #include <deque>
+#include <tuple>
 #include <string>
 #include <fstream>
 
@@ -12,13 +15,21 @@ namespace compiler {
 
 class IR: public visitor {
     public:
-        typedef std::map<std::string, unsigned> mem_map;
+        typedef std::map<std::string, unsigned, std::less<std::string>,
+                         pool_allocator<std::pair<const std::string, unsigned>>> mem_map;
         typedef std::deque<std::string>         stack_t;
     private:
         mem_map mem;
         stack_t stack;
         
         std::fstream file;
+        
+        // names are numbered per IR, that is per translation unit
+        unsigned ret_count;
+        unsigned temp_count;
+        unsigned if_count;
+        std::map<stmt_decl*, unsigned, std::less<stmt_decl*>, pool_allocator<std::pair<stmt_decl* const, unsigned>>> obj_ids;
+        std::set<ast_func*, std::less<ast_func*>, pool_allocator<ast_func*>> func_set; // for printing uniqueness
     private:
         void visit_constant(ast_constant*) override;
         void visit_object(ast_object*) override;
@@ -40,9 +51,14 @@ class IR: public visitor {
         void visit_decl(stmt_decl*) override;
     private:
         std::string pop();
+        
+        std::string make_temp();
+        std::tuple<std::string, std::string, std::string> make_if_id();
+        std::string make_obj_id(stmt_decl*);
     public:
         IR(const char *loc)
-            :mem(), stack(), file(loc, std::ios::out|std::ios::trunc) {}
+            :mem(), stack(), file(loc, std::ios::out|std::ios::trunc), ret_count(0), temp_count(1), if_count(1),
+             obj_ids(), func_set() {}
 };
 
 } // namespace compiler
@@ -0,0 +1,60 @@
+#include "context.hpp"
+#include "include_prefetch.hpp"
+#include "memory_stats.hpp"
+
+#include <atomic>
+
+using namespace compiler;
+
+static compilation_context& default_context();
+
+static thread_local compilation_context *installed = nullptr;
+// contexts made so far, the id of the next one
+static std::atomic<uint32_t> contexts{0};
+
+compilation_context& default_context() {
+    static compilation_context instance{};
+    return instance;
+}
+
+compilation_context& compiler::current_context() {
+    return installed ? *installed : default_context();
+}
+
+arena& compiler::compilation_arena() {
+    return current_context().m_memory;
+}
+
+sizepool& compiler::compilation_pool() {
+    return current_context().m_blocks;
+}
+
+compilation_context::compilation_context()
+    :m_blocks(), m_memory(), m_strings(), m_preprocessor(), m_sources(), m_includes(),
+     m_anony_tag(1), m_label_id(1), m_id(contexts.fetch_add(1, std::memory_order_relaxed)),
+     m_thread_pools(), m_thread_pools_lock() {}
+
+compilation_context::~compilation_context() {
+    // the threads lexing ahead write to the sources and the pools below
+    drop_prefetched(*this);
+    if(counting_memory()) {
+        context_scope scope(*this);
+        count_sources();
+    }
+}
+
+arena& compilation_context::thread_pool() {
+    std::lock_guard<std::mutex> lock(m_thread_pools_lock);
+    auto &&pool = m_thread_pools[std::this_thread::get_id()];
+    if(!pool) pool.reset(new arena());
+    return *pool;
+}
+
+context_scope::context_scope(compilation_context &context)
+    :m_saved(installed) {
+    installed = &context;
+}
+
+context_scope::~context_scope() {
+    installed = m_saved;
+}
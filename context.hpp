@@ -0,0 +1,75 @@
+#ifndef __COMPILER_CONTEXT__
+#define __COMPILER_CONTEXT__
+
+#include "cpp.hpp"
+#include "source.hpp"
+#include "mempool.hpp"
+#include "interner.hpp"
+#include "include_path.hpp"
+
+#include "concepts/non_copyable.hpp"
+
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+namespace compiler {
+
+/* Everything the compilation of a translation unit makes and keeps: the
+ * arena of its tokens, nodes, types and scopes, the pool of their lists and
+ * tables, its strings, its macros and guards, its sources and include
+ * lookups, the tokens lexed ahead for it, and the numbering of its anonymous
+ * declarations and labels. Two contexts share nothing, so two units are
+ * compiled at once in two of them, and a context is dropped whole once its
+ * unit is done; files changed in between are read again by the next one.
+ *
+ * A thread works in the context it installed with a context_scope, the
+ * preprocessor takes it when it is constructed. A thread that installed none
+ * works in the default context of the process, where a single compilation
+ * runs. Include directories, the token cache and the threads lexing ahead
+ * are shared by every context, they are locked; a context waits for the
+ * files being lexed ahead for it when it is destroyed.
+ */
+class compilation_context: public non_copyable {
+    public:
+        // declared first, destroyed last; whatever is below points into them,
+        // and lists of the arena's nodes into the pool
+        sizepool     m_blocks;
+        arena        m_memory;
+        string_table m_strings;
+        cpp::state   m_preprocessor;
+        source_table m_sources;
+        include_cache m_includes;
+        uint32_t     m_anony_tag; // the next anonymous declaration
+        unsigned int m_label_id;  // the next label
+        // unique in the process, the address of a context is reused once it is gone
+        const uint32_t m_id;
+    private:
+        // arenas of the threads lexing ahead, see thread_pool()
+        std::unordered_map<std::thread::id, std::unique_ptr<arena>> m_thread_pools;
+        std::mutex m_thread_pools_lock;
+    public:
+        compilation_context();
+        ~compilation_context();
+        
+        // the arena a thread lexing ahead makes its tokens in, one for every
+        // thread, kept as long as the context; see use_token_pool()
+        arena& thread_pool();
+};
+
+// the context of the calling thread
+compilation_context& current_context();
+
+// installs a context on the calling thread while it lives
+class context_scope: public non_copyable {
+    private:
+        compilation_context *m_saved;
+    public:
+        explicit context_scope(compilation_context&);
+        ~context_scope();
+};
+
+} // namespace compiler
+
+#endif // __COMPILER_CONTEXT__
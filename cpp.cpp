@@ -2,82 +2,165 @@
 #include "token.hpp"
 #include "error.hpp"
 #include "lexer.hpp"
+#include "source.hpp"
+#include "context.hpp"
+#include "trace.hpp"
+#include "memory_stats.hpp"
+#include "token_cache.hpp"
+#include "include_path.hpp"
+#include "include_prefetch.hpp"
 
 #include <string>
-#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
 
 using namespace compiler;
 
 typedef std::string string;
-typedef cpp::hash_set hash_set;
-typedef cpp::macro_table macro_table;
+typedef cpp::pp_list pp_list;
 
 
 static void merge_token(token*, token*);
 
+// an identifier, keyword or directive, see cpp::state::name_of
+static bool is_name(const token*);
+// # of a macro argument
+static token* stringize(const pp_token*, const pp_token*, const token*);
+// ## of two tokens
+static token* paste_tokens(const token*, const token*);
+
+// value of a #if expression whose macros are expanded and `defined` replaced
+static intmax_t eval_condition(const std::vector<token*>&, const token*);
+
 // concat [pos, end)
 static string op_to_string(token_list::iterator, token_list::iterator);
 
 // pop front wrapper
 static token* pop_front(token_list&);
 
-static bool file_exists(const char*);
 static string get_path(const string&);
-static string search_file(const hash_set&, const string&);
 
+// every token of a file, false if any of it does not lex without a message
+static bool lex_whole(const char*, std::vector<token*>&);
 
-hash_set cpp::include_dirs {
-    "/usr/include/x86-64/gnu",
-};
 
-cpp::cpp():m_lex(), m_buffer(), m_parsed(), has_newline(false), if_depth(0) {}
+cpp::cpp()
+    :m_state(current_context().m_preprocessor), m_lex(), m_name(), m_tokens(), m_next(0), m_pending(), m_parsed(), m_include(), m_depth(0), m_origin(nullptr),
+     has_newline(true), m_conds(), m_guard(GUARD_START), m_guard_macro(0), m_once(false) {}
 
-cpp::cpp(const char *location):m_lex(location), m_buffer(), m_parsed(), has_newline(false), if_depth(0) {}
+// the beginning of file is the beginning of a line
+cpp::cpp(const char *location)
+    :m_state(current_context().m_preprocessor), m_lex(location), m_name(location), m_tokens(), m_next(0), m_pending(), m_parsed(), m_include(), m_depth(0),
+     m_origin(nullptr), has_newline(true), m_conds(), m_guard(GUARD_START), m_guard_macro(0), m_once(false) {
+    if(include_prefetch_enabled() && !streamed(location)) {
+        // lexed ahead, what it includes has been queued then
+        if(take_prefetched(m_name, m_tokens)) return;
+        prefetch_includes(m_name);
+    }
+    if(!token_cache_enabled() || streamed(location) || load_tokens(location, m_tokens))
+        return;
+    // a miss, the file is lexed as a whole to be saved. Text that does not
+    // lex may lie in a group that is skipped, such a file is neither saved
+    // nor taken from m_tokens but lexed as it is preprocessed
+    if(lex_whole(location, m_tokens))
+        store_tokens(location, m_tokens);
+}
+
+bool cpp::end() const {
+    auto lexed = m_tokens.empty() ? m_lex.end() : m_tokens[m_next]->is(Eof);
+    return lexed && !m_include && m_pending.empty() && m_parsed.empty();
+}
 
-bool cpp::end() const {return m_lex.end() && m_buffer.empty() && m_parsed.empty();}
+bool cpp::empty() const {return m_lex.empty() && m_pending.empty() && m_parsed.empty();}
 
-bool cpp::empty() const {return m_lex.empty() && m_buffer.empty() && m_parsed.empty();}
+const token* cpp::origin() const {return m_origin;}
+
+token* cpp::lex() {
+    if(m_tokens.empty()) return m_lex.get();
+    // stays at Eof
+    auto tok = m_tokens[m_next];
+    if(!tok->is(Eof)) ++m_next;
+    return tok;
+}
+
+token_list cpp::lex_line() {
+    if(m_tokens.empty()) return m_lex.parse_line();
+    token_list result{};
+    for(auto tok = lex(); !tok->is(Newline) && !tok->is(Eof); tok = lex())
+        result.push_back(tok);
+    return result;
+}
 
-token* cpp::get_tok() {
-    if(!m_buffer.empty()) return pop_front(m_buffer);
-    auto tok = m_lex.get();
+pp_token cpp::get_tok() {
+    if(!m_pending.empty()) {
+        auto t = m_pending.back();
+        m_pending.pop_back();
+        return t;
+    }
+    auto tok = lex();
     switch(tok->m_attr) {
         case Newline: has_newline = true; return get_tok();
         case Eof: 
-            if(if_depth) 
-                error("In file %s:\nUnterminated conditional directive", tok->m_pos.m_name);
-            // intended fall-through
-        default: return tok;
+            if(!m_conds.empty())
+                error("In file %s:\nUnterminated conditional directive", source_name(tok->m_file));
+            return {tok, 0};
+        default: return {tok, 0};
     }
 }
 
-void cpp::unget_tok(token *tok) {m_buffer.emplace_front(tok);}
+void cpp::unget_tok(pp_token t) {m_pending.push_back(t);}
 
-#ifdef CC_DEBUG
-#include <iostream>
-#endif
 token* cpp::get() {
-#ifdef CC_DEBUG
-    auto tok = [this]() -> token* {
-#endif
+    auto tok = next();
+    trace(TRACE_GET, tok);
+    return tok;
+}
+
+token* cpp::next() {
+    memory_phase_scope phase(PHASE_PREPROCESS);
     if(!m_parsed.empty()) return pop_front(m_parsed);
     else if(empty()) return nullptr;
     
-    auto tok = get_tok();
+    pp_token t;
+    for(;;) {
+        // tokens of an included file come first
+        if(m_include) {
+            auto tok = m_include->next();
+            if(!tok->is(Eof)) {
+                m_origin = m_include->m_origin;
+                return tok;
+            }
+            end_include();
+        }
+        t = get_tok();
+        // a token of the file, tokens out of an expansion stand for the macro name
+        if(!t.m_hide) m_origin = t.m_tok;
+        // only the first token of a line may begin a directive
+        auto line_begin = has_newline;
+        has_newline = false;
+        if(t.m_tok->is(Pound) && line_begin) {
+            exec_directive();
+            continue;
+        }
+        // anything outside the #ifndef ... #endif pair, the file is not guarded
+        if(m_guard != GUARD_OPEN && !t.m_tok->is(Eof))
+            m_guard = GUARD_NONE;
+        if(!expand(t, nullptr)) break;
+    }
     
+    auto tok = t.m_tok;
     switch(tok->m_attr) {
         case String: return concat_string(tok);
-        case Pound: if(has_newline) {exec_directive(); return get();}
         default: 
-            if(is_directive(tok->m_attr) && tok->m_attr != If && tok->m_attr != Else)
+            if(is_directive(tok->m_attr) && tok->m_attr != If && tok->m_attr != Else) {
+                // keep the spelling, it comes from the attribute
+                tok->m_str = intern_string(tok->to_string());
                 tok->m_attr = Identifier;
+            }
             return tok;
     }
-#ifdef CC_DEBUG
-    }();
-    std::cout<<"get: "<<tok->to_string()<<std::endl;
-    return tok;
-#endif 
 }
 
 token* cpp::get(token_attr attr) {
@@ -90,20 +173,10 @@ token* cpp::get(token_attr attr) {
 }
 
 token* cpp::peek() {
-#ifdef CC_DEBUG
-    auto tok = [this]()->token*{
-#endif
-
-    if(!m_parsed.empty()) return m_parsed.front();
-    
-    auto tok = get();
-    m_parsed.push_front(tok);
+    if(m_parsed.empty()) m_parsed.push_front(next());
+    auto tok = m_parsed.front();
+    trace(TRACE_PEEK, tok);
     return tok;
-#ifdef CC_DEBUG
-    }();
-    std::cout<<"peek: "<<tok->to_string()<<std::endl;
-    return tok;
-#endif
 }
 
 bool cpp::peek(token_attr attr) {
@@ -116,17 +189,13 @@ void cpp::ignore() {
 }
 
 void cpp::unget(token *tok) {
-#ifdef CC_DEBUG
-    std::cout<<"unget: "<<tok->to_string()<<std::endl;
-#endif
+    trace(TRACE_UNGET, tok);
     m_parsed.push_front(tok);
 }
 
 bool cpp::expect(token_attr attr) {
-    auto tok = get();
-#ifdef CC_DEBUG
-    std::cout<<"expect: "<<tok->to_string()<<std::endl;
-#endif
+    auto tok = next();
+    trace(TRACE_EXPECT, tok);
     if(!tok->is(attr)) {
         error(tok, "Expecting \"%s\", but get \"%s\"", attr_to_string(attr), tok->to_string());
         return false;
@@ -135,10 +204,8 @@ bool cpp::expect(token_attr attr) {
 } 
 
 bool cpp::test(token_attr attr) {
-    auto tok = get();
-#ifdef CC_DEBUG
-    std::cout<<"test: "<<tok->to_string()<<std::endl;
-#endif
+    auto tok = next();
+    trace(TRACE_TEST, tok);
     if(!tok->is(attr)) {
         m_parsed.push_front(tok);
         return false;
@@ -146,98 +213,601 @@ bool cpp::test(token_attr attr) {
     return true;
 }
 
+// literals are concatenated after macro expansion
 token* cpp::concat_string(token* tok) {
-    has_newline = false;
+    bool copied = false;
     for(;;) {
-        auto _tok = get_tok();
-        if(_tok && _tok->is(String)) 
-            merge_token(tok, _tok);
-        else 
+        auto t = get_tok();
+        if(expand(t, nullptr)) continue;
+        if(!t.m_tok->is(String)) {
+            unget_tok(t);
             break;
+        }
+        // the literal may be in a macro body, it must not be changed; the
+        // result is spelled in no source, it is printed from its value
+        if(!copied) {
+            tok = make_token(tok->m_attr, 0, 0, tok->m_str);
+            copied = true;
+        }
+        merge_token(tok, t.m_tok);
     }
     return tok;
 }
 
-void cpp::exec_directive() {
-    auto &&list = m_lex.parse_line();
-    // get an empty line, re-get it
-    if(list.empty()) {
-        if(m_lex.valid()) exec_directive();
-        else error("Unexpected end-of-file");
-    }
-    for(auto it = list.begin(); it != list.end(); ++it) {
-        auto &&tok = *it;
-        switch(tok->m_attr) {
-            case Newline: error(tok, "A newline directly after #"); break;
-            case DirectDefine: exec_define(); break;
-            case DirectUndef: exec_undef(); break;
-            case DirectInclude: exec_include(); break;
-            case If: ++if_depth; exec_if(); break;
-            case DirectElif: 
-                if(!if_depth) error(tok, "Unexpected #elif");
-                exec_if(); break;
-            case Else:
-                exec_if(); break;
-            case DirectIfdef: exec_ifdef(true); break;
-            case DirectIfndef: exec_ifdef(false); break;
-            case DirectEndif: // Extra tokens are ignored
-                if(!if_depth) error(tok, "#endif without #if");
-                --if_depth; return;
-            case DirectError: {
-                auto str = op_to_string(++it, list.end());
-                error(tok, "%s", str.c_str()); 
-                return;
+pp_token cpp::next_tok(pp_list *input) {
+    if(!input) return get_tok();
+    if(input->empty()) return {nullptr, 0};
+    auto t = input->back();
+    input->pop_back();
+    return t;
+}
+
+bool cpp::expand(pp_token t, pp_list *input) {
+    auto name = m_state.name_of(t.m_tok);
+    auto m = name ? m_state.m_macros.find(name) : nullptr;
+    if(!m || m_state.m_hides.has(t.m_hide, name)) return false;
+    
+    auto &out = input ? *input : m_pending;
+    auto hide = m_state.m_hides.add(t.m_hide, name);
+    // most macros are constants, nothing to be done but pushing the body
+    if(m->m_simple) {
+        for(auto it = m->m_body.rbegin(); it != m->m_body.rend(); ++it)
+            out.push_back({it->m_tok, hide});
+        return true;
+    }
+    
+    if(m_state.m_expansion_depth == m_state.m_expansions.size())
+        m_state.m_expansions.emplace_back();
+    auto &&frame = m_state.m_expansions[m_state.m_expansion_depth];
+    if(m->m_params >= 0) {
+        // the name of a function-like macro alone is not an invocation
+        auto paren = next_tok(input);
+        if(!paren.m_tok || !paren.m_tok->is(LeftParen)) {
+            if(paren.m_tok) out.push_back(paren);
+            return false;
+        }
+        ++m_state.m_expansion_depth;
+        auto close = read_args(*m, t.m_tok, frame, input);
+        // new lines inside the arguments do not begin the line after ')'
+        if(!input) has_newline = false;
+        hide = m_state.m_hides.add(m_state.m_hides.intersect(t.m_hide, close.m_hide), name);
+    } else
+        ++m_state.m_expansion_depth;
+    substitute(*m, frame, hide, t.m_tok, out);
+    --m_state.m_expansion_depth;
+    return true;
+}
+
+pp_token cpp::read_args(const macro &m, const token *name, expansion &frame, pp_list *input) {
+    auto &&args = frame.m_args;
+    auto &&bounds = frame.m_bounds;
+    args.clear();
+    bounds.assign(1, 0);
+    unsigned int depth = 0;
+    pp_token t;
+    for(;;) {
+        t = next_tok(input);
+        if(!t.m_tok || t.m_tok->is(Eof))
+            error(name, "Unterminated argument list invoking macro \"%s\"", name->to_string());
+        auto attr = t.m_tok->m_attr;
+        if(attr == RightParen && !depth) break;
+        if(attr == LeftParen) ++depth;
+        else if(attr == RightParen) --depth;
+        // commas after the named parameters belong to __VA_ARGS__
+        else if(attr == Comma && !depth &&
+                !(m.m_variadic && bounds.size() == static_cast<std::size_t>(m.m_params))) {
+            bounds.push_back(args.size());
+            continue;
+        }
+        args.push_back(t);
+    }
+    bounds.push_back(args.size());
+    
+    std::size_t params = m.m_params;
+    if(!params && bounds.size() == 2 && args.empty())
+        bounds.pop_back();
+    // __VA_ARGS__ may be left out altogether
+    if(m.m_variadic && bounds.size() == params)
+        bounds.push_back(args.size());
+    if(bounds.size() - 1 != params)
+        error(name, "Macro \"%s\" requires %u arguments, but %u given",
+              name->to_string(), static_cast<unsigned>(params), static_cast<unsigned>(bounds.size() - 1));
+    
+    frame.m_expanded.clear();
+    frame.m_done.assign(params * 2, ~0U);
+    return t;
+}
+
+void cpp::substitute(const macro &m, expansion &frame, uint32_t hide, const token *name, pp_list &out) {
+    auto &&result = frame.m_result;
+    result.clear();
+    bool paste = false; // the previous element is followed by ##
+    bool lhs = false;   // and it is not empty
+    for(auto &&e: m.m_body) {
+        auto start = result.size();
+        if(e.m_param < 0) {
+            result.push_back({e.m_tok, 0});
+        } else if(e.m_flags & macro::STRINGIFY) {
+            auto arg = frame.m_args.data();
+            result.push_back({stringize(arg + frame.m_bounds[e.m_param], arg + frame.m_bounds[e.m_param + 1], name), 0});
+        } else if(paste || (e.m_flags & macro::PASTE)) {
+            // operands of ## are not expanded
+            auto begin = frame.m_args.begin() + frame.m_bounds[e.m_param],
+                 end = frame.m_args.begin() + frame.m_bounds[e.m_param + 1];
+            // GNU extension: `, ## __VA_ARGS__` is not a paste, the comma is
+            // dropped if there are no variable arguments
+            if(paste && lhs && m.m_variadic && e.m_param + 1 == m.m_params &&
+               result.back().m_tok->is(Comma)) {
+                if(begin == end) result.pop_back();
+                paste = false;
             }
-            case DirectLine: exec_line(); break;
-            case DirectPragma: warning(tok, "Unimplemented directive: #pragma"); return;
-            default: error(tok, "Expecting a directive, but get %s", tok->to_string());
+            result.insert(result.end(), begin, end);
+        } else {
+            if(frame.m_done[e.m_param * 2] == ~0U)
+                expand_arg(frame, e.m_param);
+            auto begin = frame.m_expanded.begin();
+            result.insert(result.end(), begin + frame.m_done[e.m_param * 2], begin + frame.m_done[e.m_param * 2 + 1]);
+        }
+        
+        // an empty operand of ## leaves the other one alone
+        if(paste && lhs && result.size() > start) {
+            result[start - 1].m_tok = paste_tokens(result[start - 1].m_tok, result[start].m_tok);
+            result.erase(result.begin() + start);
         }
+        lhs = (paste && lhs) || result.size() > start;
+        paste = e.m_flags & macro::PASTE;
+    }
+    
+    for(auto it = result.rbegin(); it != result.rend(); ++it)
+        out.push_back({it->m_tok, m_state.m_hides.unite(it->m_hide, hide)});
+}
+
+void cpp::expand_arg(expansion &frame, uint32_t param) {
+    auto &&input = frame.m_input;
+    input.assign(frame.m_args.rend() - frame.m_bounds[param + 1], frame.m_args.rend() - frame.m_bounds[param]);
+    frame.m_done[param * 2] = frame.m_expanded.size();
+    while(!input.empty()) {
+        auto t = input.back();
+        input.pop_back();
+        if(!expand(t, &input))
+            frame.m_expanded.push_back(t);
     }
+    frame.m_done[param * 2 + 1] = frame.m_expanded.size();
+}
+
+void cpp::exec_directive() {
+    auto line = lex_line();
     has_newline = true;
+    // null directive
+    if(line.empty()) return;
+    
+    auto tok = pop_front(line);
+    track_guard(tok, line);
+    switch(tok->m_attr) {
+        case DirectDefine: exec_define(line); break;
+        case DirectUndef: exec_undef(line); break;
+        case DirectInclude: exec_include(line); break;
+        case If: exec_if(line, tok); break;
+        case DirectIfdef: exec_ifdef(line, true); break;
+        case DirectIfndef: exec_ifdef(line, false); break;
+        // a group has been taken, the rest of the chain is not
+        case DirectElif:
+            if(m_conds.empty()) error(tok, "#elif without #if");
+            if(m_conds.back().m_else) error(tok, "#elif after #else");
+            skip_group(); break;
+        case Else:
+            if(m_conds.empty()) error(tok, "#else without #if");
+            if(m_conds.back().m_else) error(tok, "#else after #else");
+            m_conds.back().m_else = true;
+            skip_group(); break;
+        case DirectEndif: // Extra tokens are ignored
+            if(m_conds.empty()) error(tok, "#endif without #if");
+            m_conds.pop_back(); break;
+        case DirectError: {
+            auto str = op_to_string(line.begin(), line.end());
+            error(tok, "%s", str.c_str()); 
+            break;
+        }
+        case DirectLine: exec_line(line); break;
+        case DirectPragma: exec_pragma(line); break;
+        default: error(tok, "Expecting a directive, but get %s", tok->to_string());
+    }
 }
 
-void cpp::exec_define() {}
+void cpp::track_guard(const token *directive, const token_list &line) {
+    switch(m_guard) {
+        case GUARD_START:
+            if(directive->is(DirectIfndef) && !line.empty()) {
+                m_guard = GUARD_OPEN;
+                m_guard_macro = m_state.name_of(line.front());
+            } else if(!directive->is(DirectPragma))
+                m_guard = GUARD_NONE;
+            break;
+        case GUARD_OPEN:
+            // directives of the guard itself, m_conds is not updated yet
+            if(m_conds.size() != 1) break;
+            if(directive->is(DirectEndif)) m_guard = GUARD_CLOSED;
+            else if(directive->is(Else) || directive->is(DirectElif)) m_guard = GUARD_NONE;
+            break;
+        case GUARD_CLOSED:
+            m_guard = GUARD_NONE;
+            break;
+        case GUARD_NONE:
+            break;
+    }
+}
 
-void cpp::exec_undef() {}
+void cpp::skip_group() {
+    for(;;) {
+        // the directive ending the group
+        auto tok = m_tokens.empty() ? m_lex.skip_group() : skip_cached_group();
+        // the end of file is reported by get_tok, the conditional is still open
+        if(tok->is(Eof)) return;
+        
+        token_list line{};
+        if(tok->is(DirectElif)) line = lex_line();
+        else skip_rest();
+        track_guard(tok, line);
+        auto &&cond = m_conds.back();
+        if(tok->is(DirectEndif)) {
+            m_conds.pop_back();
+            return;
+        }
+        if(cond.m_else) error(tok, "#%s after #else", tok->to_string());
+        cond.m_else = tok->is(Else);
+        // the first group whose condition holds is taken
+        if(!cond.m_taken && (cond.m_else || eval_if(line, tok))) {
+            cond.m_taken = true;
+            return;
+        }
+    }
+}
 
-void cpp::exec_ifdef(bool required) {}
+// the same as lexer::skip_group, a cached file has no text to scan but its
+// tokens mark where lines begin
+token* cpp::skip_cached_group() {
+    unsigned int depth = 0;
+    for(bool line_begin = true; ; ++m_next) {
+        auto tok = m_tokens[m_next];
+        if(tok->is(Eof)) return tok;
+        if(!line_begin || !tok->is(Pound)) {
+            line_begin = tok->is(Newline);
+            continue;
+        }
+        tok = m_tokens[++m_next];
+        switch(tok->m_attr) {
+            case If: case DirectIfdef: case DirectIfndef:
+                ++depth;
+                break;
+            case DirectEndif:
+                if(!depth) return m_tokens[m_next++];
+                --depth;
+                break;
+            case DirectElif: case Else:
+                if(!depth) return m_tokens[m_next++];
+                break;
+        }
+        // a null directive is a line of its own
+        line_begin = tok->is(Newline);
+    }
+}
 
-void cpp::exec_if() {}
+void cpp::skip_rest() {
+    if(m_tokens.empty()) return m_lex.skip_raw_line();
+    for(auto tok = lex(); !tok->is(Newline) && !tok->is(Eof); tok = lex())
+        ;
+}
 
-void cpp::exec_line() {}
+static bool same_definition(const macro &lhs, const macro &rhs) {
+    if(lhs.m_params != rhs.m_params || lhs.m_variadic != rhs.m_variadic ||
+       lhs.m_param_names != rhs.m_param_names || lhs.m_body.size() != rhs.m_body.size())
+        return false;
+    for(std::size_t i = 0; i < lhs.m_body.size(); ++i) {
+        auto &&l = lhs.m_body[i], &&r = rhs.m_body[i];
+        if(l.m_param != r.m_param || l.m_flags != r.m_flags || l.m_tok->m_attr != r.m_tok->m_attr ||
+           std::strcmp(l.m_tok->to_string(), r.m_tok->to_string()))
+            return false;
+    }
+    return true;
+}
 
-void cpp::exec_include() {
-    static unsigned int include_depth = 0;
-    ++include_depth;
-    auto tok = get_tok();
-    if(include_depth >= 50)
-        error(tok, "File inclusion nested too deeply");
-    std::string path{};
-    if(tok->is(String)) { // #include "file"
-        if(tok->m_str[0] != '/')
-            path = get_path(tok->m_str) + tok->m_str;
-    } else if(tok->is(LessThan)) { // #include <file>
-        for(;;) {
-            auto p = get_tok();
-            if(p->is(GreaterThan)) break;
-            path += p->to_string();
+void cpp::exec_define(token_list &line) {
+    auto va_args = intern_string("__VA_ARGS__");
+    
+    if(line.empty()) error("Macro name missing");
+    auto name = pop_front(line);
+    auto id = m_state.name_of(name);
+    if(!id) error(name, "Macro names must be identifiers");
+    
+    std::unique_ptr<macro> m(new macro{name, -1, false, false, {}, {}});
+    // function-like only if '(' follows the name without white space
+    if(!line.empty() && line.front()->is(LeftParen) && !space_after(name)) {
+        pop_front(line);
+        for(bool first = true; ; first = false) {
+            if(line.empty()) error(name, "Missing ')' in macro parameter list");
+            auto tok = pop_front(line);
+            if(first && tok->is(RightParen)) break;
+            if(tok->is(Ellipsis)) {
+                m->m_variadic = true;
+                m->m_param_names.push_back(va_args);
+                if(line.empty() || !pop_front(line)->is(RightParen))
+                    error(tok, "Missing ')' in macro parameter list");
+                break;
+            }
+            auto param = m_state.name_of(tok);
+            if(!param) error(tok, "Expecting a parameter name, but get \"%s\"", tok->to_string());
+            m->m_param_names.push_back(param);
+            if(line.empty()) error(name, "Missing ')' in macro parameter list");
+            tok = pop_front(line);
+            // GNU extension: named variable arguments `args...`
+            if(tok->is(Ellipsis)) {
+                m->m_variadic = true;
+                if(line.empty() || !pop_front(line)->is(RightParen))
+                    error(tok, "Missing ')' in macro parameter list");
+                break;
+            }
+            if(tok->is(RightParen)) break;
+            if(!tok->is(Comma)) error(tok, "Expecting ',' or ')' in macro parameter list");
         }
-        path = search_file(include_dirs, std::move(path));
+        m->m_params = m->m_param_names.size();
     }
     
-    cpp temp(path.c_str());
-    // TODO: pass current marco table
-    for(tok = temp.get(); tok;) {
-        m_parsed.push_back(tok);
-        tok = temp.get();
+    auto &&names = m->m_param_names;
+    auto param_of = [this, &names](const token *tok) -> int32_t {
+        auto it = std::find(names.begin(), names.end(), m_state.name_of(tok));
+        return it == names.end() || !*it ? -1 : it - names.begin();
+    };
+    for(auto it = line.begin(); it != line.end(); ++it) {
+        auto tok = *it;
+        if(tok->is(StringConcat)) {
+            if(m->m_body.empty())
+                error(tok, "'##' cannot appear at either end of a macro expansion");
+            m->m_body.back().m_flags |= macro::PASTE;
+        } else if(tok->is(Pound) && m->m_params >= 0) {
+            auto param = ++it == line.end() ? -1 : param_of(*it);
+            if(param < 0) error(tok, "'#' is not followed by a macro parameter");
+            m->m_body.push_back({*it, param, macro::STRINGIFY});
+        } else
+            m->m_body.push_back({tok, m->m_params < 0 ? -1 : param_of(tok), 0});
     }
-    --include_depth;
+    if(!m->m_body.empty() && (m->m_body.back().m_flags & macro::PASTE))
+        error(name, "'##' cannot appear at either end of a macro expansion");
+    
+    m->m_simple = m->m_params < 0 && std::none_of(m->m_body.begin(), m->m_body.end(),
+        [](const macro_token &e) {return e.m_flags & macro::PASTE;});
+    
+    auto old = m_state.m_macros.find(id);
+    if(old && !same_definition(*old, *m))
+        warning(name, "\"%s\" redefined", name->to_string());
+    m_state.m_macros.insert(id, std::move(m));
+}
+
+void cpp::exec_undef(token_list &line) {
+    if(line.empty()) error("Macro name missing");
+    auto id = m_state.name_of(line.front());
+    if(!id) error(line.front(), "Macro names must be identifiers");
+    m_state.m_macros.erase(id);
 }
 
+void cpp::exec_ifdef(token_list &line, bool required) {
+    if(line.empty()) error("No macro name given in #%s directive", required ? "ifdef" : "ifndef");
+    auto id = m_state.name_of(line.front());
+    if(!id) error(line.front(), "Macro names must be identifiers");
+    bool taken = (m_state.m_macros.find(id) != nullptr) == required;
+    m_conds.push_back({taken, false});
+    if(!taken) skip_group();
+}
+
+void cpp::exec_if(token_list &line, const token *directive) {
+    bool taken = eval_if(line, directive);
+    m_conds.push_back({taken, false});
+    if(!taken) skip_group();
+}
+
+bool cpp::eval_if(token_list &line, const token *directive) {
+    auto zero = intern_string("0"), one = intern_string("1");
+    
+    pp_list input{};
+    for(auto &&t: line) input.push_back({t, 0});
+    // read from the back
+    std::reverse(input.begin(), input.end());
+    std::vector<token*> expr{};
+    while(!input.empty()) {
+        auto t = input.back();
+        input.pop_back();
+        if(!t.m_tok->is(DirectDefined)) {
+            if(!expand(t, &input)) expr.push_back(t.m_tok);
+            continue;
+        }
+        // defined X or defined(X), X is not expanded
+        auto name = next_tok(&input);
+        bool paren = name.m_tok && name.m_tok->is(LeftParen);
+        if(paren) name = next_tok(&input);
+        if(!name.m_tok || !m_state.name_of(name.m_tok))
+            error(t.m_tok, "Operator \"defined\" requires an identifier");
+        if(paren && (input.empty() || !next_tok(&input).m_tok->is(RightParen)))
+            error(t.m_tok, "Missing ')' after \"defined\"");
+        auto value = m_state.m_macros.find(m_state.name_of(name.m_tok)) ? one : zero;
+        expr.push_back(make_token(PPNumber, t.m_tok->m_file, t.m_tok->m_offset, value));
+    }
+    return eval_condition(expr, directive) != 0;
+}
+
+// accepted, positions stay those of the source
+void cpp::exec_line(token_list&) {}
+
+void cpp::exec_pragma(token_list &line) {
+    if(line.empty()) return;
+    auto tok = line.front();
+    if(tok->is(Identifier) && !std::strcmp(tok->to_string(), "once"))
+        m_once = true;
+    else
+        warning(tok, "Unimplemented directive: #pragma");
+}
+
+void cpp::exec_include(token_list &line) {
+    if(line.empty()) error("#include expects \"FILENAME\" or <FILENAME>");
+    auto tok = pop_front(line);
+    // #include MACRO, the operand is what it expands to
+    if(!tok->is(String) && !tok->is(LessThan)) {
+        pp_list operand{{tok, 0}};
+        for(auto &&t: line) operand.push_back({t, 0});
+        // read from the back
+        std::reverse(operand.begin(), operand.end());
+        line.clear();
+        while(!operand.empty()) {
+            auto t = operand.back();
+            operand.pop_back();
+            if(!expand(t, &operand)) line.push_back(t.m_tok);
+        }
+        if(line.empty()) error(tok, "#include expects \"FILENAME\" or <FILENAME>");
+        tok = pop_front(line);
+    }
+    if(m_depth >= 50)
+        error(tok, "File inclusion nested too deeply");
+    string name{};
+    bool quoted = tok->is(String);
+    if(quoted) // #include "file", relative to current file first
+        name = tok->to_string();
+    else if(tok->is(LessThan)) { // #include <file>
+        while(!line.empty() && !line.front()->is(GreaterThan))
+            name += pop_front(line)->to_string();
+        if(line.empty()) error(tok, "Missing terminating > character");
+    } else
+        error(tok, "#include expects \"FILENAME\" or <FILENAME>");
+    auto path = find_include(get_path(m_name), name, quoted);
+    if(path.empty()) error(tok, "%s: No such file or directory", name.c_str());
+    
+    // a file guarded as a whole is skipped without being read again, by
+    // whichever path it is reached
+    auto guard = m_state.m_include_guards.find(file_identity(path));
+    if(guard != m_state.m_include_guards.end() &&
+       (!guard->second || m_state.m_macros.find(guard->second)))
+        return;
+    
+    // read by get() until its end
+    m_include.reset(new cpp(path.c_str()));
+    m_include->m_depth = m_depth + 1;
+}
+
+void cpp::end_include() {
+    auto &&id = file_identity(m_include->m_name);
+    if(m_include->m_once)
+        m_state.m_include_guards[id] = 0;
+    else if(m_include->m_guard == GUARD_CLOSED)
+        m_state.m_include_guards[id] = m_include->m_guard_macro;
+    m_include.reset();
+}
 
 void merge_token(token *lhs, token *rhs) {
     std::string str{lhs->to_string()};
-    lhs->m_str = insert_string(str += rhs->to_string());
+    lhs->m_str = intern_string(str += rhs->to_string());
+}
+
+bool is_name(const token *tok) {
+    return tok->is(Identifier) || is_keyword(tok->m_attr) || is_directive(tok->m_attr) ||
+           tok->is(If) || tok->is(Else);
+}
+
+uint32_t cpp::state::name_of(const token *tok) {
+    if(tok->is(Identifier)) return tok->m_str;
+    if(!is_name(tok)) return 0;
+    auto attr = tok->m_attr;
+    auto &&slot = m_names[(attr ^ attr >> 16 ^ attr >> 20) & 127];
+    if(slot.m_attr != attr) {
+        slot.m_attr = attr;
+        slot.m_id = intern_string(attr_to_string(attr));
+    }
+    return slot.m_id;
+}
+
+// tokens are separated by a single space where there was any before them;
+// the " and \ of string and character literals are escaped, other tokens
+// are spelled as they are, the value is then that of the literal spelled
+token* stringize(const pp_token *begin, const pp_token *end, const token *name) {
+    string text = "\"";
+    for(auto p = begin; p != end; ++p) {
+        auto tok = p->m_tok;
+        if(p != begin && space_before(tok)) text += ' ';
+        auto spelling = spelling_of(tok);
+        if(!tok->is(String) && !tok->is(WideString) && !tok->is(Character) && !tok->is(WideCharacter)) {
+            text += spelling;
+            continue;
+        }
+        for(auto ch: spelling) {
+            if(ch == '"' || ch == '\\') text += '\\';
+            text += ch;
+        }
+    }
+    text += '"';
+    // the text is only scanned, it is no source
+    lexer lex(text);
+    return make_token(String, name->m_file, name->m_offset, lex.get()->m_str);
+}
+
+token* paste_tokens(const token *lhs, const token *rhs) {
+    auto text = spelling_of(lhs) + spelling_of(rhs);
+    // a comment is no token, it would lex to a newline or to nothing
+    auto comment = !text.compare(0, 2, "//") || !text.compare(0, 2, "/*");
+    // the text is only scanned, it is no source
+    lexer lex(text);
+    auto tok = comment ? nullptr : lex.get();
+    if(!tok || tok->is(Eof) || tok->is(Newline) || !lex.get()->is(Eof))
+        error(lhs, "Pasting \"%s\" and \"%s\" does not give a valid preprocessing token",
+              spelling_of(lhs).c_str(), spelling_of(rhs).c_str());
+    // the result ends where the right operand does
+    return make_token(tok->m_attr, rhs->m_file, rhs->m_offset, tok->m_str);
+}
+
+uint32_t hide_table::cons(uint32_t name, uint32_t next) {
+    auto key = static_cast<uint64_t>(name) << 32 | next;
+    auto it = m_ids.find(key);
+    if(it != m_ids.end()) return it->second;
+    uint32_t id = m_nodes.size();
+    m_nodes.push_back({name, next});
+    m_ids.emplace(key, id);
+    return id;
+}
+
+bool hide_table::has(uint32_t set, uint32_t name) const {
+    for(; set && m_nodes[set].m_name <= name; set = m_nodes[set].m_next)
+        if(m_nodes[set].m_name == name) return true;
+    return false;
+}
+
+uint32_t hide_table::add(uint32_t set, uint32_t name) {
+    if(!set || name < m_nodes[set].m_name) return cons(name, set);
+    auto n = m_nodes[set];
+    if(n.m_name == name) return set;
+    return cons(n.m_name, add(n.m_next, name));
+}
+
+uint32_t hide_table::merge(uint32_t lhs, uint32_t rhs) {
+    if(!lhs) return rhs;
+    if(!rhs || lhs == rhs) return lhs;
+    auto l = m_nodes[lhs], r = m_nodes[rhs];
+    if(l.m_name < r.m_name) return cons(l.m_name, merge(l.m_next, rhs));
+    if(r.m_name < l.m_name) return cons(r.m_name, merge(lhs, r.m_next));
+    return cons(l.m_name, merge(l.m_next, r.m_next));
+}
+
+uint32_t hide_table::unite(uint32_t lhs, uint32_t rhs) {
+    if(!lhs) return rhs;
+    if(!rhs || lhs == rhs) return lhs;
+    auto &&entry = m_unions[(lhs * 31 + rhs) & 63];
+    if(entry.m_lhs != lhs || entry.m_rhs != rhs)
+        entry = {lhs, rhs, merge(lhs, rhs)};
+    return entry.m_set;
+}
+
+uint32_t hide_table::intersect(uint32_t lhs, uint32_t rhs) {
+    while(lhs && rhs) {
+        auto l = m_nodes[lhs], r = m_nodes[rhs];
+        if(l.m_name < r.m_name) lhs = l.m_next;
+        else if(r.m_name < l.m_name) rhs = r.m_next;
+        else return cons(l.m_name, intersect(l.m_next, r.m_next));
+    }
+    return 0;
 }
 
 token* pop_front(token_list &l) {
@@ -253,20 +823,295 @@ string op_to_string(token_list::iterator pos, token_list::iterator end) {
     return result;
 }
 
-bool file_exists(const char *location) {
-    std::ifstream test(location);
-    return test.good();
+// directory of a file with the trailing '/', empty for the current directory
+string get_path(const string &src) {
+    auto pos = src.rfind('/');
+    return pos == string::npos ? string() : src.substr(0, pos + 1);
 }
 
-string get_path(const string &src) {
-    return src.substr(0,src.rfind('/'));
+// messages are held back, the text is lexed again as it is preprocessed
+// and they come out in order then
+bool lex_whole(const char *location, std::vector<token*> &tokens) {
+    auto was_quiet = is_quiet();
+    auto held_back = quiet_messages();
+    set_quiet(true);
+    try {
+        lexer lex(location);
+        for(auto tok = lex.get(); ; tok = lex.get()) {
+            tokens.push_back(tok);
+            if(tok->is(Eof)) break;
+        }
+    } catch(int) {
+        tokens.clear();
+    }
+    set_quiet(was_quiet);
+    if(quiet_messages() == held_back) return true;
+    tokens.clear();
+    return false;
 }
 
-string search_file(const hash_set &set, const string &src) {
-    string result{};
-    for(auto &&dir: set) {
-        result = dir + src;
-        if(file_exists(result.c_str())) return result;
+/* Expressions of #if and #elif, C11 6.10.1. Integers are computed in
+ * intmax_t, or in uintmax_t when an operand is unsigned, and overflow wraps
+ * around. Operands skipped by && || ?: are parsed but not evaluated, their
+ * division by zero is no error.
+ */
+namespace {
+
+struct pp_value {
+    intmax_t m_value;
+    bool     m_unsigned;
+};
+
+class condition {
+    private:
+        const std::vector<token*> &m_expr;
+        std::size_t  m_pos;
+        const token *m_directive;
+        unsigned int m_skip; // depth of operands not evaluated
+    private:
+        const token* peek() const {return m_pos < m_expr.size() ? m_expr[m_pos] : nullptr;}
+        const token* next();
+        
+        pp_value comma();
+        pp_value conditional();
+        pp_value binary(int);
+        pp_value unary();
+        pp_value primary();
+        pp_value apply(const token*, pp_value, pp_value);
+    public:
+        condition(const std::vector<token*> &expr, const token *directive)
+            :m_expr(expr), m_pos(0), m_directive(directive), m_skip(0) {}
+        
+        intmax_t eval();
+};
+
+} // anonymous namespace
+
+static pp_value number_value(const token*);
+static pp_value char_value(const token*);
+// binding strength of a binary operator, 0 for other tokens
+static int precedence(uint32_t);
+
+intmax_t eval_condition(const std::vector<token*> &expr, const token *directive) {
+    return condition(expr, directive).eval();
+}
+
+intmax_t condition::eval() {
+    if(m_expr.empty()) error(m_directive, "#%s with no expression", m_directive->to_string());
+    auto result = comma();
+    if(auto tok = peek())
+        error(tok, "Missing binary operator before token \"%s\"", tok->to_string());
+    return result.m_value;
+}
+
+const token* condition::next() {
+    auto tok = peek();
+    if(!tok) error(m_directive, "Unexpected end of expression in #%s", m_directive->to_string());
+    ++m_pos;
+    return tok;
+}
+
+pp_value condition::comma() {
+    auto result = conditional();
+    while(peek() && peek()->is(Comma)) {
+        ++m_pos;
+        result = conditional();
+    }
+    return result;
+}
+
+pp_value condition::conditional() {
+    auto cond = binary(1);
+    if(!peek() || !peek()->is(Question)) return cond;
+    ++m_pos;
+    m_skip += !cond.m_value;
+    auto lhs = comma();
+    m_skip -= !cond.m_value;
+    if(!next()->is(Colon)) error(m_expr[m_pos - 1], "Expecting ':' in #%s", m_directive->to_string());
+    m_skip += !!cond.m_value;
+    auto rhs = conditional();
+    m_skip -= !!cond.m_value;
+    auto result = cond.m_value ? lhs : rhs;
+    result.m_unsigned = lhs.m_unsigned || rhs.m_unsigned;
+    return result;
+}
+
+// precedence climbing, operators binding at least `min`
+pp_value condition::binary(int min) {
+    auto lhs = unary();
+    for(;;) {
+        auto op = peek();
+        int prec = op ? precedence(op->m_attr) : 0;
+        if(prec < min) return lhs;
+        ++m_pos;
+        // the right operand of && and || is not evaluated if the left one decides
+        bool skip = (op->is(LogicalAnd) && !lhs.m_value) || (op->is(LogicalOr) && lhs.m_value);
+        m_skip += skip;
+        auto rhs = binary(prec + 1);
+        m_skip -= skip;
+        lhs = apply(op, lhs, rhs);
+    }
+}
+
+pp_value condition::unary() {
+    auto tok = next();
+    pp_value v{};
+    switch(tok->m_attr) {
+        case Add: return unary();
+        case Sub:
+            v = unary();
+            v.m_value = static_cast<intmax_t>(0 - static_cast<uintmax_t>(v.m_value));
+            return v;
+        case BitNot:
+            v = unary();
+            v.m_value = ~v.m_value;
+            return v;
+        case LogicalNot:
+            v = unary();
+            return {!v.m_value, false};
+        default:
+            --m_pos;
+            return primary();
+    }
+}
+
+pp_value condition::primary() {
+    auto tok = next();
+    switch(tok->m_attr) {
+        case PPNumber: return number_value(tok);
+        case Character: case WideCharacter: return char_value(tok);
+        case LeftParen: {
+            auto v = comma();
+            if(!next()->is(RightParen)) error(m_expr[m_pos - 1], "Missing ')' in expression");
+            return v;
+        }
+        case PPFloat: error(tok, "Floating constant in preprocessor expression");
+        case String: case WideString: error(tok, "Token \"%s\" is not valid in preprocessor expressions", tok->to_string());
+        default:
+            // identifiers left after expansion, keywords included
+            if(is_name(tok)) return {0, false};
+            error(tok, "Token \"%s\" is not valid in preprocessor expressions", tok->to_string());
+    }
+    return {0, false};
+}
+
+pp_value condition::apply(const token *op, pp_value lhs, pp_value rhs) {
+    // usual arithmetic conversions, except for shifts
+    bool is_unsigned = lhs.m_unsigned || rhs.m_unsigned;
+    auto l = static_cast<uintmax_t>(lhs.m_value), r = static_cast<uintmax_t>(rhs.m_value);
+    auto less = is_unsigned ? l < r : lhs.m_value < rhs.m_value;
+    auto greater = is_unsigned ? l > r : lhs.m_value > rhs.m_value;
+    switch(op->m_attr) {
+        case Star: return {static_cast<intmax_t>(l * r), is_unsigned};
+        case Div: case Mod:
+            if(!r) {
+                if(!m_skip) error(op, "Division by zero in #%s", m_directive->to_string());
+                return {0, is_unsigned};
+            }
+            if(is_unsigned) return {static_cast<intmax_t>(op->is(Div) ? l / r : l % r), true};
+            // INTMAX_MIN / -1 overflows
+            if(rhs.m_value == -1) return {op->is(Div) ? static_cast<intmax_t>(0 - l) : 0, false};
+            return {op->is(Div) ? lhs.m_value / rhs.m_value : lhs.m_value % rhs.m_value, false};
+        case Add: return {static_cast<intmax_t>(l + r), is_unsigned};
+        case Sub: return {static_cast<intmax_t>(l - r), is_unsigned};
+        case LeftShift: case RightShift: {
+            // a negative count shifts the other way
+            bool left = op->is(LeftShift) != (!rhs.m_unsigned && rhs.m_value < 0);
+            auto count = !rhs.m_unsigned && rhs.m_value < 0 ? 0 - r : r;
+            if(left) return {static_cast<intmax_t>(count >= 64 ? 0 : l << count), lhs.m_unsigned};
+            if(lhs.m_unsigned) return {static_cast<intmax_t>(count >= 64 ? 0 : l >> count), true};
+            return {lhs.m_value >> (count >= 64 ? 63 : count), false};
+        }
+        case LessThan: return {less, false};
+        case GreaterThan: return {greater, false};
+        case LessEqual: return {!greater, false};
+        case GreaterEqual: return {!less, false};
+        case Equal: return {l == r, false};
+        case NotEqual: return {l != r, false};
+        case Ampersand: return {static_cast<intmax_t>(l & r), is_unsigned};
+        case BitXor: return {static_cast<intmax_t>(l ^ r), is_unsigned};
+        case BitOr: return {static_cast<intmax_t>(l | r), is_unsigned};
+        case LogicalAnd: return {lhs.m_value && rhs.m_value, false};
+        case LogicalOr: return {lhs.m_value || rhs.m_value, false};
+        default: return {0, false};
+    }
+}
+
+int precedence(uint32_t attr) {
+    switch(attr) {
+        case Star: case Div: case Mod: return 10;
+        case Add: case Sub: return 9;
+        case LeftShift: case RightShift: return 8;
+        case LessThan: case GreaterThan: case LessEqual: case GreaterEqual: return 7;
+        case Equal: case NotEqual: return 6;
+        case Ampersand: return 5;
+        case BitXor: return 4;
+        case BitOr: return 3;
+        case LogicalAnd: return 2;
+        case LogicalOr: return 1;
+        default: return 0;
+    }
+}
+
+// integer constants, decimal, octal, hexadecimal or GNU binary, with u and l suffixes
+pp_value number_value(const token *tok) {
+    auto str = tok->to_string();
+    auto p = str;
+    unsigned base = 10;
+    if(p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) base = 16, p += 2;
+    else if(p[0] == '0' && (p[1] == 'b' || p[1] == 'B')) base = 2, p += 2;
+    else if(p[0] == '0') base = 8;
+    
+    uintmax_t value = 0;
+    bool overflow = false, digits = false;
+    for(;; ++p) {
+        unsigned digit;
+        if('0' <= *p && *p <= '9') digit = *p - '0';
+        else if('a' <= *p && *p <= 'f') digit = *p - 'a' + 10;
+        else if('A' <= *p && *p <= 'F') digit = *p - 'A' + 10;
+        else break;
+        // 'e' or 'f' may begin a suffix of a decimal constant
+        if(digit >= base) break;
+        overflow = overflow || value > (UINTMAX_MAX - digit) / base;
+        value = value * base + digit;
+        digits = true;
+    }
+    if(!digits && base != 8)
+        error(tok, "Invalid integer constant \"%s\" in #if", str);
+    
+    bool is_unsigned = false;
+    unsigned longs = 0;
+    for(; *p; ++p) {
+        if((*p == 'u' || *p == 'U') && !is_unsigned) is_unsigned = true;
+        else if((*p == 'l' || *p == 'L') && !longs) longs = p[1] == *p ? (++p, 2) : 1;
+        else error(tok, "Invalid suffix \"%s\" on integer constant", p);
+    }
+    if(overflow)
+        error(tok, "Integer constant \"%s\" is too large", str);
+    if(value > static_cast<uintmax_t>(INTMAX_MAX) && !is_unsigned) {
+        if(base == 10) warning(tok, "Integer constant \"%s\" is so large that it is unsigned", str);
+        is_unsigned = true;
+    }
+    return {static_cast<intmax_t>(value), is_unsigned};
+}
+
+// the lexer keeps a character constant as its UTF-8 text
+pp_value char_value(const token *tok) {
+    auto str = reinterpret_cast<const unsigned char*>(tok->to_string());
+    auto len = tok->m_str ? string_length(tok->m_str) : 0;
+    if(!len) error(tok, "Empty character constant");
+    if(tok->is(WideCharacter)) {
+        // the first character decoded
+        auto n = str[0] < 0x80 ? 1 : str[0] < 0xe0 ? 2 : str[0] < 0xf0 ? 3 : 4;
+        intmax_t value = n == 1 ? str[0] : str[0] & (0x7f >> n);
+        for(int i = 1; i < n && i < static_cast<int>(len); ++i)
+            value = value << 6 | (str[i] & 0x3f);
+        return {value, false};
     }
-    return src; // cannot be found
+    // plain char is signed, as in GCC on x86; multi-character constants are int
+    if(len == 1) return {static_cast<signed char>(str[0]), false};
+    int32_t value = 0;
+    for(std::size_t i = 0; i < len; ++i)
+        value = static_cast<int32_t>(static_cast<uint32_t>(value) << 8 | str[i]);
+    return {value, false};
 }
@@ -3,51 +3,200 @@
 
 #include "lexer.hpp"
 
+#include <deque>
+#include <memory>
 #include <string>
-#include <unordered_set>
+#include <vector>
 #include <unordered_map>
 
 namespace compiler {
 
-struct macro {};
+// A token and the names of the macros that must not expand it again
+struct pp_token {
+    token   *m_tok;
+    uint32_t m_hide; // hide set, 0 for the empty set
+};
+
+// An element of a macro body, parameters are resolved to their indices
+// when the macro is defined.
+struct macro_token {
+    token   *m_tok;
+    int32_t  m_param; // index of the parameter, -1 if it is not one
+    uint32_t m_flags;
+};
+
+struct macro {
+    enum: uint32_t {
+        STRINGIFY = 1, // # parameter
+        PASTE     = 2, // followed by ##
+    };
+    token   *m_name;     // name in #define
+    int32_t  m_params;   // number of parameters, -1 for an object-like macro
+    bool     m_variadic; // the last parameter is __VA_ARGS__
+    bool     m_simple;   // object-like without ##, the body is used as it is
+    std::vector<uint32_t>    m_param_names;
+    std::vector<macro_token> m_body;
+};
+
+// Macros indexed by the interned ids of their names. Most identifiers are
+// not macros, a lookup is then a bounds check and a load.
+class macro_table {
+    private:
+        std::vector<std::unique_ptr<macro>> m_macros;
+    public:
+        macro* find(uint32_t name) const {
+            return name < m_macros.size() ? m_macros[name].get() : nullptr;
+        }
+        
+        void insert(uint32_t name, std::unique_ptr<macro> m) {
+            if(name >= m_macros.size()) m_macros.resize(name + 1);
+            m_macros[name] = std::move(m);
+        }
+        
+        void erase(uint32_t name) {
+            if(name < m_macros.size()) m_macros[name].reset();
+        }
+};
+
+/* Hide sets are sorted lists of macro names. Lists are hash-consed, equal
+ * sets share one id, and a set is passed around as that id. Most tokens
+ * have the empty set 0, and the sets of an expansion are usually found
+ * in the table after the first time, so expansion seldom allocates.
+ */
+class hide_table {
+    struct node {
+        uint32_t m_name;
+        uint32_t m_next; // the rest of the set
+    };
+    struct cached {
+        uint32_t m_lhs, m_rhs, m_set;
+    };
+    private:
+        std::vector<node> m_nodes;
+        std::unordered_map<uint64_t, uint32_t> m_ids;
+        // every token of an argument has the same pair of sets, a small cache
+        // of the last unions saves walking the lists for each of them
+        cached m_unions[64];
+    private:
+        uint32_t cons(uint32_t name, uint32_t next);
+        uint32_t merge(uint32_t, uint32_t);
+    public:
+        hide_table():m_nodes{{0, 0}}, m_ids(), m_unions() {}
+        
+        bool     has(uint32_t set, uint32_t name) const;
+        uint32_t add(uint32_t set, uint32_t name);
+        uint32_t unite(uint32_t, uint32_t);
+        uint32_t intersect(uint32_t, uint32_t);
+};
 
 // C PreProcessor
 class cpp {
     public:
-        typedef std::unordered_map<std::string, macro> macro_table;
-        typedef std::unordered_set<std::string> hash_set;
+        typedef std::vector<pp_token> pp_list;
+        struct state;
     private:
+        // Multiple-include optimization: a file whose tokens all lie inside
+        // #ifndef X ... #endif is not read again while X is defined.
+        enum guard_state {
+            GUARD_START,  // nothing but comments and new lines so far
+            GUARD_OPEN,   // inside the #ifndef of a possible guard
+            GUARD_CLOSED, // after the #endif of the guard
+            GUARD_NONE,   // not guarded
+        };
+        
+        // an open #if, #ifdef or #ifndef
+        struct conditional {
+            bool m_taken; // a group of the chain has been taken
+            bool m_else;  // #else has been seen
+        };
+        
+        // Buffers of a macro invocation. They are reused by the next one at
+        // the same depth of nesting and keep their capacity, so expansion
+        // stops allocating once the deepest nesting has been seen.
+        struct expansion {
+            pp_list m_args;                 // arguments back to back
+            std::vector<uint32_t> m_bounds; // argument i is [m_bounds[i], m_bounds[i + 1])
+            pp_list m_expanded;             // arguments expanded on first use
+            std::vector<uint32_t> m_done;   // [m_done[2i], m_done[2i + 1]) in m_expanded, or ~0U
+            pp_list m_input;                // rest of the argument being expanded
+            pp_list m_result;
+        };
+    private:
+        state &m_state; // of the translation unit, see compilation_context
         lexer m_lex;
-        token_list m_buffer;
+        std::string m_name; // location of the file
+        // whole file when the token cache is enabled, read instead of m_lex
+        std::vector<token*> m_tokens;
+        std::size_t m_next;
+        pp_list m_pending; // pushed back or expanded tokens, the next one is at the back
         token_list m_parsed;
+        std::unique_ptr<cpp> m_include; // the file being included, read before the rest
+        unsigned int m_depth;           // of #include nesting, 0 for the main file
+        const token *m_origin;          // see origin()
         
         bool has_newline;
-        // depth of nested if directive
-        unsigned int if_depth;
-    private:
-        static hash_set include_dirs;
+        // nested conditionals, the innermost last
+        std::vector<conditional> m_conds;
+        
+        guard_state m_guard;
+        uint32_t    m_guard_macro; // interned name of the guard
+        bool        m_once;        // #pragma once seen
     private:
+        // raw tokens, from the lexer or the cached file
+        token* lex();
+        token_list lex_line();
+        
         // get a token, a helper function
-        token* get_tok();
+        pp_token get_tok();
         // push into buffer
-        void unget_tok(token*);
+        void unget_tok(pp_token);
         
+        // the rest of the directive line is passed to each handler
         void exec_directive();
-        void exec_include();
-        void exec_if();
+        void exec_include(token_list&);
+        // records the guard of the included file once it is read through
+        void end_include();
+        void exec_if(token_list&, const token*);
         // true - #ifdef; false - #ifndef
-        void exec_ifdef(bool);
-        void exec_define();
-        void exec_undef();
-        void exec_line();
+        void exec_ifdef(token_list&, bool);
+        // value of the condition of #if or #elif, macros in the line are expanded
+        bool eval_if(token_list&, const token*);
+        void exec_define(token_list&);
+        void exec_undef(token_list&);
+        void exec_line(token_list&);
         //void exec_error();
-        void exec_pragma();
+        void exec_pragma(token_list&);
+        
+        // called for every directive before it is executed
+        void track_guard(const token*, const token_list&);
+        
+        // Skips a group whose condition is false, up to the #elif, #else or
+        // #endif that ends it. Skipped text is scanned for directives only,
+        // it is neither lexed nor expanded.
+        void skip_group();
+        // returns the directive ending the group, or Eof
+        token* skip_cached_group();
+        // consumes the rest of the current line
+        void skip_rest();
         
-        void add_macro();
-        void expand_macro();
+        // next token of a list being expanded, {nullptr} at its end;
+        // of the file without a list
+        pp_token next_tok(pp_list*);
+        // Expands a macro name unless it is in its hide set, the result is
+        // pushed onto the list or m_pending to be read again.
+        // false if it is not expanded
+        bool expand(pp_token, pp_list*);
+        // arguments after '(', returns the closing ')'
+        pp_token read_args(const macro&, const token*, expansion&, pp_list*);
+        void substitute(const macro&, expansion&, uint32_t, const token*, pp_list&);
+        // An argument is fully expanded on its own before substitution, only
+        // if it is used without # or ##, and only once per invocation.
+        void expand_arg(expansion&, uint32_t);
         
         // should be done during lexical analysis
         token* concat_string(token*);
+        // get() without tracing, read by the including file as well
+        token* next();
     public:
         cpp();
         cpp(const char*);
@@ -66,10 +215,37 @@ class cpp {
         bool end() const;
         bool empty() const;
         
+        // The token of the source the last token from get() stands for: the
+        // token itself, or the macro name an expansion came from.
+        const token* origin() const;
+        
         cpp(const cpp&) = delete;
         cpp& operator=(const cpp&) = delete;
 };
 
+// What the files of a translation unit share while it is preprocessed
+struct cpp::state {
+    macro_table m_macros;
+    // guard macros of the files read so far by file_identity, 0 for #pragma
+    // once
+    std::unordered_map<std::string, uint32_t> m_include_guards;
+    // indexed by depth, a deque keeps the entries in place
+    std::deque<expansion> m_expansions;
+    unsigned int m_expansion_depth;
+    hide_table m_hides;
+    // keywords and directives are not interned by the lexer, their ids are
+    // cached in a direct-mapped table where no two of them collide
+    struct {
+        uint32_t m_attr;
+        uint32_t m_id;
+    } m_names[128];
+    
+    state():m_macros(), m_include_guards(), m_expansions(), m_expansion_depth(0), m_hides(), m_names() {}
+    
+    // interned name of an identifier, keyword or directive, 0 for other tokens
+    uint32_t name_of(const token*);
+};
+
 } // namespace compiler
 
 #endif // __COMPILER_PREPROCESSOR__
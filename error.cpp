@@ -6,8 +6,20 @@
 
 using namespace compiler;
 
+static thread_local bool quiet = false;
+static thread_local unsigned int held_back = 0;
+
+// true if the message is to be printed
+static bool speak() {
+    if(!quiet) return true;
+    ++held_back;
+    return false;
+}
+
 static void vmessage(const file_pos &loc, const char *format, std::va_list args) {
-    if(loc.m_name)
+    if(loc.m_name && !loc.m_line)
+        std::fprintf(stderr, "In file %s:\n", loc.m_name);
+    else if(loc.m_name)
         std::fprintf(stderr, "In file %s:%u:%u:\n", loc.m_name, loc.m_line, loc.m_column);
     else
         std::fprintf(stderr, "In temporary string %u:%u:\n", loc.m_line, loc.m_column);
@@ -21,6 +33,7 @@ void compiler::print_fpos(const file_pos &p) noexcept {
     static constexpr unsigned int start = 2;
     
     auto str = p.m_begin;
+    if(!str) return;
     for(;*str!='\n' && *str!='\0'; ++str) 
         std::putc(*str, stderr);
     std::putc('\n', stderr);
@@ -30,6 +43,7 @@ void compiler::print_fpos(const file_pos &p) noexcept {
 }
 
 void compiler::error(const char *format, ...) throw(int) {
+    if(!speak()) throw 0;
     std::va_list args;
     va_start(args, format);
     std::vfprintf(stderr, format, args);
@@ -40,15 +54,17 @@ void compiler::error(const char *format, ...) throw(int) {
 }
 
 void compiler::error(const token *tok, const char *format, ...) throw(int) {
+    if(!speak()) throw 0;
     std::va_list args;
     va_start(args, format);
-    vmessage(tok->m_pos, format, args);
+    vmessage(tok->position(), format, args);
     va_end(args);
     
     throw 0;
 }
 
 void compiler::error(const file_pos &loc, const char *format, ...) throw(int) {
+    if(!speak()) throw 0;
     std::va_list args;
     va_start(args, format);
     vmessage(loc, format, args);
@@ -59,6 +75,7 @@ void compiler::error(const file_pos &loc, const char *format, ...) throw(int) {
 }
 
 void compiler::warning(const char *format, ...) noexcept {
+    if(!speak()) return;
     std::va_list args;
     va_start(args, format);
     std::vfprintf(stderr, format, args);
@@ -66,6 +83,7 @@ void compiler::warning(const char *format, ...) noexcept {
 }
 
 void compiler::warning(const file_pos &loc, const char *format, ...) noexcept {
+    if(!speak()) return;
     std::va_list args;
     va_start(args, format);
     vmessage(loc, format, args);
@@ -73,8 +91,21 @@ void compiler::warning(const file_pos &loc, const char *format, ...) noexcept {
 }
 
 void compiler::warning(const token *tok, const char *format, ...) noexcept {
+    if(!speak()) return;
     std::va_list args;
     va_start(args, format);
-    vmessage(tok->m_pos, format, args);
+    vmessage(tok->position(), format, args);
     va_end(args);
 }
+
+void compiler::set_quiet(bool q) {
+    quiet = q;
+}
+
+bool compiler::is_quiet() noexcept {
+    return quiet;
+}
+
+unsigned int compiler::quiet_messages() noexcept {
+    return held_back;
+}
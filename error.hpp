@@ -17,18 +17,24 @@ struct file_pos {
 
 struct token;
 
-extern const file_pos *epos;
-
 void print_fpos(const file_pos&) noexcept;
 
-void error(const char*, ...) throw(int);
-void error(const token*, const char*, ...) throw(int);
-void error(const file_pos&, const char*, ...) throw(int);
+[[noreturn]] void error(const char*, ...) throw(int);
+[[noreturn]] void error(const token*, const char*, ...) throw(int);
+[[noreturn]] void error(const file_pos&, const char*, ...) throw(int);
 
 void warning(const char*, ...) noexcept;
 void warning(const token*, const char*, ...) noexcept;
 void warning(const file_pos&, const char*, ...) noexcept;
 
+// Work done ahead of time on another thread must not print its messages out
+// of order. While the calling thread is quiet its messages are only counted,
+// errors still throw.
+void set_quiet(bool);
+bool is_quiet() noexcept;
+// messages held back by the calling thread so far
+unsigned int quiet_messages() noexcept;
+
 } // namespace compiler
 
 #endif // __COMPILER_ERROR__
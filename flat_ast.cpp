@@ -0,0 +1,185 @@
+#include "flat_ast.hpp"
+
+#include <cstring>
+#include <unordered_map>
+
+using namespace compiler;
+
+namespace {
+
+// adds every node it visits, the ref of the last one is left in m_result
+class flattener: public visitor {
+    private:
+        flat_ast &m_ast;
+        node_ref  m_result;
+        // a function declared again is the same node
+        std::unordered_map<ast_func*, node_ref> m_funcs;
+    private:
+        void visit_constant(ast_constant*) override;
+        void visit_object(ast_object*) override;
+        void visit_enum(ast_enum*) override;
+        void visit_func(ast_func*) override;
+        void visit_unary(ast_unary*) override;
+        void visit_cast(ast_cast*) override;
+        void visit_binary(ast_binary*) override;
+        void visit_ternary(ast_ternary*) override;
+        void visit_call(ast_call*) override;
+        
+        void visit_stmt(stmt*) override;
+        void visit_compound(stmt_compound*) override;
+        void visit_jump(stmt_jump*) override;
+        void visit_label(stmt_label*) override;
+        void visit_return(stmt_return*) override;
+        void visit_if(stmt_if*) override;
+        void visit_expr(stmt_expr*) override;
+        void visit_decl(stmt_decl*) override;
+        
+        template <class List> flat_range children(const List&);
+        node_ref function(ast_func*);
+    public:
+        explicit flattener(flat_ast &ast):m_ast(ast), m_result(flat_none), m_funcs() {}
+        
+        node_ref add(ast_node *node) {
+            m_result = flat_none;
+            if(node) node->accept(this);
+            return m_result;
+        }
+};
+
+} // anonymous namespace
+
+std::size_t flat_ast::size() const {
+    return m_constants.size() + m_objects.size() + m_enums.size() + m_unaries.size() + m_casts.size() +
+           m_binaries.size() + m_ternaries.size() + m_calls.size() + m_compounds.size() + m_jumps.size() +
+           m_labels.size() + m_returns.size() + m_ifs.size() + m_exprs.size() + m_decls.size() + m_funcs.size();
+}
+
+std::size_t flat_ast::bytes() const {
+    return m_constants.size() * sizeof(flat_constant) + m_objects.size() * sizeof(flat_object) +
+           m_enums.size() * sizeof(flat_enum) + m_unaries.size() * sizeof(flat_unary) +
+           m_casts.size() * sizeof(flat_cast) + m_binaries.size() * sizeof(flat_binary) +
+           m_ternaries.size() * sizeof(flat_ternary) + m_calls.size() * sizeof(flat_call) +
+           m_compounds.size() * sizeof(flat_compound) + m_jumps.size() * sizeof(flat_jump) +
+           m_labels.size() * sizeof(flat_label) + m_returns.size() * sizeof(flat_return) +
+           m_ifs.size() * sizeof(flat_if) + m_exprs.size() * sizeof(flat_expr) +
+           m_decls.size() * sizeof(flat_decl) + m_funcs.size() * sizeof(flat_func) +
+           (m_children.size() + m_top.size()) * sizeof(node_ref);
+}
+
+node_ref compiler::flatten(flat_ast &ast, ast_node *node) {
+    return flattener(ast).add(node);
+}
+
+void compiler::flatten(flat_ast &ast, const stmt_list &unit) {
+    flattener f(ast);
+    for(auto s: unit)
+        ast.add_top(f.add(s));
+}
+
+// the children are added first, their refs are then added to the pool together
+template <class List> flat_range flattener::children(const List &list) {
+    std::vector<node_ref> refs{};
+    refs.reserve(list.size());
+    for(auto node: list)
+        refs.push_back(add(node));
+    return m_ast.add_children(refs);
+}
+
+void flattener::visit_constant(ast_constant *a) {
+    flat_constant n;
+    n.m_tok = a->m_tok;
+    n.m_type = a->m_type;
+    std::memcpy(&n.ldval, &a->ldval, sizeof(n.ldval));
+    m_result = m_ast.add(n);
+}
+
+void flattener::visit_object(ast_object *a) {
+    m_result = m_ast.add(flat_object{a});
+}
+
+void flattener::visit_enum(ast_enum *a) {
+    m_result = m_ast.add(flat_enum{a});
+}
+
+node_ref flattener::function(ast_func *a) {
+    auto it = m_funcs.find(a);
+    if(it != m_funcs.end()) return it->second;
+    auto body = add(a->body);
+    return m_funcs[a] = m_ast.add(flat_func{a, body});
+}
+
+// a function designator, the function itself is added by its declaration
+void flattener::visit_func(ast_func *a) {
+    m_result = m_ast.add(flat_object{a});
+}
+
+void flattener::visit_unary(ast_unary *a) {
+    auto operand = add(a->operand);
+    m_result = m_ast.add(flat_unary{a->m_tok, a->m_type, a->op, operand});
+}
+
+void flattener::visit_cast(ast_cast *a) {
+    auto operand = add(a->operand);
+    m_result = m_ast.add(flat_cast{a->m_tok, a->m_type, operand});
+}
+
+void flattener::visit_binary(ast_binary *a) {
+    auto lhs = add(a->lhs);
+    auto rhs = add(a->rhs);
+    m_result = m_ast.add(flat_binary{a->m_tok, a->m_type, a->op, lhs, rhs});
+}
+
+void flattener::visit_ternary(ast_ternary *a) {
+    auto cond = add(a->cond);
+    auto yes = add(a->yes);
+    auto no = add(a->no);
+    m_result = m_ast.add(flat_ternary{a->m_type, cond, yes, no});
+}
+
+void flattener::visit_call(ast_call *a) {
+    auto args = children(a->args);
+    m_result = m_ast.add(flat_call{a->m_tok, a->m_type, a->func, args});
+}
+
+void flattener::visit_stmt(stmt*) {
+    m_result = m_ast.add_empty();
+}
+
+void flattener::visit_compound(stmt_compound *a) {
+    auto stmts = children(a->m_stmt);
+    m_result = m_ast.add(flat_compound{a->m_scope, stmts});
+}
+
+void flattener::visit_jump(stmt_jump *a) {
+    m_result = m_ast.add(flat_jump{a->label->id});
+}
+
+void flattener::visit_label(stmt_label *a) {
+    m_result = m_ast.add(flat_label{a->id});
+}
+
+void flattener::visit_return(stmt_return *a) {
+    auto val = add(a->val);
+    m_result = m_ast.add(flat_return{val});
+}
+
+void flattener::visit_if(stmt_if *a) {
+    auto cond = add(a->cond);
+    auto yes = add(a->yes);
+    auto no = add(a->no);
+    m_result = m_ast.add(flat_if{cond, yes, no});
+}
+
+void flattener::visit_expr(stmt_expr *a) {
+    auto expr = add(a->expr);
+    m_result = m_ast.add(flat_expr{expr});
+}
+
+void flattener::visit_decl(stmt_decl *a) {
+    if(auto func = a->obj->to_func()) {
+        m_result = function(func);
+        return;
+    }
+    auto inits = children(a->inits);
+    m_result = m_ast.add(flat_decl{a->obj, inits});
+}
@@ -0,0 +1,342 @@
+#ifndef __COMPILER_FLAT_AST__
+#define __COMPILER_FLAT_AST__
+
+#include "ast.hpp"
+
+#include "concepts/non_copyable.hpp"
+
+#include <vector>
+#include <cstdint>
+
+namespace compiler {
+
+/* The AST of a translation unit laid out flat, for passes that walk it
+ * whole many times.
+ *
+ * Nodes of each kind are kept in an array of their own, in the order they
+ * are added, and refer to each other by a node_ref: the kind in the top 5
+ * bits, the index in the array of the kind below. A node has no vtable and
+ * no heap pointer to its children; the children of lists, the statements of
+ * a block, the arguments of a call and the initializers of a declaration,
+ * are ranges of a single pool of refs. Declarations, types, tokens and
+ * scopes are shared with the pointer AST the flat one is made from, see
+ * flatten().
+ *
+ * A flat_ast is only appended to. Walk it with a flat_visitor.
+ */
+
+typedef uint32_t node_ref;
+
+enum flat_kind: uint8_t {
+    FLAT_NONE = 0, // no node, e.g. a missing else
+    // expressions
+    FLAT_CONSTANT,
+    FLAT_OBJECT,
+    FLAT_ENUM,
+    FLAT_UNARY,
+    FLAT_CAST,
+    FLAT_BINARY,
+    FLAT_TERNARY,
+    FLAT_CALL,
+    // statements
+    FLAT_EMPTY, // empty statement, has no array
+    FLAT_COMPOUND,
+    FLAT_JUMP,
+    FLAT_LABEL,
+    FLAT_RETURN,
+    FLAT_IF,
+    FLAT_EXPR,
+    FLAT_DECL,
+    FLAT_FUNC, // definition or declaration of a function
+};
+
+static constexpr node_ref flat_none = 0;
+
+// children in the pool of refs
+struct flat_range {
+    uint32_t m_begin;
+    uint32_t m_size;
+};
+
+struct flat_constant {
+    token    *m_tok;
+    qual_type m_type;
+    union {
+        unsigned long long ival;
+        float fval;
+        double dval;
+        long double ldval;
+        const char *str;
+    };
+};
+
+// an object or a function designator
+struct flat_object {
+    ast_object *m_obj; // the declaration
+};
+
+struct flat_enum {
+    ast_enum *m_enum;
+};
+
+struct flat_unary {
+    token    *m_tok;
+    qual_type m_type;
+    uint32_t  m_op;
+    node_ref  m_operand;
+};
+
+struct flat_cast {
+    token    *m_tok;
+    qual_type m_type; // cast to
+    node_ref  m_operand;
+};
+
+struct flat_binary {
+    token    *m_tok;
+    qual_type m_type;
+    uint32_t  m_op;
+    node_ref  m_lhs;
+    node_ref  m_rhs;
+};
+
+struct flat_ternary {
+    qual_type m_type;
+    node_ref  m_cond;
+    node_ref  m_yes;
+    node_ref  m_no;
+};
+
+struct flat_call {
+    token     *m_tok;
+    qual_type  m_type;
+    ast_func  *m_func;
+    flat_range m_args;
+};
+
+struct flat_compound {
+    scope     *m_scope;
+    flat_range m_stmts;
+};
+
+struct flat_jump {
+    unsigned int m_label; // id of the label
+};
+
+struct flat_label {
+    unsigned int m_id;
+};
+
+struct flat_return {
+    node_ref m_val; // flat_none if there is no value
+};
+
+struct flat_if {
+    node_ref m_cond;
+    node_ref m_yes;
+    node_ref m_no; // flat_none without an else
+};
+
+struct flat_expr {
+    node_ref m_expr; // flat_none for an expression of nothing
+};
+
+struct flat_decl {
+    ast_object *m_obj;
+    flat_range  m_inits;
+};
+
+// a function declared again is the same node
+struct flat_func {
+    ast_func *m_func;
+    node_ref  m_body; // flat_none if it is only declared
+};
+
+class flat_ast: public non_copyable {
+    public:
+        static constexpr unsigned int kind_bits = 5;
+        static constexpr unsigned int index_bits = 32 - kind_bits;
+        static constexpr uint32_t max_index = (uint32_t(1) << index_bits) - 1;
+    private:
+        std::vector<flat_constant> m_constants;
+        std::vector<flat_object>   m_objects;
+        std::vector<flat_enum>     m_enums;
+        std::vector<flat_unary>    m_unaries;
+        std::vector<flat_cast>     m_casts;
+        std::vector<flat_binary>   m_binaries;
+        std::vector<flat_ternary>  m_ternaries;
+        std::vector<flat_call>     m_calls;
+        std::vector<flat_compound> m_compounds;
+        std::vector<flat_jump>     m_jumps;
+        std::vector<flat_label>    m_labels;
+        std::vector<flat_return>   m_returns;
+        std::vector<flat_if>       m_ifs;
+        std::vector<flat_expr>     m_exprs;
+        std::vector<flat_decl>     m_decls;
+        std::vector<flat_func>     m_funcs;
+        
+        std::vector<node_ref> m_children; // pool of the ranges
+        std::vector<node_ref> m_top;      // the external declarations
+    private:
+        template <class T> static node_ref push(std::vector<T> &nodes, flat_kind kind, const T &node) {
+            if(nodes.size() > max_index)
+                error("Too many nodes for a flat AST");
+            nodes.push_back(node);
+            return make_ref(kind, nodes.size() - 1);
+        }
+    public:
+        flat_ast()
+            :m_constants(), m_objects(), m_enums(), m_unaries(), m_casts(), m_binaries(), m_ternaries(), m_calls(),
+             m_compounds(), m_jumps(), m_labels(), m_returns(), m_ifs(), m_exprs(), m_decls(), m_funcs(),
+             m_children(), m_top() {}
+        
+        static node_ref  make_ref(flat_kind kind, uint32_t index) {return uint32_t(kind) << index_bits | index;}
+        static flat_kind kind(node_ref ref) {return static_cast<flat_kind>(ref >> index_bits);}
+        static uint32_t  index(node_ref ref) {return ref & max_index;}
+        
+        node_ref add(const flat_constant &n) {return push(m_constants, FLAT_CONSTANT, n);}
+        node_ref add(const flat_object &n)   {return push(m_objects, FLAT_OBJECT, n);}
+        node_ref add(const flat_enum &n)     {return push(m_enums, FLAT_ENUM, n);}
+        node_ref add(const flat_unary &n)    {return push(m_unaries, FLAT_UNARY, n);}
+        node_ref add(const flat_cast &n)     {return push(m_casts, FLAT_CAST, n);}
+        node_ref add(const flat_binary &n)   {return push(m_binaries, FLAT_BINARY, n);}
+        node_ref add(const flat_ternary &n)  {return push(m_ternaries, FLAT_TERNARY, n);}
+        node_ref add(const flat_call &n)     {return push(m_calls, FLAT_CALL, n);}
+        node_ref add(const flat_compound &n) {return push(m_compounds, FLAT_COMPOUND, n);}
+        node_ref add(const flat_jump &n)     {return push(m_jumps, FLAT_JUMP, n);}
+        node_ref add(const flat_label &n)    {return push(m_labels, FLAT_LABEL, n);}
+        node_ref add(const flat_return &n)   {return push(m_returns, FLAT_RETURN, n);}
+        node_ref add(const flat_if &n)       {return push(m_ifs, FLAT_IF, n);}
+        node_ref add(const flat_expr &n)     {return push(m_exprs, FLAT_EXPR, n);}
+        node_ref add(const flat_decl &n)     {return push(m_decls, FLAT_DECL, n);}
+        node_ref add(const flat_func &n)     {return push(m_funcs, FLAT_FUNC, n);}
+        node_ref add_empty() {return make_ref(FLAT_EMPTY, 0);}
+        
+        // children are added together, once each of them is added
+        flat_range add_children(const std::vector<node_ref> &refs) {
+            flat_range range{static_cast<uint32_t>(m_children.size()), static_cast<uint32_t>(refs.size())};
+            m_children.insert(m_children.end(), refs.begin(), refs.end());
+            return range;
+        }
+        void add_top(node_ref ref) {m_top.push_back(ref);}
+        
+        const flat_constant& constant(node_ref ref) const {return m_constants[index(ref)];}
+        const flat_object&   object(node_ref ref) const {return m_objects[index(ref)];}
+        const flat_enum&     enumerator(node_ref ref) const {return m_enums[index(ref)];}
+        const flat_unary&    unary(node_ref ref) const {return m_unaries[index(ref)];}
+        const flat_cast&     cast(node_ref ref) const {return m_casts[index(ref)];}
+        const flat_binary&   binary(node_ref ref) const {return m_binaries[index(ref)];}
+        const flat_ternary&  ternary(node_ref ref) const {return m_ternaries[index(ref)];}
+        const flat_call&     call(node_ref ref) const {return m_calls[index(ref)];}
+        const flat_compound& compound(node_ref ref) const {return m_compounds[index(ref)];}
+        const flat_jump&     jump(node_ref ref) const {return m_jumps[index(ref)];}
+        const flat_label&    label(node_ref ref) const {return m_labels[index(ref)];}
+        const flat_return&   ret(node_ref ref) const {return m_returns[index(ref)];}
+        const flat_if&       branch(node_ref ref) const {return m_ifs[index(ref)];}
+        const flat_expr&     expr(node_ref ref) const {return m_exprs[index(ref)];}
+        const flat_decl&     decl(node_ref ref) const {return m_decls[index(ref)];}
+        const flat_func&     func(node_ref ref) const {return m_funcs[index(ref)];}
+        
+        const node_ref* begin(flat_range range) const {return m_children.data() + range.m_begin;}
+        const node_ref* end(flat_range range) const {return m_children.data() + range.m_begin + range.m_size;}
+        const std::vector<node_ref>& top() const {return m_top;}
+        
+        // nodes, not counting empty statements
+        std::size_t size() const;
+        // bytes of the arrays in use
+        std::size_t bytes() const;
+};
+
+/**
+ * @brief add a node of the pointer AST and everything below it to a flat one
+ * @return the ref of the node, flat_none for a node of no kind, a tag or a
+ *         typedef name
+ */
+node_ref flatten(flat_ast&, ast_node*);
+// every statement of a translation unit, as the external declarations
+void     flatten(flat_ast&, const stmt_list&);
+
+/* Walks a flat_ast without virtual calls: visit() switches on the kind of a
+ * ref and calls the visit_* member of Derived for it, which by default
+ * visits the children of the node in order. Derived hides the ones it
+ * handles itself, e.g.
+ *
+ *     struct counter: flat_visitor<counter> {
+ *         unsigned int m_calls = 0;
+ *         counter(const flat_ast &ast):flat_visitor(ast) {}
+ *         void visit_call(const flat_call &n) {++m_calls; flat_visitor::visit_call(n);}
+ *     };
+ */
+template <class Derived> class flat_visitor {
+    protected:
+        const flat_ast &m_ast;
+    private:
+        Derived& derived() {return static_cast<Derived&>(*this);}
+        void visit_range(flat_range range) {
+            for(auto p = m_ast.begin(range), end = m_ast.end(range); p != end; ++p)
+                visit(*p);
+        }
+    public:
+        explicit flat_visitor(const flat_ast &ast):m_ast(ast) {}
+        
+        void visit(node_ref ref) {
+            switch(flat_ast::kind(ref)) {
+                case FLAT_NONE:     return;
+                case FLAT_CONSTANT: return derived().visit_constant(m_ast.constant(ref));
+                case FLAT_OBJECT:   return derived().visit_object(m_ast.object(ref));
+                case FLAT_ENUM:     return derived().visit_enum(m_ast.enumerator(ref));
+                case FLAT_UNARY:    return derived().visit_unary(m_ast.unary(ref));
+                case FLAT_CAST:     return derived().visit_cast(m_ast.cast(ref));
+                case FLAT_BINARY:   return derived().visit_binary(m_ast.binary(ref));
+                case FLAT_TERNARY:  return derived().visit_ternary(m_ast.ternary(ref));
+                case FLAT_CALL:     return derived().visit_call(m_ast.call(ref));
+                case FLAT_EMPTY:    return derived().visit_empty();
+                case FLAT_COMPOUND: return derived().visit_compound(m_ast.compound(ref));
+                case FLAT_JUMP:     return derived().visit_jump(m_ast.jump(ref));
+                case FLAT_LABEL:    return derived().visit_label(m_ast.label(ref));
+                case FLAT_RETURN:   return derived().visit_return(m_ast.ret(ref));
+                case FLAT_IF:       return derived().visit_if(m_ast.branch(ref));
+                case FLAT_EXPR:     return derived().visit_expr(m_ast.expr(ref));
+                case FLAT_DECL:     return derived().visit_decl(m_ast.decl(ref));
+                case FLAT_FUNC:     return derived().visit_func(m_ast.func(ref));
+            }
+        }
+        // every external declaration
+        void visit_top() {
+            for(auto ref: m_ast.top())
+                visit(ref);
+        }
+        
+        void visit_constant(const flat_constant&) {}
+        void visit_object(const flat_object&) {}
+        void visit_enum(const flat_enum&) {}
+        void visit_unary(const flat_unary &n) {visit(n.m_operand);}
+        void visit_cast(const flat_cast &n) {visit(n.m_operand);}
+        void visit_binary(const flat_binary &n) {
+            visit(n.m_lhs);
+            visit(n.m_rhs);
+        }
+        void visit_ternary(const flat_ternary &n) {
+            visit(n.m_cond);
+            visit(n.m_yes);
+            visit(n.m_no);
+        }
+        void visit_call(const flat_call &n) {visit_range(n.m_args);}
+        void visit_empty() {}
+        void visit_compound(const flat_compound &n) {visit_range(n.m_stmts);}
+        void visit_jump(const flat_jump&) {}
+        void visit_label(const flat_label&) {}
+        void visit_return(const flat_return &n) {visit(n.m_val);}
+        void visit_if(const flat_if &n) {
+            visit(n.m_cond);
+            visit(n.m_yes);
+            visit(n.m_no);
+        }
+        void visit_expr(const flat_expr &n) {visit(n.m_expr);}
+        void visit_decl(const flat_decl &n) {visit_range(n.m_inits);}
+        void visit_func(const flat_func &n) {visit(n.m_body);}
+};
+
+} // namespace compiler
+
+#endif // __COMPILER_FLAT_AST__
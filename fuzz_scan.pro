@@ -0,0 +1,14 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+QMAKE_CXXFLAGS = -std=c++11 -O2
+
+INCLUDEPATH += $$PWD
+
+SOURCES += bench/fuzz_scan.cpp \
+    scan.cpp
+
+HEADERS += \
+    scan.hpp
@@ -0,0 +1,158 @@
+#include "include_path.hpp"
+#include "context.hpp"
+
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+#include <initializer_list>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+using namespace compiler;
+
+typedef include_cache::listing listing;
+
+// found by compiler.pro when it is configured, see initial_default_dirs()
+#ifndef CC_GCC_INCLUDE_DIR
+#define CC_GCC_INCLUDE_DIR ""
+#endif
+#ifndef CC_MULTIARCH
+#define CC_MULTIARCH "x86_64-linux-gnu"
+#endif
+
+static std::vector<std::string> initial_default_dirs();
+static listing&       list_dir(include_cache&, const std::string&);
+static bool           is_file(include_cache&, const std::string&, const std::string&);
+static void           add_dir(std::vector<std::string>&, const std::string&);
+
+static std::vector<std::string> user_dirs{};
+static std::vector<std::string> system_dirs{};
+static std::vector<std::string> default_dirs = initial_default_dirs();
+// the directories are shared by every context, taken after the lock of a cache
+static std::mutex dirs_lock{};
+
+// $CC_SYSTEM_INCLUDE, directories separated by ':', or those GCC searches
+// last, in its order: its own, then the ones of the system
+std::vector<std::string> initial_default_dirs() {
+    std::vector<std::string> result{};
+    auto add = [&result](const std::string &dir) {
+        if(!dir.empty()) result.push_back(dir.back() == '/' ? dir : dir + '/');
+    };
+    if(auto env = std::getenv("CC_SYSTEM_INCLUDE")) {
+        std::string dirs = env;
+        for(std::size_t begin = 0, end; begin <= dirs.size(); begin = end + 1) {
+            end = std::min(dirs.find(':', begin), dirs.size());
+            add(dirs.substr(begin, end - begin));
+        }
+        return result;
+    }
+    add(CC_GCC_INCLUDE_DIR);
+    add("/usr/local/include");
+    if(*CC_MULTIARCH) add("/usr/include/" CC_MULTIARCH);
+    add("/usr/include");
+    return result;
+}
+
+void compiler::add_include_dir(const std::string &dir) {
+    add_dir(user_dirs, dir);
+}
+
+void compiler::add_system_include_dir(const std::string &dir) {
+    add_dir(system_dirs, dir);
+}
+
+// the including directory only matters to "name"
+static std::string resolution_key(const std::string &from, const std::string &name, bool quoted) {
+    std::string key(1, quoted ? '"' : '<');
+    if(quoted && name[0] != '/') {
+        key += from;
+        key += '\0';
+    }
+    return key += name;
+}
+
+std::string compiler::find_include(const std::string &from, const std::string &name, bool quoted) {
+    auto &&cache = current_context().m_includes;
+    std::lock_guard<std::mutex> lock(cache.m_lock);
+    auto entry = cache.m_resolved.emplace(resolution_key(from, name, quoted), std::string());
+    auto &&path = entry.first->second;
+    // found before, or missed before
+    if(!entry.second || name.empty()) return path;
+    
+    if(name[0] == '/') {
+        if(is_file(cache, std::string(), name)) path = name;
+        return path;
+    }
+    if(quoted && is_file(cache, from, name)) return path = from + name;
+    std::lock_guard<std::mutex> dirs_guard(dirs_lock);
+    for(auto dirs: {&user_dirs, &system_dirs, &default_dirs}) {
+        for(auto &&dir: *dirs)
+            if(is_file(cache, dir, name)) return path = dir + name;
+    }
+    return path;
+}
+
+std::string compiler::file_identity(const std::string &path) {
+    auto &&cache = current_context().m_includes;
+    std::lock_guard<std::mutex> lock(cache.m_lock);
+    auto entry = cache.m_identities.emplace(path, std::string());
+    auto &&id = entry.first->second;
+    if(!entry.second) return id;
+    struct stat st;
+    if(::stat(path.c_str(), &st)) return id = path;
+    // no path begins with a digit and ':' is not in the name
+    return id = std::to_string(st.st_dev) + ':' + std::to_string(st.st_ino);
+}
+
+void add_dir(std::vector<std::string> &dirs, const std::string &dir) {
+    if(dir.empty()) return;
+    auto path = dir.back() == '/' ? dir : dir + '/';
+    {
+        std::lock_guard<std::mutex> lock(dirs_lock);
+        // as in GCC, a directory given twice keeps its first place
+        for(auto list: {&user_dirs, &system_dirs})
+            if(std::find(list->begin(), list->end(), path) != list->end()) return;
+        dirs.push_back(path);
+    }
+    // earlier lookups may have found a file later in the search, those of
+    // other contexts keep their results
+    auto &&cache = current_context().m_includes;
+    std::lock_guard<std::mutex> lock(cache.m_lock);
+    cache.m_resolved.clear();
+}
+
+listing& list_dir(include_cache &cache, const std::string &dir) {
+    auto found = cache.m_listings.find(dir);
+    if(found != cache.m_listings.end()) return found->second;
+    
+    auto &&entries = cache.m_listings[dir];
+    if(auto d = ::opendir(dir.empty() ? "." : dir.c_str())) {
+        while(auto e = ::readdir(d)) {
+            auto kind = e->d_type == DT_REG ? include_cache::ENTRY_FILE :
+                        e->d_type == DT_LNK || e->d_type == DT_UNKNOWN ? include_cache::ENTRY_UNKNOWN :
+                        include_cache::ENTRY_OTHER;
+            entries.emplace(e->d_name, kind);
+        }
+        ::closedir(d);
+    }
+    return entries;
+}
+
+// `name` may have directories of its own, its last one is listed
+bool is_file(include_cache &cache, const std::string &dir, const std::string &name) {
+    auto slash = name.rfind('/');
+    auto parent = slash == std::string::npos ? dir : dir + name.substr(0, slash + 1);
+    auto base = slash == std::string::npos ? name : name.substr(slash + 1);
+    
+    auto &&entries = list_dir(cache, parent);
+    auto it = entries.find(base);
+    if(it == entries.end()) return false;
+    if(it->second == include_cache::ENTRY_UNKNOWN) {
+        struct stat st;
+        // settled once, like the listing
+        auto file = !::stat((parent + base).c_str(), &st) && S_ISREG(st.st_mode);
+        it->second = file ? include_cache::ENTRY_FILE : include_cache::ENTRY_OTHER;
+    }
+    return it->second == include_cache::ENTRY_FILE;
+}
@@ -0,0 +1,73 @@
+#ifndef __COMPILER_INCLUDE_PATH__
+#define __COMPILER_INCLUDE_PATH__
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace compiler {
+
+/* Directories searched by #include, in order:
+ *     the directory of the including file, for "name" only
+ *     -I directories, in the order they are given
+ *     -isystem directories, in the order they are given
+ *     the default system directories: $CC_SYSTEM_INCLUDE, directories
+ *     separated by ':', if it is set; otherwise the include directory of
+ *     the GCC found when compiler.pro is configured, /usr/local/include,
+ *     the multiarch directory of /usr/include and /usr/include
+ *
+ * Lookups go through three caches of the current compilation context
+ * (see context.hpp): resolved includes, misses included, keyed by the
+ * including directory, the spelling and the kind of the name; the entries of
+ * every directory looked into, read once; and whether an entry of unknown
+ * type is a file, found by stat once. Files created during a compilation
+ * are therefore not seen, the next one sees them. The caches are locked,
+ * lookups may come from any thread.
+ */
+struct include_cache {
+    enum entry_kind: unsigned char {
+        ENTRY_FILE,
+        ENTRY_OTHER,   // directories, devices...
+        ENTRY_UNKNOWN, // symbolic links and file systems without d_type, to be stat'ed
+    };
+    // entries of a directory, empty if it cannot be read
+    typedef std::unordered_map<std::string, entry_kind> listing;
+    
+    // by the directory with its trailing '/'
+    std::unordered_map<std::string, listing> m_listings;
+    // see resolution_key, an empty path is a miss
+    std::unordered_map<std::string, std::string> m_resolved;
+    // see file_identity, by path
+    std::unordered_map<std::string, std::string> m_identities;
+    // lookups also come from threads lexing ahead, see include_prefetch.hpp
+    std::mutex m_lock;
+    
+    include_cache():m_listings(), m_resolved(), m_identities(), m_lock() {}
+    
+    include_cache(const include_cache&) = delete;
+    include_cache& operator=(const include_cache&) = delete;
+};
+
+// -I dir, searched for both "name" and <name>
+void add_include_dir(const std::string &dir);
+// -isystem dir, searched after every -I directory
+void add_system_include_dir(const std::string &dir);
+
+/**
+ * @brief resolve the operand of #include
+ * @param from directory of the including file ending with '/', empty for
+ *        the current directory
+ * @param name the name between the quotes or the angle brackets
+ * @param quoted true for "name", false for <name>
+ * @return the path of the file, empty if it cannot be found
+ */
+std::string find_include(const std::string &from, const std::string &name, bool quoted);
+
+// the same for every path of a file, "lib/s.h", "src/../lib/s.h" or a link
+// to it; the path itself if it cannot be stat'ed. Found once a path, cached
+// like the lookups
+std::string file_identity(const std::string &path);
+
+} // namespace compiler
+
+#endif // __COMPILER_INCLUDE_PATH__
@@ -0,0 +1,290 @@
+#include "include_prefetch.hpp"
+#include "error.hpp"
+#include "lexer.hpp"
+#include "source.hpp"
+#include "context.hpp"
+#include "interner.hpp"
+#include "token_cache.hpp"
+#include "include_path.hpp"
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <cstdlib>
+#include <algorithm>
+#include <unordered_map>
+#include <condition_variable>
+
+using namespace compiler;
+
+namespace {
+
+struct job {
+    enum state_t: unsigned char {
+        QUEUED,
+        LEXING,
+        DONE,
+    };
+    state_t m_state;
+    bool    m_taken;  // asked for by the preprocessor, once
+    bool    m_unused; // taken before it was lexed, it is lexed for its includes only
+    bool    m_clean;  // lexed without a message
+    std::vector<token*> m_tokens;
+    // what the string ids of m_tokens refer to until they are taken
+    std::unique_ptr<string_table> m_strings;
+};
+
+// the files of a context by location
+typedef std::unordered_map<std::string, job> job_table;
+
+struct queued {
+    compilation_context   *m_context;
+    job_table::value_type *m_job;
+};
+
+// The threads and the files given to them. It is made on first use, in main,
+// so it is destroyed and its threads are joined before the default context
+// they may write to.
+struct prefetcher {
+    std::mutex m_lock;
+    std::condition_variable m_queued; // a job is queued, or the threads stop
+    std::condition_variable m_done;   // a job is done
+    // by context, erased when it ends
+    std::unordered_map<compilation_context*, job_table> m_jobs;
+    std::deque<queued> m_queue;
+    std::vector<std::thread> m_threads;
+    bool m_stop;
+    
+    prefetcher();
+    ~prefetcher();
+    
+    void start(unsigned int);
+    // running jobs are finished, queued ones stay queued
+    void stop();
+};
+
+} // anonymous namespace
+
+static unsigned int initial_threads();
+static prefetcher&  workers();
+static void         work();
+static void         lex_ahead(const std::string&, job&);
+static void         queue_includes(const std::string&, const std::vector<token*>&);
+static void         submit(const std::string&);
+
+static unsigned int thread_count = initial_threads();
+// the prefetcher while it lives, contexts ending before it is made or after
+// it is destroyed have nothing to wait for
+static std::atomic<prefetcher*> running{nullptr};
+
+unsigned int initial_threads() {
+    auto threads = std::getenv("CC_PREFETCH");
+    return threads ? std::strtoul(threads, nullptr, 10) : 0;
+}
+
+prefetcher& workers() {
+    static prefetcher instance{};
+    return instance;
+}
+
+prefetcher::prefetcher():m_lock(), m_queued(), m_done(), m_jobs(), m_queue(), m_threads(), m_stop(false) {
+    running = this;
+}
+
+prefetcher::~prefetcher() {
+    stop();
+    running = nullptr;
+}
+
+void prefetcher::start(unsigned int threads) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    while(m_threads.size() < threads)
+        m_threads.emplace_back(work);
+}
+
+void prefetcher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+    }
+    m_queued.notify_all();
+    for(auto &&t: m_threads) t.join();
+    m_threads.clear();
+    m_stop = false;
+}
+
+void compiler::set_include_prefetch(unsigned int threads) {
+    workers().stop();
+    thread_count = threads;
+}
+
+bool compiler::include_prefetch_enabled() {
+    return thread_count;
+}
+
+void compiler::prefetch_includes(const std::string &location) {
+    if(!thread_count) return;
+    workers().start(thread_count);
+    submit(location);
+}
+
+bool compiler::take_prefetched(const std::string &location, std::vector<token*> &tokens) {
+    auto &&pool = workers();
+    std::unique_lock<std::mutex> lock(pool.m_lock);
+    auto jobs = pool.m_jobs.find(&current_context());
+    if(jobs == pool.m_jobs.end()) return false;
+    auto it = jobs->second.find(location);
+    if(it == jobs->second.end()) return false;
+    
+    auto &&j = it->second;
+    if(j.m_taken) return false;
+    j.m_taken = true;
+    // sooner lexed by the caller than waited for
+    if(j.m_state == job::QUEUED) {
+        j.m_unused = true;
+        return false;
+    }
+    pool.m_done.wait(lock, [&j]() {return j.m_state == job::DONE;});
+    lock.unlock();
+    if(!j.m_clean) return false;
+    
+    // ids of the thread become ids of the table of the context
+    auto &&strings = *j.m_strings;
+    std::vector<uint32_t> ids(strings.size() + 1, 0);
+    for(uint32_t id = 1; id < ids.size(); ++id) {
+        auto str = strings.get(id);
+        auto len = strings.length(id);
+        ids[id] = intern_string(str, len, hash_bytes(hash_seed, str, len));
+    }
+    for(auto tok: j.m_tokens)
+        tok->m_str = ids[tok->m_str];
+    
+    tokens = std::move(j.m_tokens);
+    j.m_tokens.clear();
+    j.m_strings.reset();
+    return true;
+}
+
+void compiler::drop_prefetched(compilation_context &context) {
+    auto pool = running.load();
+    if(!pool) return;
+    std::unique_lock<std::mutex> lock(pool->m_lock);
+    auto found = pool->m_jobs.find(&context);
+    if(found == pool->m_jobs.end()) return;
+    
+    auto &&jobs = found->second;
+    auto &&queue = pool->m_queue;
+    auto unqueue = [&]() {
+        queue.erase(std::remove_if(queue.begin(), queue.end(), [&context](const queued &q) {
+            return q.m_context == &context;
+        }), queue.end());
+    };
+    unqueue();
+    pool->m_done.wait(lock, [&jobs]() {
+        return std::none_of(jobs.begin(), jobs.end(), [](const job_table::value_type &j) {
+            return j.second.m_state == job::LEXING;
+        });
+    });
+    // the files that were being lexed may have queued their includes
+    unqueue();
+    pool->m_jobs.erase(&context);
+}
+
+// the loop of a thread
+void work() {
+    set_quiet(true);
+    
+    auto &&pool = workers();
+    std::unique_lock<std::mutex> lock(pool.m_lock);
+    for(;;) {
+        pool.m_queued.wait(lock, [&pool]() {return pool.m_stop || !pool.m_queue.empty();});
+        if(pool.m_stop) return;
+        auto next = pool.m_queue.front();
+        pool.m_queue.pop_front();
+        next.m_job->second.m_state = job::LEXING;
+        
+        // the job is left to this thread until it is done, it works in the
+        // context of the job
+        lock.unlock();
+        auto &&j = next.m_job->second;
+        {
+            context_scope scope(*next.m_context);
+            use_token_pool(&next.m_context->thread_pool());
+            lex_ahead(next.m_job->first, j);
+            use_token_pool(nullptr);
+        }
+        lock.lock();
+        j.m_state = job::DONE;
+        if(j.m_unused) {
+            j.m_tokens = std::vector<token*>();
+            j.m_strings.reset();
+        }
+        pool.m_done.notify_all();
+    }
+}
+
+// as the preprocessor reads a file with the token cache enabled
+void lex_ahead(const std::string &location, job &j) {
+    j.m_strings.reset(new string_table());
+    use_string_table(j.m_strings.get());
+    auto held_back = quiet_messages();
+    try {
+        if(!streamed(location.c_str()) && !load_tokens(location.c_str(), j.m_tokens)) {
+            lexer lex(location.c_str());
+            for(auto tok = lex.get(); ; tok = lex.get()) {
+                j.m_tokens.push_back(tok);
+                if(tok->is(Eof)) break;
+            }
+            store_tokens(location.c_str(), j.m_tokens);
+        }
+    } catch(int) {}
+    
+    auto complete = !j.m_tokens.empty() && j.m_tokens.back()->is(Eof);
+    j.m_clean = complete && quiet_messages() == held_back;
+    // names are read while the strings of the thread are in use
+    if(complete) queue_includes(location, j.m_tokens);
+    use_string_table(nullptr);
+}
+
+// #include "name" and #include <name> at the beginning of a line
+void queue_includes(const std::string &location, const std::vector<token*> &tokens) {
+    auto slash = location.rfind('/');
+    auto from = slash == std::string::npos ? std::string() : location.substr(0, slash + 1);
+    
+    auto size = tokens.size();
+    for(std::size_t i = 0; i + 2 < size; ++i) {
+        // tokens[i] begins a line
+        if(tokens[i]->is(Pound) && tokens[i + 1]->is(DirectInclude)) {
+            i += 2;
+            std::string name{};
+            bool quoted = tokens[i]->is(String);
+            if(quoted)
+                name = tokens[i]->to_string();
+            else if(tokens[i]->is(LessThan)) {
+                while(++i < size && !tokens[i]->is(GreaterThan) && !tokens[i]->is(Newline))
+                    name += tokens[i]->to_string();
+                if(i == size || !tokens[i]->is(GreaterThan)) name.clear();
+            }
+            if(!name.empty()) {
+                auto path = find_include(from, name, quoted);
+                if(!path.empty()) submit(path);
+            }
+        }
+        while(i < size && !tokens[i]->is(Newline) && !tokens[i]->is(Eof))
+            ++i;
+    }
+}
+
+void submit(const std::string &location) {
+    auto &&pool = workers();
+    auto &&context = current_context();
+    {
+        std::lock_guard<std::mutex> lock(pool.m_lock);
+        auto added = pool.m_jobs[&context].emplace(location, job{job::QUEUED, false, false, false, {}, nullptr});
+        if(!added.second) return;
+        pool.m_queue.push_back({&context, &*added.first});
+    }
+    pool.m_queued.notify_one();
+}
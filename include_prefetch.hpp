@@ -0,0 +1,57 @@
+#ifndef __COMPILER_INCLUDE_PREFETCH__
+#define __COMPILER_INCLUDE_PREFETCH__
+
+#include "token.hpp"
+
+#include <string>
+#include <vector>
+
+namespace compiler {
+
+class compilation_context;
+
+/* Files named by #include lines are lexed ahead on a pool of threads while
+ * the including file is preprocessed, their tokens are then ready when the
+ * preprocessor reaches the #include. A file lexed ahead has its own #include
+ * lines queued in turn.
+ *
+ * Only lexing is done ahead. Which files are read, their guards and every
+ * expansion are still decided by the preprocessor in order; a file lexed for
+ * nothing, under a false #if or behind its guard, only costs a thread some
+ * time. Operands are taken as they are spelled, #include MACRO is not lexed
+ * ahead. A file whose lexing reported anything is lexed again once it is
+ * reached, so messages come out in order.
+ *
+ * A file is lexed ahead at most once a compilation, including it again lexes
+ * it as usual. Files are lexed ahead in the compilation_context that asked
+ * for them, their sources and tokens belong to it.
+ */
+
+// number of threads, 0 disables prefetching and waits for the threads to
+// finish their files. Defaults to $CC_PREFETCH, disabled if it is not set.
+void set_include_prefetch(unsigned int threads);
+bool include_prefetch_enabled();
+
+/**
+ * @brief queue the files included by a file to be lexed ahead, the file is
+ *        lexed on a thread as well to find them; nothing if it already was
+ * @param location location of the including file
+ */
+void prefetch_includes(const std::string &location);
+
+/**
+ * @brief take the tokens of a file lexed ahead, waits if it is being lexed
+ * @param location location of the file as find_include resolved it
+ * @param tokens receives every token of the file, the last one is Eof
+ * @return false if the file has to be lexed by the caller, it is not waited
+ *         for if no thread has begun lexing it
+ */
+bool take_prefetched(const std::string &location, std::vector<token*> &tokens);
+
+// forget the files lexed ahead for a context that ends, waits for those being
+// lexed; see ~compilation_context
+void drop_prefetched(compilation_context &context);
+
+} // namespace compiler
+
+#endif // __COMPILER_INCLUDE_PREFETCH__
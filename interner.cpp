@@ -0,0 +1,79 @@
+#include "interner.hpp"
+#include "memory_stats.hpp"
+
+#include <new>
+#include <cstdlib>
+#include <cstring>
+
+using namespace compiler;
+
+static constexpr std::size_t chunk_size = 64 * 1024;
+static constexpr std::size_t initial_slots = 1024;
+
+string_table::string_table()
+    :m_entries{{"", 0, hash_seed}}, m_slots(initial_slots, 0), m_chunks(), m_free(nullptr), m_left(0),
+     m_census(nullptr) {}
+
+string_table::~string_table() {
+    delete m_census;
+    for(auto chunk: m_chunks)
+        std::free(chunk);
+}
+
+const char* string_table::store(const char *str, std::size_t len) {
+    auto need = len + 1;
+    if(need > m_left) {
+        // a long string gets a chunk of its own, the current one keeps its space
+        auto size = need > chunk_size / 4 ? need : chunk_size;
+        auto chunk = static_cast<char*>(std::malloc(size));
+        if(!chunk) throw std::bad_alloc();
+        m_chunks.push_back(chunk);
+        if(size != chunk_size) {
+            std::memcpy(chunk, str, len);
+            chunk[len] = '\0';
+            return chunk;
+        }
+        m_free = chunk;
+        m_left = size;
+    }
+    auto res = m_free;
+    std::memcpy(res, str, len);
+    res[len] = '\0';
+    m_free += need;
+    m_left -= need;
+    return res;
+}
+
+void string_table::rehash() {
+    std::vector<uint32_t> slots(m_slots.size() << 1, 0);
+    auto mask = slots.size() - 1;
+    for(uint32_t id = 1; id < m_entries.size(); ++id) {
+        auto i = m_entries[id].hash & mask;
+        while(slots[i]) i = (i + 1) & mask;
+        slots[i] = id;
+    }
+    m_slots.swap(slots);
+}
+
+uint32_t string_table::intern(const char *str, std::size_t len, uint32_t hash) {
+    auto mask = m_slots.size() - 1;
+    auto i = hash & mask;
+    for(; m_slots[i]; i = (i + 1) & mask) {
+        auto &&e = m_entries[m_slots[i]];
+        if(e.hash == hash && e.len == len && !std::memcmp(e.str, str, len))
+            return m_slots[i];
+    }
+    
+    if(counting_memory()) {
+        static const auto kind = memory_kind("string", FROM_STRINGS);
+        if(!m_census) m_census = new memory_census();
+        m_census->add(kind, len + 1);
+    }
+    uint32_t id = m_entries.size();
+    m_entries.push_back({store(str, len), static_cast<uint32_t>(len), hash});
+    m_slots[i] = id;
+    // keep load factor under 1/2
+    if(m_entries.size() * 2 > m_slots.size())
+        rehash();
+    return id;
+}
@@ -0,0 +1,73 @@
+#ifndef __COMPILER_UTIL_INTERNER__
+#define __COMPILER_UTIL_INTERNER__
+
+#include "concepts/non_copyable.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace compiler {
+
+class memory_census;
+
+// FNV-1a, can be computed a character at a time while scanning
+static constexpr uint32_t hash_seed = 2166136261U;
+
+inline uint32_t hash_step(uint32_t hash, char ch) {
+    return (hash ^ static_cast<unsigned char>(ch)) * 16777619U;
+}
+
+inline uint32_t hash_bytes(uint32_t hash, const char *str, std::size_t len) {
+    for(auto end = str + len; str != end; ++str)
+        hash = hash_step(hash, *str);
+    return hash;
+}
+
+/* String table with open addressing and linear probing.
+ *
+ * Strings are copied into large arena chunks and never move or die before
+ * the table, so both the returned id and the `const char*` of it are stable.
+ * Ids start from 1, 0 is reserved for "no string". The hash of each string
+ * is kept to avoid comparing strings that only collide in their slot.
+ */
+class string_table: public non_copyable {
+    struct entry {
+        const char *str;
+        uint32_t    len;
+        uint32_t    hash;
+    };
+    private:
+        std::vector<entry>    m_entries; // indexed by id
+        std::vector<uint32_t> m_slots;   // ids, 0 for an empty slot
+        std::vector<char*>    m_chunks;
+        char       *m_free;     // free space of current chunk
+        std::size_t m_left;
+        memory_census *m_census; // of the strings stored, while counting memory
+    private:
+        const char* store(const char *str, std::size_t len);
+        void rehash();
+    public:
+        string_table();
+        ~string_table();
+        
+        /**
+         * @brief find or insert a string
+         * @param str string, does not need to be null-terminated
+         * @param len length of string
+         * @param hash `hash_bytes(hash_seed, str, len)`
+         * @return id of the string
+         */
+        uint32_t intern(const char *str, std::size_t len, uint32_t hash);
+        uint32_t intern(const char *str, std::size_t len) {
+            return intern(str, len, hash_bytes(hash_seed, str, len));
+        }
+        
+        const char* get(uint32_t id) const {return m_entries[id].str;}
+        std::size_t length(uint32_t id) const {return m_entries[id].len;}
+        std::size_t size() const {return m_entries.size() - 1;}
+};
+
+} // namespace compiler
+
+#endif // __COMPILER_UTIL_INTERNER__
@@ -1,118 +1,211 @@
+#include "scan.hpp"
 #include "lexer.hpp"
+#include "source.hpp"
+#include "interner.hpp"
+#include "memory_stats.hpp"
 
 #include <limits>
-#include <cctype>
-#include <fstream>
-#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
 
 using namespace compiler;
 
 using string = lexer::string;
 using char_t = lexer::char_t;
-using file_map = std::unordered_map<string, string>;
-
-static file_map files{};
-
-static file_map::iterator read_file(const char*);
 
 static void append(string&, char_t, encoding);
-static void append16(string&, char16_t);
-static void append32(string&, char32_t);
+static void appendu8(string&, char_t);
+static void append16(string&, char_t);
+static void append32(string&, char_t);
 
 static int value_of(char_t); // translate hex/oct to its real value
 
-static bool is_oct(char_t);
 static bool is_one_of(char_t, const char*);
 
-lexer::lexer():m_text(nullptr), m_pos(nullptr), m_loc() {}
-
-lexer::lexer(const char *location) {
-    auto it = read_file(location);
-    m_text = &it->second;
-    m_loc.m_name = it->first.c_str();
-    m_pos = m_loc.m_begin = m_text->c_str();
-    m_loc.m_line = m_loc.m_column = 1;
+/* Character classes of the lexer, replacing the locale-dependent <cctype>.
+ * Codepoints beyond ASCII belong to no class, as in the "C" locale.
+ */
+enum char_flag: uint8_t {
+    DIGIT = 0x01, // [0-9]
+    ALPHA = 0x02, // [A-Za-z]
+    IDENT = 0x04, // [A-Za-z_$], what an identifier consists of besides digits
+    HEX   = 0x08, // [0-9A-Fa-f]
+    OCT   = 0x10, // [0-7]
+    SPACE = 0x20, // [ \t\n\v\f\r]
+    PLAIN = 0x40, // ASCII that needs no UTF-8 decoding, line splicing or line counting
+};
+
+static constexpr uint8_t classify(unsigned ch) {
+    return (('0' <= ch && ch <= '9') ? DIGIT | HEX : 0) |
+           (('0' <= ch && ch <= '7') ? OCT : 0) |
+           ((('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z')) ? ALPHA | IDENT : 0) |
+           ((('a' <= ch && ch <= 'f') || ('A' <= ch && ch <= 'F')) ? HEX : 0) |
+           ((ch == '_' || ch == '$') ? IDENT : 0) |
+           ((ch == ' ' || ('\t' <= ch && ch <= '\r')) ? SPACE : 0) |
+           ((0 < ch && ch < 0x80 && ch != '\n' && ch != '\\') ? PLAIN : 0);
+}
+
+static constexpr uint8_t char_class[256] = {
+    #define CLASS4(n)   classify(n), classify(n + 1), classify(n + 2), classify(n + 3)
+    #define CLASS16(n)  CLASS4(n), CLASS4(n + 4), CLASS4(n + 8), CLASS4(n + 12)
+    #define CLASS64(n)  CLASS16(n), CLASS16(n + 16), CLASS16(n + 32), CLASS16(n + 48)
+    CLASS64(0), CLASS64(64), CLASS64(128), CLASS64(192),
+    #undef CLASS64
+    #undef CLASS16
+    #undef CLASS4
+};
+
+static inline bool is_class(char_t ch, uint8_t flag) {
+    return ch < 256 && (char_class[ch] & flag);
+}
+
+static inline bool is_digit(char_t ch) {return is_class(ch, DIGIT);}
+static inline bool is_alnum(char_t ch) {return is_class(ch, DIGIT | ALPHA);}
+// any multibyte UTF-8 character may be part of an identifier, as in GCC
+static inline bool is_ident(char_t ch) {return ch > 0xff || is_class(ch, DIGIT | IDENT);}
+static inline bool is_xdigit(char_t ch) {return is_class(ch, HEX);}
+static inline bool is_oct(char_t ch) {return is_class(ch, OCT);}
+static inline bool is_space(char_t ch) {return is_class(ch, SPACE);}
+
+// length of the UTF-8 sequence starting with `lead`, 1 for ASCII and stray bytes
+static inline int utf8_length(unsigned char lead) {
+    return lead < 0xc0 ? 1 : lead < 0xe0 ? 2 : lead < 0xf0 ? 3 : 4;
+}
+
+lexer::lexer():m_text(nullptr), m_end(nullptr), m_pos(nullptr), m_file(0), m_base(0), m_stream() {}
+
+lexer::lexer(const char *location):lexer() {
+    if(streamed(location)) {
+        m_stream.reset(new source_stream(location));
+        m_file = m_stream->id();
+        m_pos = m_text = m_stream->data();
+        refill();
+        return;
+    }
+    m_file = open_source(location);
+    m_text = source_text(m_file);
+    // the sentinel '\0' is part of the text, as if it were read from file
+    m_end = m_text + source_size(m_file) + 1;
+    m_pos = m_text;
 }
 
+// the terminator of `src` is the sentinel, as for a file
 lexer::lexer(const string &src)
-    :m_text(&src), m_pos(src.c_str()), m_loc() {}
+    :m_text(src.c_str()), m_end(src.c_str() + src.length() + 1), m_pos(src.c_str()), 
+     m_file(0), m_base(0), m_stream() {}
+
+lexer::lexer(int fd, const char *name)
+    :m_text(nullptr), m_end(nullptr), m_pos(nullptr), m_file(0), m_base(0),
+     m_stream(new source_stream(fd, name)) {
+    m_file = m_stream->id();
+    m_pos = m_text = m_stream->data();
+    refill();
+}
+
+lexer::~lexer() {}
+
+uint32_t lexer::offset() const {
+    return m_base + (m_pos - m_text);
+}
+
+bool lexer::refill() {
+    // what ungetc may step back over
+    static constexpr std::ptrdiff_t lookback = 16;
+    
+    if(m_stream->eof()) return false;
+    auto keep = m_pos - std::min(m_pos - m_text, lookback);
+    auto pos = m_pos - keep;
+    auto more = m_stream->refill(keep);
+    m_text = m_stream->data();
+    m_pos = m_text + pos;
+    // a token keeps 32 bits of its offset, see locate()
+    m_base = static_cast<uint32_t>(m_stream->base());
+    m_end = m_stream->eof() ? m_text + m_stream->size() + 1 : nullptr;
+    return more;
+}
+
+void lexer::ensure(std::size_t n) {
+    if(m_stream && static_cast<std::size_t>(m_text + m_stream->size() - m_pos) < n)
+        refill();
+}
 
 token* lexer::make_token(char_t attr) const {
-    return compiler::make_token(attr, m_loc);
+    return compiler::make_token(attr, m_file, offset());
 }
 
-void lexer::set_line(unsigned int line) {m_loc.m_line = line;}
+token* lexer::make_token(char_t attr, string &text) const {
+    return compiler::make_token(attr, m_file, offset(), text);
+}
+
+file_pos lexer::location() const {
+    if(m_file) return locate(m_file, offset());
+    // a string that is no source, counted in place
+    file_pos result{};
+    result.m_begin = m_text;
+    for(auto p = m_text; p != m_pos; ++p) {
+        if(*p != '\n') continue;
+        ++result.m_line;
+        result.m_begin = p + 1;
+    }
+    result.m_column = m_pos - result.m_begin + 1;
+    return result;
+}
 
 char_t lexer::getc() {
-    auto ch = peekc();
-    ++m_pos;
+    // plain ASCII: no decoding, no line splice
+    if(m_pos != m_end && char_class[static_cast<unsigned char>(*m_pos)] & PLAIN)
+        return static_cast<unsigned char>(*m_pos++);
+    // past the sentinel nothing more is read, the end is read again
+    if(empty() || end()) return 0;
     
-    if(ch == '\n' && peekc() != 0) {
-        ++m_loc.m_line;
-        m_loc.m_begin = m_pos;
-        m_loc.m_column = 1;
-    } else
-        ++m_loc.m_column;
+    auto ch = peekc();
+    m_pos += utf8_length(*m_pos);
     return ch;
 }
 
 // TODO: platform-dependent newline
 char_t lexer::peek_helper() {
-    if(empty()) return 0;
+    if(empty() || end()) return 0;
     
-    auto ch = *m_pos;
+    // the sentinel of a stream window is not the end yet, a backslash needs the next byte
+    ensure(2);
+    auto ch = static_cast<unsigned char>(*m_pos);
     
-    if(ch == '\\') {
-        if(!end()) {
-            m_loc.m_begin = (m_pos += 2);
-            ++m_loc.m_line;
-            m_loc.m_column = 1;
-            return peek_helper();
-        }
+    // line splice, the text always ends with '\0' so m_pos[1] is readable
+    if(ch == '\\' && m_pos[1] == '\n') {
+        m_pos += 2;
+        return peek_helper();
     }
     
     return ch;
 }
 
 char_t lexer::peekc() {
-    char_t ch = peek_helper();
+    if(m_pos != m_end && char_class[static_cast<unsigned char>(*m_pos)] & PLAIN)
+        return static_cast<unsigned char>(*m_pos);
     
-    if((ch & 0x80) == 0) // ASCII, 0xxxxxxx
+    char_t ch = peek_helper();
+    if(ch < 0x80) // ASCII, 0xxxxxxx
         return ch;
-    else if((ch & 0xe0) == 0xc0) // 110xxxxx 10xxxxxx
-        return (ch << 8) | peek_helper();
-    else if((ch & 0xe0) == 0xe0) {// 1110xxxx 10xxxxxx 10xxxxxx
-        ch = (ch << 8) | peek_helper();
-        return (ch << 8) | peek_helper();
-    } else if((ch & 0xf8) == 0xf0) { // 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
-        ch = (ch << 8) | peek_helper();
-        ch = (ch << 8) | peek_helper();
-        return (ch << 8) | peek_helper();
-    } else 
-        error("Invalid character %c", ch);
     
-    switch(ch & 0xf8) {
-        case 0xf0:
-        case 0xe0:
-        default:
-            return ch;
+    // bytes of the sequence packed into one value, lead byte highest:
+    // 110xxxxx 10xxxxxx, 1110xxxx 10xxxxxx 10xxxxxx, 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
+    auto len = utf8_length(ch);
+    if(len == 1)
+        error(location(), "Invalid character %c", ch);
+    ensure(len);
+    for(int i = 1; i < len; ++i) {
+        auto next = static_cast<unsigned char>(m_pos[i]);
+        if((next & 0xc0) != 0x80)
+            error(location(), "Invalid UTF-8 sequence");
+        ch = (ch << 8) | next;
     }
-    
-    return 0;
+    return ch;
 }
 
 void lexer::ungetc() {
-    auto ch = *--m_pos;
-    if(ch == '\n') {
-        if(m_pos != m_text->c_str() && m_pos[-1] == '/') {
-            --m_pos;
-            // TODO: line begin, column handler
-            --m_loc.m_line;
-            ungetc();
-        } else
-            --m_loc.m_line;
-    } else 
-        --m_loc.m_column;
+    // back to the lead byte of a UTF-8 sequence
+    do --m_pos; while(m_pos != m_text && (*m_pos & 0xc0) == 0x80);
 }
 
 string lexer::getline() {
@@ -127,9 +220,9 @@ string lexer::getline() {
 
 void lexer::ignore(char_t ch, bool newline) {
     bool has_newline = false;
-    for(int c = getc(); c != '\0'; c = getc()) {
+    for(auto c = getc(); c != '\0'; c = getc()) {
         if(c == '\n') has_newline = true;
-        else if(!std::isspace(c)) has_newline = false;
+        else if(!is_space(c)) has_newline = false;
         if(c == ch && (!newline || has_newline)) break;
     }
 }
@@ -155,7 +248,7 @@ token_list lexer::parse_line() {
 }
 
 bool lexer::end() const {
-    return m_pos == m_text->c_str() + m_text->length();
+    return m_pos == m_end;
 }
 
 bool lexer::empty() const {
@@ -168,6 +261,7 @@ bool lexer::valid() const {
 
 void lexer::skip_line() {
     for(;;) {
+        m_pos = scan_line(m_pos);
         auto ch = getc();
         if(ch == '\n' || ch == '\0')
             break;
@@ -176,9 +270,10 @@ void lexer::skip_line() {
 
 void lexer::skip_block_comment() {
     for(;;) {
+        m_pos = scan_comment(m_pos);
         auto ch = getc();
         if(ch == '\0') {
-            error(m_loc, "Unexpected end-of-file");
+            error(location(), "Unexpected end-of-file");
             break;
         } else if(ch == '*' && peekc() == '/') {
             // do not use getc() in condition because this
@@ -191,6 +286,7 @@ void lexer::skip_block_comment() {
 bool lexer::skip_space() {
     bool result = false;
     for(;;) {
+        if(m_pos != m_end) m_pos = scan_space(m_pos);
         switch(getc()) {
             case ' ': case '\f': case '\r':
             case '\t': case '\v': 
@@ -199,8 +295,8 @@ bool lexer::skip_space() {
                 result = true; continue;
             case '/': 
                 if(expect('*')) {skip_block_comment(); continue;}
-                if(expect('/')) {skip_line(); continue;}
-                // intended fall-through
+                if(expect('/')) {skip_line(); result = true; continue;}
+                // fall through
             default:
                 ungetc(); return result;
         }
@@ -208,6 +304,144 @@ bool lexer::skip_space() {
     return result;
 }
 
+token* lexer::skip_group() {
+    unsigned int depth = 0; // of conditionals opened inside the group
+    while(skip_to_directive()) {
+        auto attr = directive_name();
+        switch(attr) {
+            case If: case DirectIfdef: case DirectIfndef:
+                ++depth;
+                break;
+            case DirectEndif:
+                if(!depth) return make_token(attr);
+                --depth;
+                break;
+            case DirectElif: case Else:
+                if(!depth) return make_token(attr);
+                break;
+        }
+        skip_raw_line();
+    }
+    return make_token(Eof);
+}
+
+bool lexer::skip_to_directive() {
+    for(;;) {
+        // the sentinel was read by a directive line that ended the text
+        if(end()) return false;
+        // white space and comments may come before '#'
+        m_pos = scan_space(m_pos);
+        // ensure() keeps a pair of characters readable in a stream window
+        ensure(2);
+        switch(*m_pos) {
+            case '\0': return false;
+            case '#': ++m_pos; return true;
+            case '%': // digraph %:
+                if(m_pos[1] != ':') break;
+                m_pos += 2;
+                return true;
+            case ' ': case '\t': case '\v': case '\f': case '\r':
+                ++m_pos;
+                continue;
+            case '/':
+                if(m_pos[1] != '*') break;
+                m_pos += 2;
+                skip_raw_comment();
+                continue;
+            case '\\':
+                if(m_pos[1] != '\n') break;
+                m_pos += 2;
+                continue;
+        }
+        skip_raw_line();
+    }
+}
+
+// directive names are at most 6 characters, a longer identifier is none of them
+uint32_t lexer::directive_name() {
+    static constexpr std::ptrdiff_t longest = 6;
+    
+    for(;;) {
+        m_pos = scan_space(m_pos);
+        ensure(longest + 2);
+        if(m_pos[0] == '/' && m_pos[1] == '*') {
+            m_pos += 2;
+            skip_raw_comment();
+        } else if(!is_space(static_cast<unsigned char>(*m_pos)) || *m_pos == '\n')
+            break;
+    }
+    auto begin = m_pos;
+    while(m_pos - begin <= longest && is_ident(static_cast<unsigned char>(*m_pos)))
+        ++m_pos;
+    return m_pos - begin > longest ? Error : string_to_attr(begin, m_pos - begin);
+}
+
+void lexer::skip_raw_line() {
+    for(;;) {
+        m_pos = scan_skipped(m_pos);
+        ensure(2);
+        switch(*m_pos) {
+            case '\0': return;
+            case '\n': ++m_pos; return;
+            case '\'': case '\"':
+                skip_raw_literal(*m_pos++);
+                continue;
+            case '/':
+                if(m_pos[1] == '*') {
+                    m_pos += 2;
+                    skip_raw_comment();
+                    continue;
+                }
+                if(m_pos[1] == '/') {
+                    m_pos += 2;
+                    skip_raw_line_comment();
+                    continue;
+                }
+                break;
+            case '\\':
+                if(m_pos[1] == '\n') ++m_pos;
+                break;
+        }
+        ++m_pos;
+    }
+}
+
+void lexer::skip_raw_comment() {
+    for(;;) {
+        m_pos = scan_comment(m_pos);
+        ensure(2);
+        if(!*m_pos) return;
+        if(m_pos[0] == '*' && m_pos[1] == '/') {
+            m_pos += 2;
+            return;
+        }
+        ++m_pos;
+    }
+}
+
+// up to the newline, a splice continues the comment
+void lexer::skip_raw_line_comment() {
+    for(;;) {
+        m_pos = scan_line(m_pos);
+        ensure(2);
+        if(!*m_pos || *m_pos == '\n') return;
+        m_pos += m_pos[0] == '\\' && m_pos[1] == '\n' ? 2 : 1;
+    }
+}
+
+// an unterminated literal ends with its line, as an apostrophe in text may
+void lexer::skip_raw_literal(char quote) {
+    for(;;) {
+        ensure(2);
+        auto ch = *m_pos;
+        if(!ch || ch == '\n') return;
+        ++m_pos;
+        if(ch == quote) return;
+        // an escaped character or a line splice
+        if(ch == '\\' && *m_pos) ++m_pos;
+    }
+}
+
 // TODO: trigraphs
 /* 5.2.1.1 Trigraph sequences
  *
@@ -221,6 +455,7 @@ bool lexer::skip_space() {
  * above is not changed.
  */
 token* lexer::get() {
+    memory_phase_scope phase(PHASE_LEX);
     // TODO: record the correct position of newline
     if(skip_space()) return make_token(Newline);
     
@@ -228,8 +463,8 @@ token* lexer::get() {
     token* temp = nullptr;
     
     if(ch == '\0') return make_token(Eof);
-    else if(std::isdigit(ch)) return get_number(ch);
-    else if(std::isalpha(ch) || ch == '_' || ch == '$') {
+    else if(is_digit(ch)) return get_number(ch);
+    else if(is_ident(ch)) {
         if(ch == 'L') {
             if(expect('\'')) return get_char(WCHAR);
             if(expect('\"')) return get_string(WCHAR);
@@ -290,14 +525,14 @@ token* lexer::get() {
         case ']': case '{': case '}': case '?':
             return make_token(ch);
         case '.':
-            if(std::isdigit(peekc())) {ungetc(); return get_number(ch);}
+            if(is_digit(peekc())) {ungetc(); return get_number(ch);}
             if(expect('.')) {
                 if(expect('.')) 
                     return make_token(Ellipsis);
                 ungetc();
             }
             return make_token(Dot);
-        default: error(m_loc, "Unrecongnized character %c", ch); return nullptr;
+        default: error(location(), "Unrecongnized character %c", ch); return nullptr;
     }
 }
 
@@ -327,7 +562,7 @@ token* lexer::get_digraph(char_t ch) {
                 }
                 return make_token(Pound);
             }
-            // intended fall-through
+            // fall through
         default: return nullptr;
     }
 }
@@ -335,9 +570,9 @@ token* lexer::get_digraph(char_t ch) {
 // size can only be 4 or 8
 char_t lexer::get_UCN(int size) {
     int result = 0;
-    for(int count = 0; count <= size; ++count) {
-        if(!isxdigit(peekc()))
-            error(m_loc, "Expecting hexademical, but get %c", getc());
+    for(int count = 0; count < size; ++count) {
+        if(!is_xdigit(peekc()))
+            error(location(), "Expecting hexademical, but get %c", getc());
         result = (result << 4) | value_of(getc());
     }
     return result;
@@ -345,10 +580,10 @@ char_t lexer::get_UCN(int size) {
 
 char_t lexer::get_hex_char() {
     int result = 0;
-    if(!isxdigit(peekc())) 
-        error(m_loc, "Expecting hexademical, but get %c", getc());
+    if(!is_xdigit(peekc())) 
+        error(location(), "Expecting hexademical, but get %c", getc());
     for(int size = 0; size <= 32; size += 4) {
-        if(!isxdigit(peekc()))
+        if(!is_xdigit(peekc()))
             break;
         result = (result << 4) | value_of(getc());
     }
@@ -357,7 +592,8 @@ char_t lexer::get_hex_char() {
 
 // the first is impossible to be non-octonary
 char_t lexer::get_oct_char(char_t ch) {
-    for(int count = 1; count <= 3; ++count) {
+    ch = value_of(ch);
+    for(int count = 1; count < 3; ++count) {
         if(!is_oct(peekc())) break;
         ch = (ch << 3) | value_of(getc());
     }
@@ -376,41 +612,57 @@ char_t lexer::get_escaped_char(encoding &enc) {
         case 'r': return '\r';
         case 't': return '\t';
         case 'v': return '\v';
-        case 'x': enc = CHAR32; return get_hex_char();
+        case 'x': return get_hex_char();
         case 'u': enc = CHAR16; return get_UCN(4);
         case 'U': enc = CHAR32; return get_UCN(8);
         case '0': case '1': case '2': case '3':
         case '4': case '5': case '6': case '7':
-            enc = CHAR32; return get_oct_char(ch);
+            return get_oct_char(ch);
+        case '\0':
+            // a backslash at the end of the text, the literal is unterminated
+            ungetc();
+            return '\\';
         default:
-            warning(m_loc, "Unknown escape sequence %c", ch);
+            warning(location(), "Unknown escape sequence %c", ch);
             return ch;
     }
 }
 
 token* lexer::get_char(encoding enc) {
     string result{};
-    auto attr = static_cast<token_attr>(static_cast<unsigned>(Character) | reinterpret_cast<unsigned&>(enc));
+    auto attr = static_cast<token_attr>(static_cast<unsigned>(Character) | static_cast<unsigned>(enc));
     for(;;) {
         auto ch = getc();
         if(ch == '\'') break;
-        if(ch == '\\') ch = get_escaped_char(enc);
-        append(result, ch, enc);
+        // an apostrophe in text, as GCC does, is no error
+        if(ch == '\n' || ch == '\0') {
+            ungetc();
+            warning(location(), "Missing terminating ' character");
+            break;
+        }
+        auto char_enc = enc;
+        if(ch == '\\') ch = get_escaped_char(char_enc);
+        append(result, ch, char_enc);
     }
-    return compiler::make_token(attr, m_loc, result);
+    return make_token(attr, result);
 }
 
 token* lexer::get_string(encoding enc) {
     string result{};
-    auto attr = static_cast<token_attr>(static_cast<unsigned>(String) | reinterpret_cast<unsigned&>(enc));
+    auto attr = static_cast<token_attr>(static_cast<unsigned>(String) | static_cast<unsigned>(enc));
     for(;;) {
         auto ch = getc();
         if(ch == '\"') break;
-        else if(ch == '\n') error(m_loc, "Unterminated string literal");
-        else if(ch == '\\') ch = get_escaped_char(enc);
-        append(result, ch, enc);
+        // the sentinel is not read past
+        if(ch == '\n' || ch == '\0') {
+            ungetc();
+            error(location(), "Unterminated string literal");
+        }
+        auto char_enc = enc;
+        if(ch == '\\') ch = get_escaped_char(char_enc);
+        append(result, ch, char_enc);
     }
-    return compiler::make_token(attr, m_loc, result);
+    return make_token(attr, result);
 }
 
 token* lexer::get_number(char_t ch) {
@@ -421,57 +673,68 @@ token* lexer::get_number(char_t ch) {
         ch = getc();
         bool flonum = is_one_of(last, "eEpP") && is_one_of(ch, "+-");
         maybe_float = maybe_float || flonum || ch == '.';
-        if (!std::isalnum(ch) && ch != '.' && !flonum) {
+        if (!is_alnum(ch) && ch != '.' && !flonum) {
             ungetc();
             break;
         }
         result += ch;
         last = ch;
     }
-    return compiler::make_token(maybe_float ? PPFloat : PPNumber, m_loc, result);
+    return make_token(maybe_float ? PPFloat : PPNumber, result);
 }
 
 token* lexer::get_identifier(char_t ch, encoding enc) {
+    // usually the identifier is a single run in the text and needs no copy
+    if(enc == ASCII && static_cast<unsigned char>(m_pos[-1]) == ch) {
+        auto begin = m_pos - 1, run = m_pos;
+        auto hash = hash_step(hash_seed, ch);
+        for(; is_ident(static_cast<unsigned char>(*run)); ++run)
+            hash = hash_step(hash, *run);
+        // a line splice or UCN, a character to be decoded, or the end of a stream window follows
+        if(*run != '\\' && static_cast<unsigned char>(*run) < 0x80 && (*run || !m_stream)) {
+            m_pos = run;
+            auto attr = string_to_attr(begin, run - begin);
+            if(attr == Error)
+                return compiler::make_token(Identifier, m_file, offset(), intern_string(begin, run - begin, hash));
+            return make_token(attr);
+        }
+    }
+
     string result{};
     append(result, ch, enc);
+    // hash for the string table goes along with scanning
+    auto hash = hash_bytes(hash_seed, result.data(), result.size());
     for(;;) {
+        // take the longest run of plain identifier characters at once
+        auto run = m_pos;
+        for(; is_ident(static_cast<unsigned char>(*run)); ++run)
+            hash = hash_step(hash, *run);
+        result.append(m_pos, run);
+        m_pos = run;
+        
+        auto size = result.size();
         ch = getc();
-        if(std::isalnum(ch) || ch == '_' || ch == '$')
-            result += ch;
+        if(is_ident(ch))
+            append(result, ch, ASCII);
         else if(ch == '\\') {
             if(expect('u')) append(result, get_UCN(4), CHAR16);
             else if(expect('U')) append(result, get_UCN(8), CHAR32);
             else break;
         } else 
             break;
+        hash = hash_bytes(hash, result.data() + size, result.size() - size);
     }
     ungetc();
     
     auto attr = string_to_attr(result);
     if(attr == Error)
-        return compiler::make_token(Identifier, m_loc, result);
+        return compiler::make_token(Identifier, m_file, offset(), intern_string(result.data(), result.size(), hash));
     return make_token(attr);
 }
 
 
-file_map::iterator read_file(const char *location) {
-    auto it = files.find(location);
-    if(it != files.end())
-        return it;
-    
-    std::ifstream file(location, std::ios::in|std::ios::binary|std::ios::ate);
-    if(!file.is_open())
-        error("%s: Cannot open file or file does not exist\n", location);
-    unsigned int file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    std::string result(file_size + 1, '\0');
-    file.read(&result.front(), file_size);
-    
-    return files.insert({location, std::move(result)}).first;
-}
-
 int value_of(char_t ch) {
-    if(std::isdigit(ch))
+    if(is_digit(ch))
         return ch - '0';
     else if('a' <= ch && ch <= 'f') 
         return ch - 'a' + 10;
@@ -481,22 +744,28 @@ int value_of(char_t ch) {
         return 0;
 }
 
-bool is_oct(char_t ch) {return '0' <= ch && ch <= '7';}
-
-bool is_one_of(char_t ch, const char_t *pattern) {
+bool is_one_of(char_t ch, const char *pattern) {
     for(; *pattern; ++pattern) 
-        if(ch == *pattern) return true;
+        if(ch == static_cast<unsigned char>(*pattern)) return true;
     return false;
 }
 
 void append(string &str, char_t ch, encoding enc) {
     switch(enc) {
-        case ASCII: str += ch; break;
+        case ASCII: case WCHAR: appendu8(str, ch); break;
         case CHAR16: append16(str, ch); break;
         case CHAR32: append32(str, ch); break;
     }
 }
 
+// ch is ASCII or a UTF-8 sequence packed by peekc
+void appendu8(string &str, char_t ch) {
+    if(ch > 0xffffff) str += static_cast<char>(ch >> 24);
+    if(ch > 0xffff) str += static_cast<char>(ch >> 16);
+    if(ch > 0xff) str += static_cast<char>(ch >> 8);
+    str += static_cast<char>(ch);
+}
+
 void append16(string &str, char_t ch) {
     static constexpr auto uchar_max = std::numeric_limits<unsigned char>::max();
     str += ch & uchar_max;
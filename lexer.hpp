@@ -6,8 +6,12 @@
 
 #include "concepts/non_copyable.hpp"
 
+#include <memory>
+
 namespace compiler {
 
+class source_stream;
+
 enum encoding: unsigned int {
     ASCII = 0, WCHAR = 1, CHAR16, CHAR32
 };
@@ -17,13 +21,38 @@ class lexer: public non_copyable {
         typedef std::string string;
         typedef char32_t    char_t;
     private:
-        const string *m_text; /**< text source of lexer */
+        const char *m_text;   /**< text source of lexer */
+        const char *m_end;    /**< end of text source, past its sentinel '\0' */
         const char *m_pos;    /**< current reading position */
-        file_pos m_loc;       /**< location to current reading file */
+        uint32_t m_file;      /**< source id of the text */
+        uint32_t m_base;      /**< offset of m_text in the source, moves with a stream window */
+        std::unique_ptr<source_stream> m_stream; /**< input read through a window, if any */
     private:
         token* make_token(char_t) const;
+        token* make_token(char_t, string&) const;
+        
+        // offset of the reading position in the source
+        uint32_t offset() const;
+        // line and column of the reading position, only computed for messages
+        file_pos location() const;
+        
+        // slide the stream window forward, returns false at the end of input
+        bool refill();
+        // make sure `n` bytes from the reading position are in memory, unless input ends
+        void ensure(std::size_t n);
         
         char_t peek_helper();
+        
+        // raw scanning of skipped groups
+        // consumes lines up to one beginning with '#' and the '#' itself,
+        // false at the end of input
+        bool skip_to_directive();
+        // the name of a directive if it is one, Error otherwise
+        uint32_t directive_name();
+        // after the opening characters
+        void skip_raw_comment();
+        void skip_raw_line_comment();
+        void skip_raw_literal(char quote);
     public:
         /**
          * @brief lexer empty initializer
@@ -31,22 +60,30 @@ class lexer: public non_copyable {
         lexer();
         
         /**
-         * @brief initialize a lexer with given file location
+         * @brief initialize a lexer with given file location, "-" for stdin.
+         *        Pipes and other files that are not regular are read
+         *        through a bounded window instead of being loaded at once.
          * @param location location of a file
          */
         lexer(const char *location);
         
         /**
-         * @brief initialize a lexer with given string
+         * @brief initialize a lexer with given string. The text is not
+         *        registered as a source, its tokens have source id 0 and
+         *        cannot be located; the string only has to outlive the lexer
          * @param text text source of this new lexer
          */
         lexer(const string &text);
         
         /**
-         * @brief set line number
-         * @param line line number to set
+         * @brief initialize a lexer reading through a bounded window,
+         *        memory stays constant regardless of the input size
+         * @param fd file descriptor to read from, e.g. 0 for stdin
+         * @param name name of the input in messages
          */
-        void set_line(unsigned line);
+        lexer(int fd, const char *name);
+        
+        ~lexer();
         
         /**
          * @brief get a single character. Trigraphs are handled here.
@@ -104,6 +141,20 @@ class lexer: public non_copyable {
         // returns true if a (lexical) newline is skipped
         bool skip_space();
         
+        // Skipped conditional groups are scanned as raw text, nothing is
+        // tokenized. Comments and literals are only stepped over so that
+        // a '#' inside them begins no directive.
+        
+        /**
+         * @brief skip a group whose condition is false. Conditionals nested
+         *        in it are matched by the names of their directives only.
+         * @return the #elif, #else or #endif ending the group, the rest of
+         *         its line is not read yet; Eof if input ends first
+         */
+        token* skip_group();
+        // consumes the rest of the line and the newline
+        void skip_raw_line();
+        
         token* get();
         
         token* get_digraph(char_t);
@@ -1,16 +1,146 @@
-#ifndef CC_DEBUG
-#define CC_DEBUG
-#endif
-
+#include "cpp.hpp"
 #include "parser.hpp"
+#include "trace.hpp"
+#include "context.hpp"
+#include "include_path.hpp"
+#include "token_printer.hpp"
 
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
-int main() try {
-    compiler::parser parser("/home/h/2.c");
-    parser.process();
-    parser.print();
-    return EXIT_SUCCESS;
+#include <fcntl.h>
+#include <unistd.h>
+
+static std::string output_of(const char*);
+static bool preprocess(const char*, const char*);
+static bool compile(const char*, const char*);
+static bool compile_all(const std::vector<const char*>&, unsigned int);
+
+// usage: compiler [-E] [-o file] [-j threads] [-I dir] [-isystem dir] file...
+// -E writes the preprocessed files in turn to the standard output, or the
+// only one to -o file
+// file.c is compiled into file.s, or into -o file if it is the only one;
+// several files are compiled at once on -j threads
+int main(int argc, char *argv[]) try {
+    std::vector<const char*> inputs{};
+    const char *output = nullptr;
+    bool preprocess_only = false;
+    unsigned int threads = 1;
+    for(int i = 1; i < argc; ++i) {
+        if(!std::strcmp(argv[i], "-E"))
+            preprocess_only = true;
+        else if(!std::strncmp(argv[i], "-o", 2))
+            output = argv[i][2] ? argv[i] + 2 : i + 1 < argc ? argv[++i] : "";
+        else if(!std::strncmp(argv[i], "-j", 2)) {
+            auto n = argv[i][2] ? argv[i] + 2 : i + 1 < argc ? argv[++i] : "";
+            threads = std::strtoul(n, nullptr, 10);
+        }
+        else if(!std::strncmp(argv[i], "-I", 2)) {
+            auto dir = argv[i][2] ? argv[i] + 2 : i + 1 < argc ? argv[++i] : "";
+            compiler::add_include_dir(dir);
+        } else if(!std::strcmp(argv[i], "-isystem") && i + 1 < argc)
+            compiler::add_system_include_dir(argv[++i]);
+        else
+            inputs.push_back(argv[i]);
+    }
+    if(inputs.empty())
+        compiler::error("No input files\n");
+    if(output && inputs.size() > 1)
+        compiler::error("Option -o requires a single input file\n");
+    if(preprocess_only) {
+        // a file that fails does not stop the ones after it, as in GCC
+        bool done = true;
+        for(auto input: inputs)
+            done = preprocess(input, output) && done;
+        return done ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if(inputs.size() > 1)
+        return compile_all(inputs, threads) ? EXIT_SUCCESS : EXIT_FAILURE;
+    
+    auto input = inputs.front();
+    auto done = compile(input, output ? output : output_of(input).c_str());
+    return done ? EXIT_SUCCESS : EXIT_FAILURE;
 } catch (int) {
     return EXIT_FAILURE;
 }
+
+// The trace is dumped where a unit fails, while the strings of its context
+// are there to name the tokens
+static std::mutex dump_lock{};
+
+// file.c gives file.s, the standard input the standard output
+std::string output_of(const char *input) {
+    std::string result = input;
+    if(result == "-") return "/dev/stdout";
+    auto dot = result.rfind('.'), slash = result.rfind('/');
+    if(dot != std::string::npos && (slash == std::string::npos || dot > slash))
+        result.erase(dot);
+    return result + ".s";
+}
+
+// to the standard output if there is no output file
+bool preprocess(const char *input, const char *output) {
+    compiler::compilation_context context{};
+    compiler::context_scope scope(context);
+    auto fd = output ? open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+    if(fd < 0) {
+        std::perror(output);
+        return false;
+    }
+    try {
+        compiler::cpp pp(input);
+        compiler::token_printer out(fd);
+        for(auto tok = pp.get(); !tok->is(compiler::Eof); tok = pp.get())
+            out.print(tok, pp.origin());
+        out.flush();
+        if(output) close(fd);
+        return true;
+    } catch(int) {
+        if(output) close(fd);
+        std::lock_guard<std::mutex> lock(dump_lock);
+        compiler::dump_trace();
+        return false;
+    }
+}
+
+// every unit is compiled in a context of its own, freed once it is done
+bool compile(const char *input, const char *output) {
+    compiler::compilation_context context{};
+    compiler::context_scope scope(context);
+    try {
+        compiler::parser parser(input);
+        parser.process();
+        parser.print(output);
+        return true;
+    } catch(int) {
+        std::lock_guard<std::mutex> lock(dump_lock);
+        compiler::dump_trace();
+        return false;
+    }
+}
+
+// every file is compiled by the first thread free
+bool compile_all(const std::vector<const char*> &inputs, unsigned int threads) {
+    std::atomic<std::size_t> next{0};
+    std::atomic<bool> failed{false};
+    auto work = [&]() {
+        for(auto i = next++; i < inputs.size(); i = next++) {
+            if(!compile(inputs[i], output_of(inputs[i]).c_str()))
+                failed = true;
+        }
+    };
+    
+    std::vector<std::thread> pool{};
+    for(unsigned int i = 1; i < threads && i < inputs.size(); ++i)
+        pool.emplace_back(work);
+    work();
+    for(auto &&t: pool) t.join();
+    return !failed;
+}
@@ -0,0 +1,295 @@
+#include "memory_stats.hpp"
+#include "source.hpp"
+
+#include <mutex>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+#include <cxxabi.h>
+
+using namespace compiler;
+
+namespace {
+
+struct kind_counters {
+    std::atomic<uint64_t> m_allocations;
+    std::atomic<uint64_t> m_bytes;
+    std::atomic<uint64_t> m_frees;
+    std::atomic<uint64_t> m_freed_bytes;
+    std::atomic<uint64_t> m_live;
+    std::atomic<uint64_t> m_peak;
+    std::atomic<uint64_t> m_lifetimes; // sum, of the freed ones
+    std::atomic<uint64_t> m_longest;
+};
+
+struct phase_counters {
+    std::atomic<uint64_t> m_allocations;
+    std::atomic<uint64_t> m_bytes;
+};
+
+} // anonymous namespace
+
+static constexpr unsigned int max_kinds = 1024;
+
+static const char *phase_names[PHASE_COUNT] = {"other", "lex", "preprocess", "parse", "IR"};
+static const char *source_names[] = {"arena", "pool", "strings"};
+
+static bool        initial_memory_stats();
+static std::string readable(const char *mangled);
+static void        raise(std::atomic<uint64_t>&, uint64_t);
+static void        arm();
+static void        write_at_exit();
+static void        put_string(std::FILE*, const std::string&);
+static void        sum_sources(uint64_t &files, uint64_t &bytes, uint64_t &lines);
+
+static std::string output{};
+std::atomic<bool> compiler::memory_stats_enabled{initial_memory_stats()};
+
+static kind_counters kinds[max_kinds];
+static phase_counters phases[PHASE_COUNT];
+// allocations counted so far, the clock of lifetimes
+static std::atomic<uint64_t> clock_now{0};
+static std::atomic<uint64_t> total_live{0};
+static std::atomic<uint64_t> total_peak{0};
+// of the units done, see count_sources
+static std::atomic<uint64_t> source_files{0};
+static std::atomic<uint64_t> source_bytes{0};
+static std::atomic<uint64_t> source_lines{0};
+
+// names by id, kind 0 is for the kinds beyond max_kinds
+static std::mutex kinds_lock{};
+static std::vector<std::pair<std::string, memory_source>> kind_names{{"other", FROM_ARENA}};
+static std::unordered_map<std::string, unsigned int> kind_ids{};
+
+static thread_local memory_phase current_phase = PHASE_OTHER;
+// not thread_local, the blocks of the default context die after the
+// thread_local objects of the main thread
+static std::mutex births_lock{};
+static std::unordered_map<const void*, uint64_t> block_births{};
+
+bool initial_memory_stats() {
+    auto path = std::getenv("CC_MEMORY_STATS");
+    if(!path || !*path) return false;
+    output = path;
+    return true;
+}
+
+void compiler::set_memory_stats(const char *path) {
+    if(path) output = path;
+    memory_stats_enabled.store(path, std::memory_order_relaxed);
+}
+
+// demangled, without the namespaces of the compiler and of the library ABI
+std::string readable(const char *mangled) {
+    int status;
+    auto demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+    std::string name = status ? mangled : demangled;
+    std::free(demangled);
+    for(auto prefix: {"compiler::", "__cxx11::"}) {
+        auto len = std::strlen(prefix);
+        for(auto at = name.find(prefix); at != std::string::npos; at = name.find(prefix, at))
+            name.erase(at, len);
+    }
+    return name;
+}
+
+unsigned int compiler::memory_kind(const std::type_info &type, memory_source source) {
+    return memory_kind(readable(type.name()).c_str(), source);
+}
+
+unsigned int compiler::memory_kind(const char *name, memory_source source) {
+    std::lock_guard<std::mutex> lock(kinds_lock);
+    std::string key = std::string(source_names[source]) + ':' + name;
+    auto it = kind_ids.find(key);
+    if(it != kind_ids.end()) return it->second;
+    if(kind_names.size() == max_kinds) return 0;
+    kind_names.emplace_back(name, source);
+    return kind_ids[key] = kind_names.size() - 1;
+}
+
+void raise(std::atomic<uint64_t> &peak, uint64_t value) {
+    auto old = peak.load(std::memory_order_relaxed);
+    while(old < value && !peak.compare_exchange_weak(old, value, std::memory_order_relaxed))
+        ;
+}
+
+// the counts are written at exit, after the objects constructed from now on
+// are destroyed and their deaths counted
+void arm() {
+    static std::once_flag once{};
+    std::call_once(once, []() {std::atexit(write_at_exit);});
+}
+
+uint64_t compiler::count_allocation(unsigned int kind, std::size_t bytes) {
+    arm();
+    auto birth = clock_now.fetch_add(1, std::memory_order_relaxed);
+    auto &&k = kinds[kind];
+    k.m_allocations.fetch_add(1, std::memory_order_relaxed);
+    k.m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    raise(k.m_peak, k.m_live.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    auto &&p = phases[current_phase];
+    p.m_allocations.fetch_add(1, std::memory_order_relaxed);
+    p.m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    raise(total_peak, total_live.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    return birth;
+}
+
+void compiler::count_free(unsigned int kind, std::size_t bytes, uint64_t birth) {
+    auto lifetime = clock_now.load(std::memory_order_relaxed) - birth;
+    auto &&k = kinds[kind];
+    k.m_frees.fetch_add(1, std::memory_order_relaxed);
+    k.m_freed_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    k.m_live.fetch_sub(bytes, std::memory_order_relaxed);
+    k.m_lifetimes.fetch_add(lifetime, std::memory_order_relaxed);
+    raise(k.m_longest, lifetime);
+    total_live.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void compiler::count_block(unsigned int kind, const void *block, std::size_t bytes) {
+    auto birth = count_allocation(kind, bytes);
+    std::lock_guard<std::mutex> lock(births_lock);
+    block_births[block] = birth;
+}
+
+void compiler::count_block_free(unsigned int kind, const void *block, std::size_t bytes) {
+    uint64_t birth;
+    {
+        // blocks allocated before counting began were not counted
+        std::lock_guard<std::mutex> lock(births_lock);
+        auto it = block_births.find(block);
+        if(it == block_births.end()) return;
+        birth = it->second;
+        block_births.erase(it);
+    }
+    count_free(kind, bytes, birth);
+}
+
+void memory_census::add(unsigned int kind, std::size_t bytes) {
+    auto birth = count_allocation(kind, bytes);
+    if(m_kinds.size() <= kind) m_kinds.resize(kind + 1, entry{0, 0, 0, 0});
+    auto &&e = m_kinds[kind];
+    if(!e.m_count++) e.m_first = birth;
+    e.m_bytes += bytes;
+    e.m_births += birth;
+}
+
+void memory_census::release() {
+    auto now = clock_now.load(std::memory_order_relaxed);
+    for(unsigned int kind = 0; kind < m_kinds.size(); ++kind) {
+        auto &&e = m_kinds[kind];
+        if(!e.m_count) continue;
+        auto &&k = kinds[kind];
+        k.m_frees.fetch_add(e.m_count, std::memory_order_relaxed);
+        k.m_freed_bytes.fetch_add(e.m_bytes, std::memory_order_relaxed);
+        k.m_live.fetch_sub(e.m_bytes, std::memory_order_relaxed);
+        k.m_lifetimes.fetch_add(e.m_count * now - e.m_births, std::memory_order_relaxed);
+        raise(k.m_longest, now - e.m_first);
+        total_live.fetch_sub(e.m_bytes, std::memory_order_relaxed);
+    }
+    m_kinds.clear();
+}
+
+// of the current context
+void sum_sources(uint64_t &files, uint64_t &bytes, uint64_t &lines) {
+    for(uint32_t id = 1, count = source_count(); id <= count; ++id) {
+        ++files;
+        bytes += source_size(id);
+        lines += locate(id, source_size(id)).m_line;
+    }
+}
+
+void compiler::count_sources() {
+    uint64_t files = 0, bytes = 0, lines = 0;
+    sum_sources(files, bytes, lines);
+    source_files.fetch_add(files, std::memory_order_relaxed);
+    source_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    source_lines.fetch_add(lines, std::memory_order_relaxed);
+}
+
+memory_phase memory_phase_scope::enter_phase(memory_phase phase) {
+    auto left = current_phase;
+    current_phase = phase;
+    return left;
+}
+
+void write_at_exit() {
+    if(output.empty()) return;
+    if(output == "-") {
+        dump_memory_stats(stderr);
+        return;
+    }
+    auto file = std::fopen(output.c_str(), "w");
+    if(!file) {
+        std::perror(output.c_str());
+        return;
+    }
+    dump_memory_stats(file);
+    std::fclose(file);
+}
+
+void put_string(std::FILE *out, const std::string &str) {
+    std::fputc('"', out);
+    for(auto ch: str) {
+        if(ch == '"' || ch == '\\') std::fputc('\\', out);
+        if(static_cast<unsigned char>(ch) < 0x20)
+            std::fprintf(out, "\\u%04x", ch);
+        else
+            std::fputc(ch, out);
+    }
+    std::fputc('"', out);
+}
+
+void compiler::dump_memory_stats(std::FILE *out) {
+    auto load = [](const std::atomic<uint64_t> &n) {
+        return static_cast<unsigned long long>(n.load(std::memory_order_relaxed));
+    };
+    
+    // and those of the unit still running, if any
+    uint64_t files = load(source_files), bytes = load(source_bytes), lines = load(source_lines);
+    sum_sources(files, bytes, lines);
+    
+    std::fprintf(out, "{\n  \"lifetime_unit\": \"allocations\",\n");
+    std::fprintf(out, "  \"sources\": {\"files\": %llu, \"bytes\": %llu, \"lines\": %llu},\n",
+                 static_cast<unsigned long long>(files), static_cast<unsigned long long>(bytes),
+                 static_cast<unsigned long long>(lines));
+    std::fprintf(out, "  \"allocations\": %llu,\n  \"live_bytes\": %llu,\n  \"peak_live_bytes\": %llu,\n",
+                 load(clock_now), load(total_live), load(total_peak));
+    
+    std::fprintf(out, "  \"phases\": {");
+    for(unsigned int i = 0; i < PHASE_COUNT; ++i) {
+        std::fprintf(out, "%s\n    \"%s\": {\"allocations\": %llu, \"bytes\": %llu}", i ? "," : "",
+                     phase_names[i], load(phases[i].m_allocations), load(phases[i].m_bytes));
+    }
+    std::fprintf(out, "\n  },\n");
+    
+    std::vector<std::pair<std::string, memory_source>> names{};
+    {
+        std::lock_guard<std::mutex> lock(kinds_lock);
+        names = kind_names;
+    }
+    // the most bytes first
+    std::vector<unsigned int> order{};
+    for(unsigned int kind = 0; kind < names.size(); ++kind) {
+        if(load(kinds[kind].m_allocations)) order.push_back(kind);
+    }
+    std::stable_sort(order.begin(), order.end(), [](unsigned int lhs, unsigned int rhs) {
+        return kinds[lhs].m_bytes.load(std::memory_order_relaxed) > kinds[rhs].m_bytes.load(std::memory_order_relaxed);
+    });
+    
+    std::fprintf(out, "  \"kinds\": [");
+    for(std::size_t i = 0; i < order.size(); ++i) {
+        auto &&k = kinds[order[i]];
+        auto frees = load(k.m_frees);
+        std::fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+        put_string(out, names[order[i]].first);
+        std::fprintf(out, ", \"allocator\": \"%s\", \"allocations\": %llu, \"bytes\": %llu, \"live_bytes\": %llu, "
+                     "\"peak_live_bytes\": %llu, \"frees\": %llu, \"mean_lifetime\": %.1f, \"max_lifetime\": %llu}",
+                     source_names[names[order[i]].second], load(k.m_allocations), load(k.m_bytes), load(k.m_live),
+                     load(k.m_peak), frees, frees ? load(k.m_lifetimes) / double(frees) : 0.0, load(k.m_longest));
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+    std::fflush(out);
+}
@@ -0,0 +1,124 @@
+#ifndef __COMPILER_MEMORY_STATS__
+#define __COMPILER_MEMORY_STATS__
+
+#include <atomic>
+#include <cstdio>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <typeinfo>
+
+namespace compiler {
+
+/* Where the memory of a compilation goes, counted on request.
+ *
+ * Objects made in an arena, blocks of a sizepool taken through
+ * pool_allocator or pool_vector and strings of a string_table are counted by
+ * kind, the type of the object or block, and by phase, what the thread was
+ * doing when it was allocated. Each kind has its allocations, bytes, live and peak live
+ * bytes, and the lifetimes of the objects freed so far. Lifetimes are
+ * measured in allocations, how many were counted in the process between
+ * the birth and the death of an object; an arena or a table frees all of
+ * its objects at once.
+ *
+ * Counting is off unless $CC_MEMORY_STATS names a file, the counts are then
+ * written to it at exit as JSON, with the lines of the sources read by every
+ * unit so that they can be compared per line across releases. "-" is the standard error.
+ * Disabled counting costs a load and a branch per allocation.
+ */
+
+enum memory_phase: unsigned char {
+    PHASE_OTHER,
+    PHASE_LEX,
+    PHASE_PREPROCESS,
+    PHASE_PARSE,
+    PHASE_IR,
+    
+    PHASE_COUNT,
+};
+
+enum memory_source: unsigned char {
+    FROM_ARENA,
+    FROM_POOL,
+    FROM_STRINGS,
+};
+
+extern std::atomic<bool> memory_stats_enabled;
+
+inline bool counting_memory() {
+    return memory_stats_enabled.load(std::memory_order_relaxed);
+}
+
+// id of a kind of allocation, made the first time a kind is counted
+unsigned int memory_kind(const std::type_info&, memory_source);
+unsigned int memory_kind(const char *name, memory_source);
+
+template <class T, memory_source Source> unsigned int memory_kind() {
+    static const unsigned int id = memory_kind(typeid(T), Source);
+    return id;
+}
+
+/**
+ * @brief count an allocation
+ * @return its birth, to be given back when it dies
+ */
+uint64_t count_allocation(unsigned int kind, std::size_t bytes);
+void     count_free(unsigned int kind, std::size_t bytes, uint64_t birth);
+
+// blocks freed one by one, their births are kept by address
+void count_block(unsigned int kind, const void*, std::size_t bytes);
+void count_block_free(unsigned int kind, const void*, std::size_t bytes);
+
+// Allocations that die together, the objects of an arena or the strings of
+// a table: only sums are kept, by kind.
+class memory_census {
+    struct entry {
+        uint64_t m_count;
+        uint64_t m_bytes;
+        uint64_t m_births; // sum
+        uint64_t m_first;  // birth of the oldest one
+    };
+    private:
+        std::vector<entry> m_kinds;
+    public:
+        memory_census():m_kinds() {}
+        ~memory_census() {release();}
+        
+        void add(unsigned int kind, std::size_t bytes);
+        // every allocation counted so far dies
+        void release();
+};
+
+// what the calling thread is doing, while it lives; nothing if not counting
+class memory_phase_scope {
+    private:
+        memory_phase m_saved;
+        bool m_set;
+    public:
+        explicit memory_phase_scope(memory_phase phase)
+            :m_saved(PHASE_OTHER), m_set(counting_memory()) {
+            if(m_set) m_saved = enter_phase(phase);
+        }
+        ~memory_phase_scope() {
+            if(m_set) enter_phase(m_saved);
+        }
+        
+        memory_phase_scope(const memory_phase_scope&) = delete;
+        memory_phase_scope& operator=(const memory_phase_scope&) = delete;
+        
+        // returns the phase left
+        static memory_phase enter_phase(memory_phase);
+};
+
+// the sources of the current context are added to those of the process,
+// before it goes with its unit; see ~compilation_context
+void count_sources();
+
+// nullptr disables counting, the counts so far are kept
+void set_memory_stats(const char *path);
+// the counts so far as JSON
+void dump_memory_stats(std::FILE *out);
+
+} // namespace compiler
+
+#endif // __COMPILER_MEMORY_STATS__
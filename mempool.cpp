@@ -0,0 +1,151 @@
+#include "mempool.hpp"
+
+#include <cstdio>
+
+using namespace compiler;
+
+void* arena::grow(std::size_t size, std::size_t align) {
+    // objects bigger than a quarter of a chunk get one of their own, the
+    // current chunk is kept for the small ones
+    auto large = size > chunk_size / 4;
+    auto bytes = sizeof(chunk) + align + (large ? size : chunk_size);
+    auto c = static_cast<chunk*>(std::malloc(bytes));
+    if(!c) {
+        std::puts("Interal error: insufficient memory");
+        throw std::bad_alloc();
+    }
+    ++m_count;
+    m_reserved += bytes;
+    
+    auto begin = reinterpret_cast<uintptr_t>(c + 1);
+    auto p = (begin + align - 1) & ~uintptr_t(align - 1);
+    if(large && m_chunks) {
+        // behind the current chunk, which is still the first one
+        c->m_prev = m_chunks->m_prev;
+        m_chunks->m_prev = c;
+    } else {
+        c->m_prev = m_chunks;
+        m_chunks = c;
+        m_next = reinterpret_cast<char*>(p + size);
+        m_end = reinterpret_cast<char*>(c) + bytes;
+    }
+    m_allocated += size;
+    return reinterpret_cast<void*>(p);
+}
+
+void arena::count(unsigned int kind, std::size_t bytes) {
+    if(!m_census) m_census = new memory_census();
+    m_census->add(kind, bytes);
+}
+
+void arena::release() {
+    for(auto f = m_finalizers; f; f = f->m_next)
+        f->m_destroy(f->m_object);
+    m_finalizers = nullptr;
+    // the objects die once they are destroyed
+    delete m_census;
+    m_census = nullptr;
+    
+    while(m_chunks) {
+        auto prev = m_chunks->m_prev;
+        std::free(m_chunks);
+        m_chunks = prev;
+    }
+    m_next = m_end = nullptr;
+    m_count = m_allocated = m_reserved = 0;
+}
+
+sizepool::sizepool()
+    :m_free(), m_next(nullptr), m_end(nullptr), m_slabs(nullptr), m_large{&m_large, &m_large}, m_used(),
+     m_large_used(0), m_in_use(0), m_high_water(0), m_reserved(0) {}
+
+sizepool::~sizepool() {
+    while(m_slabs) {
+        auto prev = m_slabs->m_prev;
+        std::free(m_slabs);
+        m_slabs = prev;
+    }
+    for(auto block = m_large.m_next; block != &m_large; ) {
+        auto next = block->m_next;
+        std::free(block);
+        block = next;
+    }
+}
+
+void* sizepool::carve(std::size_t cls) {
+    // what is left of the slab is cut into blocks of the classes it fits
+    for(auto i = classes; i--; ) {
+        auto bytes = class_size(i);
+        while(static_cast<std::size_t>(m_end - m_next) >= bytes) {
+            auto block = reinterpret_cast<free_block*>(m_next);
+            block->m_next = m_free[i];
+            m_free[i] = block;
+            m_next += bytes;
+        }
+    }
+    
+    auto s = static_cast<slab*>(std::malloc(slab_size));
+    if(!s) {
+        std::puts("Interal error: insufficient memory");
+        throw std::bad_alloc();
+    }
+    s->m_prev = m_slabs;
+    m_slabs = s;
+    m_reserved += slab_size;
+    // the header takes the place of a block
+    m_next = reinterpret_cast<char*>(s) + alignment;
+    m_end = reinterpret_cast<char*>(s) + slab_size;
+    
+    auto mem = m_next;
+    m_next += class_size(cls);
+    return mem;
+}
+
+void* sizepool::allocate_large(std::size_t size) {
+    auto block = static_cast<large_block*>(std::malloc(sizeof(large_block) + size));
+    if(!block) {
+        std::puts("Interal error: insufficient memory");
+        throw std::bad_alloc();
+    }
+    block->m_prev = &m_large;
+    block->m_next = m_large.m_next;
+    m_large.m_next->m_prev = block;
+    m_large.m_next = block;
+    
+    m_reserved += sizeof(large_block) + size;
+    m_large_used += size;
+    m_in_use += size;
+    if(m_in_use > m_high_water) m_high_water = m_in_use;
+    return block + 1;
+}
+
+void sizepool::deallocate_large(void *mem, std::size_t size) {
+    auto block = static_cast<large_block*>(mem) - 1;
+    block->m_prev->m_next = block->m_next;
+    block->m_next->m_prev = block->m_prev;
+    std::free(block);
+    m_reserved -= sizeof(large_block) + size;
+    m_large_used -= size;
+    m_in_use -= size;
+}
+
+void* sizepool::reallocate(void *old, std::size_t old_size, std::size_t new_size) {
+    if(!old) return allocate(new_size);
+    if(old_size <= max_size && new_size <= max_size) {
+        auto from = class_of(old_size), to = class_of(new_size);
+        if(from == to) return old;
+        // the block at the top of the slab grows or shrinks where it is
+        auto mem = static_cast<char*>(old);
+        if(mem + class_size(from) == m_next && class_size(to) <= static_cast<std::size_t>(m_end - mem)) {
+            m_used[from] -= class_size(from);
+            m_in_use -= class_size(from);
+            count(to, class_size(to));
+            m_next = mem + class_size(to);
+            return old;
+        }
+    }
+    auto mem = allocate(new_size);
+    std::memcpy(mem, old, old_size < new_size ? old_size : new_size);
+    deallocate(old, old_size);
+    return mem;
+}
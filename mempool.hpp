@@ -1,74 +1,299 @@
 #ifndef __COMPILER_UTIL_MEMPOOL__
 #define __COMPILER_UTIL_MEMPOOL__
 
+#include "memory_stats.hpp"
+
+#include "concepts/non_copyable.hpp"
+
+#include <new>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
-#include <boost/pool/object_pool.hpp>
+#include <utility>
+#include <type_traits>
 
 namespace compiler {
 
-template <class T> class mempool: public boost::object_pool<T> {
-    typedef boost::object_pool<T> base_class;
+// Objects of T made in an arena are destroyed on release. A class whose
+// destructor is not trivial but frees nothing, only virtual, specializes this
+// next to its definition.
+template <class T> struct arena_destroyed
+    :std::integral_constant<bool, !std::is_trivially_destructible<T>::value> {};
+
+/* Memory of a compilation: tokens, AST nodes, types and scopes.
+ *
+ * Objects are bump-allocated from chunks of chunk_size bytes and never freed
+ * one by one, release() drops them all at once at the end of a translation
+ * unit. Destructors run then, in reverse order of construction, only for
+ * objects that need one, see arena_destroyed; any other object costs nothing
+ * but its size. Not thread-safe, a thread allocating on its own has its own.
+ */
+class arena: public non_copyable {
+    struct chunk {
+        chunk *m_prev;
+    };
+    struct finalizer {
+        void (*m_destroy)(void*);
+        void *m_object;
+        finalizer *m_next;
+    };
+    private:
+        char *m_next; // free space of the current chunk
+        char *m_end;
+        chunk *m_chunks;         // the last one allocated first
+        finalizer *m_finalizers; // the last one constructed first
+        std::size_t m_count;     // chunks
+        std::size_t m_allocated; // bytes handed out
+        std::size_t m_reserved;  // bytes of chunks
+        memory_census *m_census; // of the objects made, while counting memory
+    private:
+        // a new chunk, or one of its own for a large object
+        void* grow(std::size_t size, std::size_t align);
+        void  count(unsigned int kind, std::size_t bytes);
+        
+        template <class T> static void destroy(void *object) {
+            static_cast<T*>(object)->~T();
+        }
     public:
-        using base_class::base_class;
-        // mempool();
-        // ~mempool();
-        // T* malloc(); 
-        // void free(const T*);
+        static constexpr std::size_t chunk_size = 1 << 20;
+        
+        arena()
+            :m_next(nullptr), m_end(nullptr), m_chunks(nullptr), m_finalizers(nullptr),
+             m_count(0), m_allocated(0), m_reserved(0), m_census(nullptr) {}
+        ~arena() {release();}
+        
+        void* allocate(std::size_t size, std::size_t align = alignof(std::max_align_t)) {
+            auto p = (reinterpret_cast<uintptr_t>(m_next) + align - 1) & ~uintptr_t(align - 1);
+            if(p + size > reinterpret_cast<uintptr_t>(m_end))
+                return grow(size, align);
+            m_next = reinterpret_cast<char*>(p + size);
+            m_allocated += size;
+            return reinterpret_cast<void*>(p);
+        }
+        
+        template <class T, class... Args> T* make(Args&&... args) {
+            auto object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            if(counting_memory()) count(memory_kind<T, FROM_ARENA>(), sizeof(T));
+            if(arena_destroyed<T>::value) {
+                auto f = static_cast<finalizer*>(allocate(sizeof(finalizer), alignof(finalizer)));
+                *f = {&destroy<T>, object, m_finalizers};
+                m_finalizers = f;
+            }
+            return object;
+        }
+        
+        // destroys every object and frees every chunk
+        void release();
+        
+        std::size_t chunks() const {return m_count;}
+        std::size_t allocated() const {return m_allocated;}
+        std::size_t reserved() const {return m_reserved;}
 };
 
-class sizepool {
-    struct poolnode {
-        poolnode *prev;
-        poolnode *next;
+// the arena of the current compilation_context, where the tokens of a thread
+// without an arena of its own are made as well
+arena& compilation_arena();
+
+/* Blocks of the variable-length data of a compilation: lists of parameters,
+ * members, arguments and statements, and the tables of scopes.
+ *
+ * A block is rounded up to a size class, 16 to 64 bytes by 16 then 96, 128,
+ * 192, 256 up to 2048, and carved from slabs of slab_size bytes. A freed
+ * block goes on the free list of its class and is handed out again for the
+ * next block of the class; a block freed or grown at the top of the current
+ * slab gives back or takes the space right there. Larger blocks are
+ * allocated on their own. Everything is freed with the pool, not thread-safe
+ * like the arena.
+ */
+class sizepool: public non_copyable {
+    struct free_block {
+        free_block *m_next;
+    };
+    struct slab {
+        slab *m_prev;
+    };
+    struct alignas(alignof(std::max_align_t)) large_block {
+        large_block *m_prev;
+        large_block *m_next;
     };
+    public:
+        static constexpr std::size_t classes = 14;
+        static constexpr std::size_t max_size = 2048;
+        static constexpr std::size_t slab_size = 64 << 10;
+        static constexpr std::size_t alignment = 16;
+    private:
+        free_block *m_free[classes];
+        char *m_next; // free space of the current slab
+        char *m_end;
+        slab *m_slabs;
+        large_block m_large; // head of a circular list
+        // statistics, in bytes
+        std::size_t m_used[classes]; // in blocks of each class
+        std::size_t m_large_used;
+        std::size_t m_in_use;        // in every block
+        std::size_t m_high_water;    // most in use at once
+        std::size_t m_reserved;      // of slabs and large blocks
     private:
-        poolnode head, tail;
+        // the free space of the current slab is too small
+        void* carve(std::size_t cls);
+        void* allocate_large(std::size_t size);
+        void  deallocate_large(void *mem, std::size_t size);
+        void  count(std::size_t cls, std::size_t size) {
+            m_used[cls] += size;
+            m_in_use += size;
+            if(m_in_use > m_high_water) m_high_water = m_in_use;
+        }
     public:
-        sizepool():head{nullptr, &tail}, tail{&head, nullptr} {}
-        
-        ~sizepool() {
-            auto ptr = head.next;
-            while(ptr != &tail) {
-                auto save = ptr->next;
-                std::free(ptr);
-                ptr = save;
-            }
+        static std::size_t class_of(std::size_t size) {
+            if(size <= 64) return size ? (size - 1) >> 4 : 0;
+            // two classes a power of two, 1.5 and 2 times the one below
+            auto n = size - 1;
+            auto bit = 63 - __builtin_clzll(n);
+            return 4 + (bit - 6) * 2 + ((n >> (bit - 1)) & 1);
+        }
+        static std::size_t class_size(std::size_t cls) {
+            if(cls < 4) return (cls + 1) << 4;
+            return (cls & 1 ? 128 : 96) << ((cls - 4) >> 1);
+        }
+        
+        sizepool();
+        ~sizepool();
+        
+        void* allocate(std::size_t size) {
+            if(size > max_size) return allocate_large(size);
+            auto cls = class_of(size), bytes = class_size(cls);
+            void *mem = m_free[cls];
+            if(mem)
+                m_free[cls] = m_free[cls]->m_next;
+            else if(static_cast<std::size_t>(m_end - m_next) >= bytes) {
+                mem = m_next;
+                m_next += bytes;
+            } else
+                mem = carve(cls);
+            count(cls, bytes);
+            return mem;
         }
         
-        void* allocate(size_t size) {
-            auto mem = reinterpret_cast<poolnode*>(malloc(sizeof(poolnode) + size)),
-                 before_tail = tail.prev;
-            if(!mem) {
-                puts("Interal error: insufficient memory");
-                throw std::bad_alloc();
+        // `size` is the size the block was allocated or last reallocated with
+        void deallocate(void *mem, std::size_t size) {
+            if(!mem) return;
+            if(size > max_size) return deallocate_large(mem, size);
+            auto cls = class_of(size), bytes = class_size(cls);
+            m_used[cls] -= bytes;
+            m_in_use -= bytes;
+            if(static_cast<char*>(mem) + bytes == m_next)
+                m_next = static_cast<char*>(mem);
+            else {
+                auto block = static_cast<free_block*>(mem);
+                block->m_next = m_free[cls];
+                m_free[cls] = block;
             }
-            before_tail->next = mem;
-            mem->prev = before_tail;
-            mem->next = &tail;
-            tail.prev = mem;
-            
-            return reinterpret_cast<void*>(reinterpret_cast<void**>(mem) + 2);
         }
         
-        void deallocate(void *mem) {
-            auto next = *(reinterpret_cast<poolnode**>(mem) - 1);
-            auto curr = next->prev,
-                 prev = curr->prev;
-            prev->next = next;
-            next->prev = prev;
-            std::free(curr);
+        void* reallocate(void *old, std::size_t old_size, std::size_t new_size);
+        
+        std::size_t used(std::size_t cls) const {return m_used[cls];}
+        std::size_t large() const {return m_large_used;}
+        std::size_t in_use() const {return m_in_use;}
+        std::size_t high_water() const {return m_high_water;}
+        std::size_t reserved() const {return m_reserved;}
+};
+
+// the pool of the current compilation_context
+sizepool& compilation_pool();
+
+// Allocator of containers whose elements live in compilation_pool(), the
+// pool of the context the container is made in.
+template <class T> class pool_allocator {
+    static_assert(alignof(T) <= sizepool::alignment, "over-aligned type");
+    template <class U> friend class pool_allocator;
+    private:
+        sizepool *m_pool;
+    public:
+        typedef T value_type;
+        typedef std::true_type propagate_on_container_copy_assignment;
+        typedef std::true_type propagate_on_container_move_assignment;
+        typedef std::true_type propagate_on_container_swap;
+        
+        pool_allocator():m_pool(&compilation_pool()) {}
+        template <class U> pool_allocator(const pool_allocator<U> &other):m_pool(other.m_pool) {}
+        
+        T* allocate(std::size_t n) {
+            auto p = m_pool->allocate(n * sizeof(T));
+            if(counting_memory()) count_block(memory_kind<T, FROM_POOL>(), p, n * sizeof(T));
+            return static_cast<T*>(p);
+        }
+        void deallocate(T *p, std::size_t n) {
+            if(counting_memory()) count_block_free(memory_kind<T, FROM_POOL>(), p, n * sizeof(T));
+            m_pool->deallocate(p, n * sizeof(T));
         }
         
-        void* reallocate(void *old, size_t old_size, size_t new_size) {
-            auto new_mem = allocate(new_size);
-            if(!new_mem) {
-                puts("Interal error: insufficient memory");
-                throw std::bad_alloc();
-            }
-            std::memmove(new_mem, old, old_size);
-            deallocate(old);
-            return new_mem;
+        template <class U> bool operator==(const pool_allocator<U> &other) const {return m_pool == other.m_pool;}
+        template <class U> bool operator!=(const pool_allocator<U> &other) const {return m_pool != other.m_pool;}
+};
+
+// A growing array of trivially copyable T in compilation_pool(), for the
+// lists built once and then only read: parameters and members. It grows by
+// sizepool::reallocate(), in place while it is at the top of a slab.
+template <class T> class pool_vector: public non_copyable {
+    static_assert(std::is_trivially_copyable<T>::value, "elements are moved as bytes");
+    static_assert(alignof(T) <= sizepool::alignment, "over-aligned type");
+    private:
+        sizepool *m_pool;
+        T *m_data;
+        uint32_t m_size;
+        uint32_t m_cap;
+    private:
+        void grow() {
+            auto cap = m_cap ? m_cap << 1 : 4;
+            auto counted = counting_memory();
+            if(counted && m_data) count_block_free(memory_kind<pool_vector, FROM_POOL>(), m_data, m_cap * sizeof(T));
+            m_data = static_cast<T*>(m_pool->reallocate(m_data, m_cap * sizeof(T), cap * sizeof(T)));
+            if(counted) count_block(memory_kind<pool_vector, FROM_POOL>(), m_data, cap * sizeof(T));
+            m_cap = cap;
+        }
+    public:
+        typedef T value_type;
+        typedef T* iterator;
+        typedef const T* const_iterator;
+        
+        pool_vector():m_pool(&compilation_pool()), m_data(nullptr), m_size(0), m_cap(0) {}
+        pool_vector(pool_vector &&o):m_pool(o.m_pool), m_data(o.m_data), m_size(o.m_size), m_cap(o.m_cap) {
+            o.m_data = nullptr;
+            o.m_size = o.m_cap = 0;
+        }
+        pool_vector& operator=(pool_vector &&o) {
+            std::swap(m_pool, o.m_pool);
+            std::swap(m_data, o.m_data);
+            std::swap(m_size, o.m_size);
+            std::swap(m_cap, o.m_cap);
+            return *this;
         }
+        ~pool_vector() {
+            if(counting_memory() && m_data) count_block_free(memory_kind<pool_vector, FROM_POOL>(), m_data, m_cap * sizeof(T));
+            m_pool->deallocate(m_data, m_cap * sizeof(T));
+        }
+        
+        void push_back(const T &value) {
+            if(m_size == m_cap) grow();
+            m_data[m_size++] = value;
+        }
+        
+        bool        empty() const {return !m_size;}
+        std::size_t size() const {return m_size;}
+        
+        T& operator[](std::size_t i) const {return m_data[i];}
+        T& front() const {return m_data[0];}
+        T& back() const {return m_data[m_size - 1];}
+        
+        iterator       begin() {return m_data;}
+        iterator       end() {return m_data + m_size;}
+        const_iterator begin() const {return m_data;}
+        const_iterator end() const {return m_data + m_size;}
+        const_iterator cbegin() const {return m_data;}
+        const_iterator cend() const {return m_data + m_size;}
 };
 
 } // namespace compiler
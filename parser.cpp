@@ -958,6 +958,7 @@ stmt* parser::statement() {
                 m_cpp.unget(tok);
                 return label_stmt();
             }
+            // fall through
         default: {
             m_cpp.unget(tok);
             auto res = make_expr_stmt(expr());
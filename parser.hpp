@@ -7,6 +7,7 @@
 #include "token.hpp"
 #include "scope.hpp"
 #include "codegen.hpp"
+#include "memory_stats.hpp"
 
 #include <list>
 
@@ -111,7 +112,13 @@ class parser {
         parser();
         parser(const char*);
         
-        void process() {translation_unit();}
+        // external declarations, once processed
+        const stmt_list& unit() const {return m_tu;}
+        
+        void process() {
+            memory_phase_scope phase(PHASE_PARSE);
+            translation_unit();
+        }
         
 //        void run() {
 //            auto main = m_curr->find("main");
@@ -121,8 +128,10 @@ class parser {
 //            print_top();
 //        }
         
-        void print() {
-            static IR ir{"/home/h/test.s"};
+        // every print numbers its temporaries and labels from the start
+        void print(const char *location) {
+            memory_phase_scope phase(PHASE_IR);
+            IR ir{location};
             for(auto &s:m_tu)
                 s->accept(&ir);
         }
@@ -0,0 +1,118 @@
+#include "scan.hpp"
+
+#include <cstdint>
+
+#if !defined(CC_SCALAR_SCAN) && defined(__AVX2__)
+#define CC_SCAN_WIDTH 32
+#include <immintrin.h>
+#elif !defined(CC_SCALAR_SCAN) && defined(__SSE2__)
+#define CC_SCAN_WIDTH 16
+#include <emmintrin.h>
+#endif
+
+using namespace compiler;
+
+#ifdef CC_SCAN_WIDTH
+
+#if CC_SCAN_WIDTH == 32
+typedef __m256i vec_t;
+
+static inline vec_t load(const char *p) {return _mm256_load_si256(reinterpret_cast<const vec_t*>(p));}
+static inline vec_t splat(char ch) {return _mm256_set1_epi8(ch);}
+static inline vec_t eq(vec_t a, vec_t b) {return _mm256_cmpeq_epi8(a, b);}
+static inline vec_t any(vec_t a, vec_t b) {return _mm256_or_si256(a, b);}
+static inline uint32_t bits(vec_t v) {return _mm256_movemask_epi8(v);}
+#else
+typedef __m128i vec_t;
+
+static inline vec_t load(const char *p) {return _mm_load_si128(reinterpret_cast<const vec_t*>(p));}
+static inline vec_t splat(char ch) {return _mm_set1_epi8(ch);}
+static inline vec_t eq(vec_t a, vec_t b) {return _mm_cmpeq_epi8(a, b);}
+static inline vec_t any(vec_t a, vec_t b) {return _mm_or_si128(a, b);}
+static inline uint32_t bits(vec_t v) {return _mm_movemask_epi8(v);}
+#endif
+
+/* Runs `mask(block)` over aligned blocks starting from the one containing `p`,
+ * `mask` returns a bit per byte, set for the bytes to stop at. Bytes before `p`
+ * in the first block are discarded.
+ */
+template <class Mask>
+static inline const char* scan(const char *p, Mask mask) {
+    auto offset = reinterpret_cast<uintptr_t>(p) & (CC_SCAN_WIDTH - 1);
+    auto block = p - offset;
+    auto found = mask(load(block)) >> offset;
+    if(found) return p + __builtin_ctz(found);
+    for(;;) {
+        block += CC_SCAN_WIDTH;
+        found = mask(load(block));
+        if(found) return block + __builtin_ctz(found);
+    }
+}
+
+const char* compiler::scan_line(const char *p) {
+    return scan(p, [](vec_t v) -> uint32_t {
+        // sign bits of non-ASCII bytes come for free
+        auto stop = any(any(eq(v, splat('\n')), eq(v, splat('\\'))), eq(v, splat('\0')));
+        return bits(stop) | bits(v);
+    });
+}
+
+const char* compiler::scan_comment(const char *p) {
+    return scan(p, [](vec_t v) -> uint32_t {
+        auto stop = any(any(eq(v, splat('\n')), eq(v, splat('\\'))), eq(v, splat('\0')));
+        return bits(any(stop, eq(v, splat('*')))) | bits(v);
+    });
+}
+
+const char* compiler::scan_skipped(const char *p) {
+    return scan(p, [](vec_t v) -> uint32_t {
+        auto stop = any(any(eq(v, splat('\n')), eq(v, splat('\\'))), eq(v, splat('\0')));
+        auto open = any(eq(v, splat('/')), any(eq(v, splat('"')), eq(v, splat('\''))));
+        return bits(any(stop, open));
+    });
+}
+
+const char* compiler::scan_space(const char *p) {
+    return scan(p, [](vec_t v) -> uint32_t {
+        auto space = any(any(eq(v, splat(' ')), eq(v, splat('\t'))),
+                         any(any(eq(v, splat('\v')), eq(v, splat('\f'))), eq(v, splat('\r'))));
+        // only the low CC_SCAN_WIDTH bits are meaningful
+        return ~bits(space) & static_cast<uint32_t>((1ULL << CC_SCAN_WIDTH) - 1);
+    });
+}
+
+#else // scalar fallback
+
+const char* compiler::scan_line(const char *p) {
+    for(;; ++p) {
+        auto ch = static_cast<unsigned char>(*p);
+        if(ch == '\n' || ch == '\\' || ch == '\0' || ch >= 0x80) return p;
+    }
+}
+
+const char* compiler::scan_comment(const char *p) {
+    for(;; ++p) {
+        auto ch = static_cast<unsigned char>(*p);
+        if(ch == '*' || ch == '\n' || ch == '\\' || ch == '\0' || ch >= 0x80) return p;
+    }
+}
+
+const char* compiler::scan_skipped(const char *p) {
+    for(;; ++p) {
+        switch(*p) {
+            case '\n': case '\\': case '\0': case '/': case '"': case '\'': return p;
+            default: continue;
+        }
+    }
+}
+
+const char* compiler::scan_space(const char *p) {
+    for(;; ++p) {
+        switch(*p) {
+            case ' ': case '\t': case '\v': case '\f': case '\r': continue;
+            default: return p;
+        }
+    }
+}
+
+#endif // CC_SCAN_WIDTH
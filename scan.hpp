@@ -0,0 +1,32 @@
+#ifndef __COMPILER_UTIL_SCAN__
+#define __COMPILER_UTIL_SCAN__
+
+namespace compiler {
+
+/* Byte scanners used by the lexer to skip comments and whitespaces.
+ *
+ * Each returns the first byte at or after the given position that the
+ * lexer has to look at on its own. '\0' always stops a scan, so the text
+ * must be terminated by it; the 16/32-byte kernels only issue aligned loads
+ * and never cross a page the terminator is not in.
+ *
+ * SSE2 or AVX2 kernels are selected at compile time, define CC_SCALAR_SCAN
+ * to force the portable byte-by-byte versions.
+ */
+
+// stops at '\n', '\\', '\0' and non-ASCII bytes
+const char* scan_line(const char*);
+
+// stops at '*', '\n', '\\', '\0' and non-ASCII bytes
+const char* scan_comment(const char*);
+
+// stops at '\n', '\\', '\0', '/', '"' and '\'', for text of skipped groups
+// that is not decoded
+const char* scan_skipped(const char*);
+
+// stops at the first byte other than ' ', '\t', '\v', '\f' or '\r'
+const char* scan_space(const char*);
+
+} // namespace compiler
+
+#endif // __COMPILER_UTIL_SCAN__
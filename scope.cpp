@@ -1,12 +1,8 @@
 #include "scope.hpp"
-#include "mempool.hpp"
+#include "context.hpp"
 
 using namespace compiler;
 
-static mempool<scope> scope_pool{};
-
-static uint32_t anony_tag = 1;
-
 static std::string tagged(token *tok) {
     return std::string{tok->to_string()} += '@';
 }
@@ -49,7 +45,7 @@ ast_object* scope::declare(token *tok, qual_type tp, uint8_t stor) {
     std::string name;
     uint32_t _anony = 0;
     if(!tok) {
-        _anony = anony_tag++;
+        _anony = current_context().m_anony_tag++;
         name = "Anony[" + std::to_string(_anony) + ']';
     } else 
         name = tok->to_string();
@@ -104,5 +100,5 @@ ast_ident* scope::declare_tag(token *tok, type *tp) {
 
 
 scope* compiler::make_scope(scope *par, scope_kind k) {
-    return new (scope_pool.malloc()) scope(par, k);
+    return compilation_arena().make<scope>(par, k);
 }
@@ -2,6 +2,7 @@
 #define __COMPILER_SCOPE__
 
 #include "ast.hpp"
+#include "mempool.hpp"
 
 #include <string>
 #include <cstdint>
@@ -59,7 +60,8 @@ enum scope_kind: uint8_t {
 
 class scope {
     public:
-        typedef std::unordered_map<std::string, ast_ident*> table_t;
+        typedef std::unordered_map<std::string, ast_ident*, std::hash<std::string>, std::equal_to<std::string>,
+                                   pool_allocator<std::pair<const std::string, ast_ident*>>> table_t;
     private:
         scope *m_par; // outer scope
         scope_kind m_kind;
@@ -0,0 +1,303 @@
+#include "source.hpp"
+#include "error.hpp"
+#include "context.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace compiler;
+
+typedef source_table::entry source_entry;
+
+static source_table& sources() {return current_context().m_sources;}
+static source_entry& entry(source_table &table, uint32_t id) {return table.m_entries[id - 1];}
+
+// the window of a stream now holds `size` bytes from offset `window` on, those
+// after the first `kept` are new; lines before the window are only counted
+static void append_stream(uint32_t id, const char *text, uint64_t window, std::size_t kept, std::size_t size) {
+    auto &&table = sources();
+    std::lock_guard<std::mutex> lock(table.m_lock);
+    auto &&src = entry(table, id);
+    auto &&lines = src.m_window_lines;
+    for(auto p = text + kept, end = text + size; (p = std::find(p, end, '\n')) != end; )
+        lines.push_back(window + (++p - text));
+    src.m_size = window + size;
+    
+    auto first = std::upper_bound(lines.begin(), lines.end(), window) - 1;
+    src.m_first_line += first - lines.begin();
+    lines.erase(lines.begin(), first);
+    src.m_window = window;
+    src.m_window_text = text;
+}
+
+// the text of a closed stream is gone
+static void close_stream(uint32_t id) {
+    auto &&table = sources();
+    std::lock_guard<std::mutex> lock(table.m_lock);
+    entry(table, id).m_window_text = nullptr;
+}
+
+// offset in the window of a stream, of a 32-bit offset of a token; past
+// the end of the window for an offset before it
+static uint64_t in_window(const source_entry &src, uint32_t offset) {
+    // offsets of tokens wrap around every 4GB of input
+    return static_cast<uint32_t>(offset - static_cast<uint32_t>(src.m_window));
+}
+
+// a stream keeps no text and the lines of its window only, see append_stream
+static file_pos locate_stream(const source_entry &src, uint32_t offset) {
+    file_pos result{};
+    result.m_name = src.m_name;
+    auto &&lines = src.m_window_lines;
+    auto in = in_window(src, offset);
+    // the end-of-file token lies right after the sentinel
+    if(in > src.m_size - src.m_window + 1) {
+        // before the window, nothing is known but the file
+        result.m_line = result.m_column = 0;
+        return result;
+    }
+    auto pos = src.m_window + std::min<uint64_t>(in, src.m_size - src.m_window);
+    auto line = std::upper_bound(lines.begin(), lines.end(), pos) - 1;
+    // the new line ending a stream may have begun a line that never came
+    if(*line == src.m_size && line != lines.begin()) --line;
+    result.m_line = src.m_first_line + (line - lines.begin()) + 1;
+    result.m_column = pos - *line + 1;
+    return result;
+}
+
+static std::size_t page_size() {
+    static const std::size_t size = ::sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+source_buffer::source_buffer()
+    :m_data(""), m_size(0), m_mapped(0), m_copy() {}
+
+source_buffer::source_buffer(const char *location)
+    :m_data(""), m_size(0), m_mapped(0), m_copy() {
+    int fd = ::open(location, O_RDONLY);
+    if(fd < 0)
+        error("%s: Cannot open file or file does not exist\n", location);
+    
+    struct stat st;
+    bool mapped = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+                  map_file(fd, st.st_size);
+    ::close(fd);
+    
+    if(!mapped) read_stream(location);
+}
+
+source_buffer::source_buffer(source_buffer &&other)
+    :m_data(other.m_data), m_size(other.m_size), m_mapped(other.m_mapped), m_copy(std::move(other.m_copy)) {
+    // short strings live inside the object, re-point to our own copy
+    if(!m_mapped && m_size) m_data = m_copy.c_str();
+    other.m_data = "";
+    other.m_size = other.m_mapped = 0;
+}
+
+source_buffer::~source_buffer() {
+    if(m_mapped)
+        ::munmap(const_cast<char*>(m_data), m_mapped);
+}
+
+/* Reserve one page more than the file needs with an anonymous mapping, then
+ * map the file over its head. Bytes after the end of file in the last file page
+ * are zero-filled by the kernel, and the extra page is zero anyway, so there is
+ * always a '\0' right after the text, even when the size is page-aligned.
+ */
+bool source_buffer::map_file(int fd, std::size_t size) {
+    if(size == 0) return true; // m_data is already an empty string
+    
+    auto page = page_size();
+    auto length = (size + page) & ~(page - 1);
+    
+    auto base = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED) return false;
+    
+    auto text = ::mmap(base, size, PROT_READ, MAP_PRIVATE|MAP_FIXED, fd, 0);
+    if(text == MAP_FAILED) {
+        ::munmap(base, length);
+        return false;
+    }
+    ::madvise(text, size, MADV_SEQUENTIAL);
+    
+    m_data = static_cast<const char*>(text);
+    m_size = size;
+    m_mapped = length;
+    return true;
+}
+
+void source_buffer::read_stream(const char *location) {
+    static constexpr std::size_t chunk = 64 * 1024;
+    
+    std::ifstream file(location, std::ios::in|std::ios::binary);
+    if(!file.is_open())
+        error("%s: Cannot open file or file does not exist\n", location);
+    
+    // size of a pipe is unknown, grow until the stream drains
+    for(;;) {
+        auto used = m_copy.size();
+        m_copy.resize(used + chunk);
+        file.read(&m_copy[used], chunk);
+        m_copy.resize(used + file.gcount());
+        if(!file) break;
+    }
+    
+    m_data = m_copy.c_str();
+    m_size = m_copy.size();
+}
+
+// the sentinel, and whole blocks the scanners may load past it
+static constexpr std::size_t window_padding = 64;
+
+source_stream::source_stream(const char *location)
+    :m_fd(0), m_owned(false), m_eof(false), m_id(0), m_base(0), m_size(0),
+     m_window(new char[window_size + window_padding]()) {
+    if(std::string(location) != "-") {
+        m_fd = ::open(location, O_RDONLY);
+        if(m_fd < 0)
+            error("%s: Cannot open file or file does not exist\n", location);
+        m_owned = true;
+    }
+    m_id = add_stream(location);
+}
+
+source_stream::source_stream(int fd, const char *name)
+    :m_fd(fd), m_owned(false), m_eof(false), m_id(add_stream(name)), m_base(0), m_size(0),
+     m_window(new char[window_size + window_padding]()) {}
+
+source_stream::~source_stream() {
+    close_stream(m_id);
+    if(m_owned)
+        ::close(m_fd);
+}
+
+bool source_stream::refill(const char *keep) {
+    if(m_eof) return false;
+    
+    std::size_t kept = m_window.get() + m_size - keep;
+    std::memmove(m_window.get(), keep, kept);
+    m_base += keep - m_window.get();
+    
+    auto read = kept;
+    while(read < window_size) {
+        auto n = ::read(m_fd, m_window.get() + read, window_size - read);
+        if(n < 0 && errno == EINTR) continue;
+        if(n < 0) error("%s: Read error\n", source_name(m_id));
+        if(n == 0) {
+            m_eof = true;
+            break;
+        }
+        read += n;
+    }
+    
+    append_stream(m_id, m_window.get(), m_base, kept, read);
+    m_size = read;
+    // the sentinel, and no stale text right after it
+    std::memset(m_window.get() + m_size, 0, window_padding);
+    return read != kept;
+}
+
+bool compiler::streamed(const char *location) {
+    struct stat st;
+    return std::string(location) == "-" ||
+           (::stat(location, &st) == 0 && !S_ISREG(st.st_mode));
+}
+
+uint32_t compiler::open_source(const char *location) {
+    auto &&table = sources();
+    std::unique_lock<std::mutex> lock(table.m_lock);
+    auto it = table.m_ids.find(location);
+    if(it != table.m_ids.end())
+        return it->second;
+    
+    // mapped without the lock, another thread may register the file meanwhile
+    lock.unlock();
+    source_buffer buf(location);
+    lock.lock();
+    auto added = table.m_ids.emplace(location, table.m_entries.size() + 1);
+    if(added.second)
+        table.m_entries.emplace_back(std::move(buf), added.first->first.c_str());
+    return added.first->second;
+}
+
+uint32_t compiler::add_stream(const char *name) {
+    auto &&table = sources();
+    std::lock_guard<std::mutex> lock(table.m_lock);
+    table.m_stream_names.emplace_back(name);
+    table.m_entries.emplace_back(table.m_stream_names.back().c_str());
+    return table.m_entries.size();
+}
+
+uint32_t compiler::source_count() {
+    auto &&table = sources();
+    std::lock_guard<std::mutex> lock(table.m_lock);
+    return table.m_entries.size();
+}
+
+const char* compiler::source_name(uint32_t id) {
+    auto &&table = sources();
+    std::lock_guard<std::mutex> lock(table.m_lock);
+    return id ? entry(table, id).m_name : nullptr;
+}
+
+const char* compiler::source_text(uint32_t id) {
+    auto &&table = sources();
+    std::lock_guard<std::mutex> lock(table.m_lock);
+    return id ? entry(table, id).m_text : nullptr;
+}
+
+std::size_t compiler::source_size(uint32_t id) {
+    auto &&table = sources();
+    std::lock_guard<std::mutex> lock(table.m_lock);
+    return id ? entry(table, id).m_size : 0;
+}
+
+const char* compiler::source_at(uint32_t id, uint32_t offset, std::size_t &before) {
+    auto &&table = sources();
+    std::lock_guard<std::mutex> lock(table.m_lock);
+    if(!id) return nullptr;
+    auto &&src = entry(table, id);
+    if(src.m_text) {
+        if(offset > src.m_size) return nullptr;
+        before = offset;
+        return src.m_text + offset;
+    }
+    auto in = in_window(src, offset);
+    if(!src.m_window_text || in > src.m_size - src.m_window) return nullptr;
+    before = in;
+    return src.m_window_text + in;
+}
+
+file_pos compiler::locate(uint32_t id, uint32_t offset) {
+    file_pos result{};
+    if(!id) return result;
+    
+    auto &&table = sources();
+    std::lock_guard<std::mutex> lock(table.m_lock);
+    auto &&src = entry(table, id);
+    if(!src.m_text) return locate_stream(src, offset);
+    auto &&lines = src.m_lines;
+    if(lines.empty()) {
+        lines.push_back(0);
+        // a new line at the very end does not begin another line
+        for(auto p = src.m_text, end = p + src.m_size; (p = std::find(p, end, '\n')) + 1 < end; )
+            lines.push_back(++p - src.m_text);
+    }
+    
+    // the end-of-file token lies right after the sentinel
+    offset = std::min<std::size_t>(offset, src.m_size);
+    auto line = std::upper_bound(lines.begin(), lines.end(), offset) - 1;
+    result.m_name = src.m_name;
+    result.m_begin = src.m_text + *line;
+    result.m_line = line - lines.begin() + 1;
+    result.m_column = offset - *line + 1;
+    return result;
+}
@@ -0,0 +1,174 @@
+#ifndef __COMPILER_SOURCE__
+#define __COMPILER_SOURCE__
+
+#include "error.hpp" // file_pos
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+namespace compiler {
+
+// Read-only text of a source file, always followed by a '\0' sentinel.
+// Regular files are memory-mapped without copying, anything that cannot be
+// mapped (pipes, terminals, character devices) is read into a string.
+class source_buffer {
+    private:
+        const char *m_data;
+        std::size_t m_size;   // length of text, excluding the sentinel
+        std::size_t m_mapped; // length of the mapping, 0 if not mapped
+        std::string m_copy;   // storage of fallback path
+    private:
+        bool map_file(int fd, std::size_t size);
+        void read_stream(const char *location);
+    public:
+        source_buffer();
+        
+        /**
+         * @brief load the file at given location
+         * @param location location of a file
+         */
+        explicit source_buffer(const char *location);
+        
+        source_buffer(source_buffer&&);
+        ~source_buffer();
+        
+        const char* data() const {return m_data;}
+        std::size_t size() const {return m_size;}
+        bool mapped() const {return m_mapped;}
+        
+        source_buffer(const source_buffer&) = delete;
+        source_buffer& operator=(const source_buffer&) = delete;
+};
+
+/* A bounded window over a file descriptor, for input generated on the fly
+ * or too large to be held in memory. The text in the window is followed by a
+ * '\0' like any other source, it is the end of input only if `eof()`.
+ * The stream is registered in the source table with the lines of its
+ * window, and its text while it is open, so memory stays the same whatever the size of
+ * the input. Tokens in the window can still be located, of those before it
+ * only the file is known.
+ */
+class source_stream {
+    private:
+        int         m_fd;
+        bool        m_owned;  // opened by us, closed on destruction
+        bool        m_eof;
+        uint32_t    m_id;     // source id
+        uint64_t    m_base;   // offset of the window in the whole input
+        std::size_t m_size;   // bytes in the window, excluding the sentinel
+        std::unique_ptr<char[]> m_window;
+    public:
+        static constexpr std::size_t window_size = 64 * 1024;
+        
+        /**
+         * @brief open a file to be read through a window
+         * @param location location of a file, "-" for stdin
+         */
+        explicit source_stream(const char *location);
+        
+        /**
+         * @brief read through a window from an open file descriptor
+         * @param fd the file descriptor, not closed by the stream
+         * @param name name of the input in messages
+         */
+        source_stream(int fd, const char *name);
+        ~source_stream();
+        
+        const char* data() const {return m_window.get();}
+        std::size_t size() const {return m_size;}
+        uint64_t    base() const {return m_base;}
+        uint32_t    id() const {return m_id;}
+        bool        eof() const {return m_eof;}
+        
+        /**
+         * @brief slide the window, bytes before `keep` are dropped and
+         *        the rest moves to the front, followed by newly read input
+         * @param keep a position in the window
+         * @return if any input was read
+         */
+        bool refill(const char *keep);
+        
+        source_stream(const source_stream&) = delete;
+        source_stream& operator=(const source_stream&) = delete;
+};
+
+/* Every file a lexer reads is registered in the source table of the
+ * current compilation context (see context.hpp), tokens refer to it by the
+ * source id and a byte offset instead of carrying a whole file_pos. Ids
+ * start from 1, 0 means a token has no source. A file is loaded once a
+ * compilation and released with its context, the next compilation reads it
+ * again.
+ */
+struct source_table {
+    struct entry {
+        source_buffer m_buffer;
+        const char   *m_name;
+        const char   *m_text;
+        std::size_t   m_size;
+        // offsets of the beginning of every line, built on first use
+        std::vector<uint32_t> m_lines;
+        // of a stream, only the lines of its window are kept: the offsets of
+        // those beginning in the window, after that of the line it begins in
+        std::vector<uint64_t> m_window_lines;
+        uint64_t m_window;      // offset of the window in the whole input
+        uint64_t m_first_line;  // number of the line the window begins in, from 0
+        const char *m_window_text; // text of the window while the stream is open
+        
+        entry(source_buffer &&buf, const char *name)
+            :m_buffer(std::move(buf)), m_name(name), m_text(m_buffer.data()), m_size(m_buffer.size()), m_lines(),
+             m_window_lines(), m_window(0), m_first_line(0), m_window_text(nullptr) {}
+        // a stream, lines are recorded as it is read
+        explicit entry(const char *name)
+            :m_buffer(), m_name(name), m_text(nullptr), m_size(0), m_lines(),
+             m_window_lines{0}, m_window(0), m_first_line(0), m_window_text(nullptr) {}
+    };
+    
+    // id - 1 indexes this table, a deque keeps the entries in place
+    std::deque<entry> m_entries;
+    std::unordered_map<std::string, uint32_t> m_ids;
+    // names of streams, they are not looked up as files are
+    std::deque<std::string> m_stream_names;
+    // files are opened by threads lexing ahead too, see include_prefetch.hpp;
+    // guards the tables and the lines of every entry
+    std::mutex m_lock;
+    
+    source_table():m_entries(), m_ids(), m_stream_names(), m_lock() {}
+    
+    source_table(const source_table&) = delete;
+    source_table& operator=(const source_table&) = delete;
+};
+
+// stdin ("-") and files that are not regular are better read through source_stream
+bool streamed(const char *location);
+// load a file and register it, a file is loaded only once a compilation
+uint32_t open_source(const char *location);
+
+// register a stream, see source_stream, only the lines of its window are kept
+uint32_t add_stream(const char *name);
+
+// number of sources registered, the last id
+uint32_t source_count();
+// name of the file, nullptr for id 0
+const char* source_name(uint32_t id);
+// text of the source, followed by a '\0', nullptr for a stream
+const char* source_text(uint32_t id);
+// size of the text, of a stream it is what has been read so far
+std::size_t source_size(uint32_t id);
+// the text of the source at `offset`, followed by the rest of it and a '\0';
+// `before` receives how many bytes of the text precede it. Of a stream only
+// the window is there while it is open, nullptr elsewhere and for id 0
+const char* source_at(uint32_t id, uint32_t offset, std::size_t &before);
+
+// recover line and column of a byte offset in the source, both are 0 if
+// they are no longer known; offsets in a stream wrap around every 4GB
+file_pos locate(uint32_t id, uint32_t offset);
+
+} // namespace compiler
+
+#endif // __COMPILER_SOURCE__
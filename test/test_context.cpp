@@ -0,0 +1,104 @@
+// Compilation context tests.
+//
+// usage: test_context
+// Preprocesses units one after the other, each in a context of its own, with
+// the files they read changed in between, with and without threads lexing
+// ahead. Every unit must see the files as they are when it runs, and start
+// with a source table of its own, and dump a trace of its own events only.
+// Prints every mismatch and exits with failure if there is any.
+
+#include "cpp.hpp"
+#include "include_prefetch.hpp"
+#include "trace.hpp"
+#include "test_util.hpp"
+
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+using namespace compiler;
+
+static void check(const std::string &name, const std::string &path, const std::string &expected,
+                  uint32_t expected_sources) {
+    uint32_t sources = 0;
+    check(name, preprocess(path, &sources), expected);
+    check(name + ", sources", std::to_string(sources), std::to_string(expected_sources));
+}
+
+static void run(const std::string &mode, const std::string &dir) {
+    auto unit = dir + "/unit.c", first = dir + "/first.h", second = dir + "/second.h";
+    write_file(first, "#define A 1\n");
+    write_file(unit, "#include \"first.h\"\nint x = A;\n");
+    check(mode + ", first unit", unit, "int x = 1 ; ", 2);
+    
+    // a file changed, the next unit reads it again
+    write_file(first, "#define A (2 + 3) /* longer */\n");
+    check(mode + ", changed header", unit, "int x = ( 2 + 3 ) ; ", 2);
+    
+    // a file created, the next unit finds it
+    write_file(second, "#define B 4\n");
+    write_file(unit, "#include \"first.h\"\n#include \"second.h\"\nint y = A + B;\n");
+    check(mode + ", created header", unit, "int y = ( 2 + 3 ) + 4 ; ", 3);
+    
+    unlink(second.c_str());
+    write_file(unit, "#include \"second.h\"\n");
+    check(mode + ", removed header", unit, "error", 0);
+    
+    for(auto path: {unit, first})
+        unlink(path.c_str());
+}
+
+// a unit's trace has only its own events, the strings and sources of a
+// unit before it are gone with its context
+static void trace_per_unit(const std::string &dir) {
+    auto first = dir + "/first.c", second = dir + "/second.c";
+    write_file(first, "int first_unit, first_again;\n");
+    write_file(second, "b1 b2 b3\n");
+    set_trace(true);
+    preprocess(first);
+    
+    std::string dump{};
+    {
+        compilation_context context{};
+        context_scope scope(context);
+        cpp pp(second.c_str());
+        for(auto tok = pp.get(); !tok->is(Eof); tok = pp.get()) {}
+        auto out = std::tmpfile();
+        dump_trace(out);
+        std::rewind(out);
+        char line[256];
+        while(std::fgets(line, sizeof(line), out)) dump += line;
+        std::fclose(out);
+    }
+    set_trace(false);
+    
+    auto events = 0;
+    for(auto p = dump.c_str(); (p = std::strstr(p, "\nget")); ++p, ++events) {}
+    if(events != 4 || dump.find("first") != std::string::npos) {
+        std::printf("trace per unit: %d gets, expected 4, in\n%s", events, dump.c_str());
+        ++failures;
+    }
+    for(auto path: {first, second})
+        unlink(path.c_str());
+}
+
+int main() {
+    char dir[] = "/tmp/test_context_XXXXXX";
+    if(!mkdtemp(dir)) {
+        std::perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    
+    set_include_prefetch(0);
+    run("alone", dir);
+    set_include_prefetch(2);
+    run("lexing ahead", dir);
+    set_include_prefetch(0);
+    trace_per_unit(dir);
+    rmdir(dir);
+    
+    return report();
+}
@@ -0,0 +1,55 @@
+// Include guard tests.
+//
+// usage: test_guard
+// Includes files guarded by #pragma once and by #ifndef through several paths
+// of the same file: "lib/s.h" and "src/../lib/s.h", "./inc/o.h" and
+// "inc/o.h", and a link to the file. Each is read once whatever the path,
+// and a file without a guard every time. Prints every mismatch and exits
+// with failure if there is any.
+
+#include "test_util.hpp"
+
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace compiler;
+
+int main() {
+    char dir[] = "/tmp/test_guard_XXXXXX";
+    if(!mkdtemp(dir)) {
+        std::perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    std::string root = dir;
+    for(auto sub: {"/lib", "/src", "/inc"})
+        mkdir((root + sub).c_str(), 0700);
+    write_file(root + "/lib/s.h", "#pragma once\nstruct S { int a; };\n");
+    write_file(root + "/src/u.h", "#include \"../lib/s.h\"\n");
+    write_file(root + "/inc/o.h", "#ifndef O_H\n#define O_H\nint o;\n#endif\n");
+    write_file(root + "/plain.h", "p\n");
+    symlink("lib/s.h", (root + "/link.h").c_str());
+    
+    auto unit = root + "/m.c";
+    write_file(unit, "#include \"lib/s.h\"\n#include \"src/u.h\"\n");
+    check("pragma once, from another directory", preprocess(unit), "struct S { int a ; } ; ");
+    
+    write_file(unit, "#include \"./inc/o.h\"\n#include \"inc/o.h\"\n");
+    check("guard macro, with ./", preprocess(unit), "int o ; ");
+    
+    write_file(unit, "#include \"link.h\"\n#include \"lib/s.h\"\n");
+    check("pragma once, through a link", preprocess(unit), "struct S { int a ; } ; ");
+    
+    write_file(unit, "#include \"plain.h\"\n#include \"./plain.h\"\n");
+    check("no guard", preprocess(unit), "p p ");
+    
+    for(auto path: {"/m.c", "/link.h", "/plain.h", "/inc/o.h", "/src/u.h", "/lib/s.h"})
+        unlink((root + path).c_str());
+    for(auto sub: {"/lib", "/src", "/inc", ""})
+        rmdir((root + sub).c_str());
+    
+    return report();
+}
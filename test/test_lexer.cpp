@@ -0,0 +1,129 @@
+// Lexer regression tests.
+//
+// usage: test_lexer
+// Lexes short texts and compares the tokens with what is expected, prints
+// every mismatch and exits with failure if there is any. Covers line
+// splices, escapes in literals and UTF-8 text.
+
+#include "lexer.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+using namespace compiler;
+
+static int failures = 0;
+
+// the attributes and texts of the tokens of `text` up to the end
+static std::vector<token> lex(const std::string &text) {
+    std::vector<token> result;
+    lexer lex(text);
+    for(;;) {
+        auto tok = lex.get();
+        if(tok->is(Eof)) break;
+        result.push_back(*tok);
+    }
+    return result;
+}
+
+// `text` lexes to a single token of `attr` whose text is `expected`, a text
+// is compared up to its first '\0'
+static void check(const char *name, const std::string &text, uint32_t attr, const char *expected) {
+    try {
+        auto tokens = lex(text);
+        if(tokens.size() != 1) {
+            std::printf("%s: %zu tokens, expected 1\n", name, tokens.size());
+            ++failures;
+        } else if(!tokens[0].is(attr) || std::strcmp(tokens[0].to_string(), expected)) {
+            std::printf("%s: got %x \"%s\", expected %x \"%s\"\n", name, tokens[0].m_attr,
+                        tokens[0].to_string(), attr, expected);
+            ++failures;
+        }
+    } catch(int) {
+        std::printf("%s: rejected\n", name);
+        ++failures;
+    }
+}
+
+// `text` is an error, from a string and from a file
+static void rejected(const char *name, const std::string &text) {
+    auto path = "/tmp/test_lexer." + std::to_string(getpid()) + ".c";
+    auto file = std::fopen(path.c_str(), "w");
+    std::fwrite(text.data(), 1, text.size(), file);
+    std::fclose(file);
+    
+    for(auto from_file: {false, true}) {
+        try {
+            std::unique_ptr<lexer> lex(from_file ? new lexer(path.c_str()) : new lexer(text));
+            for(auto tok = lex->get(); !tok->is(Eof); tok = lex->get()) {}
+            std::printf("%s: accepted from a %s\n", name, from_file ? "file" : "string");
+            ++failures;
+        } catch(int) {}
+    }
+    unlink(path.c_str());
+}
+
+// `text` lexes to `count` tokens, and to Eof again when read past its end
+static void ends(const char *name, const std::string &text, std::size_t count) {
+    try {
+        lexer lex(text);
+        std::size_t n = 0;
+        for(auto tok = lex.get(); !tok->is(Eof); tok = lex.get()) ++n;
+        if(n != count) {
+            std::printf("%s: %zu tokens, expected %zu\n", name, n, count);
+            ++failures;
+        }
+        if(!lex.get()->is(Eof) || !lex.get()->is(Eof)) {
+            std::printf("%s: no Eof past the end\n", name);
+            ++failures;
+        }
+    } catch(int) {
+        std::printf("%s: rejected\n", name);
+        ++failures;
+    }
+}
+
+int main() {
+    // only a backslash followed by a newline is a splice
+    check("splice in identifier", "ab\\\ncd", Identifier, "abcd");
+    check("splice in string", "\"ab\\\ncd\"", String, "abcd");
+    check("escape is no splice", "\"a\\tb\\\\c\"", String, "a\tb\\c");
+    check("escaped quote", "'\\''", Character, "'");
+    
+    // an octal escape is at most 3 digits, a \x escape is one byte
+    check("octal escape", "\"\\101\\1024\"", String, "AB4");
+    check("octal zero", "\"\\0\"", String, "");
+    check("hex then text", "\"\\x41-\"", String, "A-");
+    
+    // \u takes 4 hex digits and \U 8, the closing quote is no digit
+    check("short UCN", "\"\\u00e9\"", String, "\xe9");
+    check("long UCN", "\"\\U000000e9\"", String, "\xe9");
+    
+    // UTF-8 text is kept byte for byte and may be part of an identifier
+    check("UTF-8 identifier", "r\xc3\xa9sum\xc3\xa9", Identifier, "r\xc3\xa9sum\xc3\xa9");
+    check("UTF-8 string", "\"\xe2\x82\xac \xf0\x9f\x98\x80\"", String, "\xe2\x82\xac \xf0\x9f\x98\x80");
+    check("UTF-8 character", "'\xc3\xa9'", Character, "\xc3\xa9");
+    
+    // a literal is ended by the end of the text, nothing past it is read
+    rejected("unterminated string", "\"abc");
+    rejected("backslash at the end", "\"abc\\");
+    
+    // a string is read up to its terminator as a file is, and no further;
+    // the texts are long enough to be on the heap
+    ends("line comment at the end", "first second // a comment up to the end", 3);
+    ends("space at the end", "first second                      ", 2);
+    ends("directive at the end", "#define the_name_of_a_macro 1", 4);
+    
+    if(failures) {
+        std::printf("%d failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("all passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,54 @@
+// Macro expansion tests.
+//
+// usage: test_macro
+// Preprocesses short texts and compares the spellings of the tokens out of
+// the preprocessor with what is expected. Prints every mismatch and exits
+// with failure if there is any.
+
+#include "cpp.hpp"
+#include "source.hpp"
+#include "test_util.hpp"
+
+#include <string>
+
+#include <unistd.h>
+
+using namespace compiler;
+
+// the spellings of the tokens out of the preprocessor separated by a space,
+// "error" if it fails; `sources` receives the number of sources registered
+static std::string expanded(const std::string &text, uint32_t *sources = nullptr) {
+    auto path = temporary_file("test_macro", text);
+    std::string result{};
+    auto done = in_context([&]() {
+        cpp pp(path.c_str());
+        for(auto tok = pp.get(); !tok->is(Eof); tok = pp.get())
+            result += (result.empty() ? "" : " ") + spelling_of(tok);
+        if(sources) *sources = source_count();
+    });
+    unlink(path.c_str());
+    return done ? result : "error";
+}
+
+int main() {
+    // a pasted token is scanned in place, no source is added for it
+    uint32_t sources = 0;
+    check("paste", expanded("#define cat(a, b) a ## b\n"
+                            "cat(x, 1) cat(0x, 1f) cat(+, +) cat(<<, =) cat(x, 2) cat(x, 3)\n", &sources),
+          "x1 0x1f ++ <<= x2 x3");
+    check("paste, sources", std::to_string(sources), "1");
+    check("invalid paste", expanded("#define cat(a, b) a ## b\ncat(a, +)\n"), "error");
+    check("paste of a line comment", expanded("#define P(a, b) a ## b\nP(/, /) x\n"), "error");
+    check("paste of a block comment", expanded("#define P(a, b) a ## b\nP(/, *) x */\n"), "error");
+    // C11 6.10.3.5 example 4, spaces are those before each token
+    check("stringize", expanded("#define hash_hash # ## #\n#define mkstr(a) # a\n"
+                                "#define in_between(a) mkstr(a)\n#define join(c, d) in_between(c hash_hash d)\n"
+                                "join(x, y)\n"), "\"x ## y\"");
+    check("stringize literals", expanded("#define str(s) # s\nstr(\"abc\\0d\"  'x')\n"),
+          "\"\\\"abc\\\\0d\\\" 'x'\"");
+    // C11 6.10.3.2, a \ outside of literals is not escaped
+    check("stringize backslash", expanded("#define str(s) # s\nstr(: \\n)\n"), "\": \\n\"");
+    check("paste of a prefix", expanded("#define W(s) L ## s\nW(\"ab\")\n"), "L\"ab\"");
+    
+    return report();
+}
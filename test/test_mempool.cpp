@@ -0,0 +1,166 @@
+// Size-class pool tests.
+//
+// usage: test_mempool
+// Allocates, frees and reallocates blocks of a sizepool and checks the size
+// classes, where each block comes from and what the statistics say: reuse
+// from the free lists, the top block given back and grown or shrunk in
+// place, the rest of a slab carved up and large blocks. Then grows a
+// pool_vector in a compilation context. Prints every mismatch and exits with
+// failure if there is any.
+
+#include "mempool.hpp"
+#include "context.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace compiler;
+
+static int failures = 0;
+
+static void check(const char *name, std::size_t got, std::size_t expected) {
+    if(got == expected) return;
+    std::printf("%s: got %zu, expected %zu\n", name, got, expected);
+    ++failures;
+}
+
+static void check(const char *name, const void *got, const void *expected) {
+    if(got == expected) return;
+    std::printf("%s: got %p, expected %p\n", name, got, expected);
+    ++failures;
+}
+
+static void classes() {
+    // the edges of the steps by 16, 1.5 and 2
+    const std::size_t sizes[][2] = {
+        {1, 16}, {16, 16}, {17, 32}, {64, 64}, {65, 96}, {96, 96}, {97, 128},
+        {128, 128}, {129, 192}, {1536, 1536}, {1537, 2048}, {2048, 2048},
+    };
+    for(auto &&s: sizes)
+        check("class size", sizepool::class_size(sizepool::class_of(s[0])), s[1]);
+    check("last class", sizepool::class_of(sizepool::max_size), sizepool::classes - 1);
+    for(std::size_t cls = 0; cls < sizepool::classes; ++cls)
+        check("class of its size", sizepool::class_of(sizepool::class_size(cls)), cls);
+}
+
+static void reuse() {
+    sizepool pool{};
+    auto a = pool.allocate(16), b = pool.allocate(16), c = pool.allocate(16);
+    check("used", pool.used(0), 48);
+    
+    // b is not at the top, it goes on the free list
+    pool.deallocate(b, 16);
+    check("used after free", pool.used(0), 32);
+    check("from the free list", pool.allocate(10), b);
+    
+    // the top block is given back, a block of another class takes its place
+    pool.deallocate(c, 16);
+    check("top given back", pool.allocate(2048), c);
+    check("in use", pool.in_use(), 32 + 2048);
+    check("high water", pool.high_water(), 32 + 2048);
+    
+    pool.deallocate(c, 2048);
+    pool.deallocate(a, 16);
+    check("in use at the end", pool.in_use(), 16);
+    check("high water at the end", pool.high_water(), 32 + 2048);
+    check("reserved", pool.reserved(), sizepool::slab_size);
+}
+
+static void carve() {
+    sizepool pool{};
+    // the slab header takes the place of a block of 16 bytes
+    auto first = static_cast<char*>(pool.allocate(2048));
+    auto slab = first - sizepool::alignment;
+    auto blocks = (sizepool::slab_size - sizepool::alignment) / 2048;
+    for(std::size_t i = 1; i < blocks; ++i)
+        pool.allocate(2048);
+    check("one slab", pool.reserved(), sizepool::slab_size);
+    
+    // 2032 bytes are left, too few for 2048: a new slab is taken and the
+    // rest is cut into 1536, 384 and 96 + 16 bytes
+    auto next = static_cast<char*>(pool.allocate(2048));
+    check("two slabs", pool.reserved(), 2 * sizepool::slab_size);
+    check("new slab", next < slab || next >= slab + sizepool::slab_size, true);
+    auto rest = slab + sizepool::alignment + blocks * 2048;
+    check("rest of 1536", pool.allocate(1536), rest);
+    check("rest of 384", pool.allocate(384), rest + 1536);
+    check("rest of 96", pool.allocate(96), rest + 1536 + 384);
+    check("rest of 16", pool.allocate(16), rest + 1536 + 384 + 96);
+    check("rest taken", pool.allocate(16), next + 2048);
+}
+
+static void reallocate() {
+    sizepool pool{};
+    auto a = static_cast<char*>(pool.allocate(16));
+    std::memcpy(a, "0123456789abcde", 16);
+    
+    // the top block grows and shrinks in place
+    check("same class", pool.reallocate(a, 16, 10), a);
+    check("grown in place", pool.reallocate(a, 16, 100), a);
+    check("grown, used before", pool.used(0), 0);
+    check("grown, used after", pool.used(sizepool::class_of(100)), 128);
+    check("shrunk in place", pool.reallocate(a, 100, 40), a);
+    check("shrunk, used", pool.used(sizepool::class_of(40)), 48);
+    check("shrunk, top", pool.allocate(16), a + 48);
+    
+    // a block below the top is copied, and its place freed
+    auto b = static_cast<char*>(pool.reallocate(a, 40, 200));
+    check("copied", b != a, true);
+    check("copied text", std::strcmp(b, "0123456789abcde"), 0);
+    check("copied, used before", pool.used(sizepool::class_of(40)), 0);
+    check("copied, old freed", pool.allocate(48), a);
+    
+    // and so is a large one
+    auto large = static_cast<char*>(pool.reallocate(b, 200, 4096));
+    check("large", pool.large(), 4096);
+    check("large text", std::strcmp(large, "0123456789abcde"), 0);
+    auto small = static_cast<char*>(pool.reallocate(large, 4096, 16));
+    check("small again", pool.large(), 0);
+    check("small text", std::strcmp(small, "0123456789abcde"), 0);
+}
+
+static void vector() {
+    compilation_context context{};
+    context_scope scope(context);
+    auto before = compilation_pool().in_use();
+    pool_vector<std::size_t> v{};
+    v.push_back(0);
+    auto data = v.begin();
+    for(std::size_t i = 1; i < 200; ++i)
+        v.push_back(i);
+    // nothing else is allocated, the top block grows in place
+    check("grown in place", v.begin(), data);
+    check("size", v.size(), 200);
+    std::size_t sum = 0;
+    for(auto i: v) sum += i;
+    check("elements", sum, 199 * 200 / 2);
+    check("capacity in use", compilation_pool().in_use() - before, 256 * sizeof(std::size_t));
+    
+    // another block on top, the next growth copies
+    auto other = compilation_pool().allocate(16);
+    for(std::size_t i = 200; i < 257; ++i)
+        v.push_back(i);
+    check("copied", v.begin() != data, true);
+    check("copied elements", v[0] + v[199] + v[256], 199 + 256);
+    
+    auto moved = std::move(v);
+    check("moved", moved.size(), 257);
+    check("moved from", v.size(), 0);
+    compilation_pool().deallocate(other, 16);
+}
+
+int main() {
+    classes();
+    reuse();
+    carve();
+    reallocate();
+    vector();
+    
+    if(failures) {
+        std::printf("%d failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("all passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,55 @@
+// Preprocessed output tests.
+//
+// usage: test_printer
+// Preprocesses short files and prints their tokens as -E does, then compares
+// the lines of code with what is expected; line markers are left out. Prints
+// every mismatch and exits with failure if there is any.
+
+#include "cpp.hpp"
+#include "token_printer.hpp"
+#include "test_util.hpp"
+
+#include <string>
+#include <cstdio>
+
+#include <unistd.h>
+
+using namespace compiler;
+
+// the output of -E without its line markers, "error" if it fails
+static std::string printed(const std::string &text) {
+    auto path = temporary_file("test_printer", text);
+    char output[] = "/tmp/test_printer_XXXXXX";
+    auto fd = mkstemp(output);
+    auto done = in_context([&]() {
+        cpp pp(path.c_str());
+        token_printer out(fd);
+        for(auto tok = pp.get(); !tok->is(Eof); tok = pp.get())
+            out.print(tok, pp.origin());
+    });
+    close(fd);
+    
+    std::string result{};
+    if(auto in = std::fopen(output, "r")) {
+        char line[1024];
+        while(std::fgets(line, sizeof(line), in)) {
+            if(line[0] != '#') result += line;
+        }
+        std::fclose(in);
+    }
+    unlink(output);
+    unlink(path.c_str());
+    return done ? result : "error";
+}
+
+int main() {
+    check("literals", printed("char *s = L\"ab\", c = '\\'', *u = \"\\u00e9x\\0\";\n"),
+          "char *s = L\"ab\", c = '\\'', *u = \"\\u00e9x\\0\";\n");
+    // adjacent literals are one token, printed from its value
+    check("adjacent literals", printed("char *s = \"a\" \"b\";\n"), "char *s = \"ab\";\n");
+    check("adjacent stringized", printed("#define S(x) #x\nchar *t = \"q\" S(w);\n"), "char *t = \"qw\";\n");
+    check("adjacent escapes", printed("char *v = \"\\\"\\u00e9\" \"\\n\";\n"), "char *v = \"\\\"\\351\\n\";\n");
+    check("adjacent spacing", printed("f(\"a\"\"b\",  \"c\"\n  \"d\");\n"), "f(\"ab\", \"cd\"\n  );\n");
+    
+    return report();
+}
@@ -0,0 +1,82 @@
+// Token cache tests.
+//
+// usage: test_token_cache
+// Preprocesses short files with the token cache disabled, then enabled on
+// a miss and on a hit, and compares what comes out. Prints every mismatch
+// and exits with failure if there is any.
+
+#include "token_cache.hpp"
+#include "test_util.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+using namespace compiler;
+
+static unsigned int entries(const std::string &dir) {
+    unsigned int result = 0;
+    if(auto d = opendir(dir.c_str())) {
+        while(auto e = readdir(d))
+            result += e->d_name[0] != '.';
+        closedir(d);
+    }
+    return result;
+}
+
+int main() {
+    auto dir = "/tmp/test_token_cache." + std::to_string(getpid());
+    
+    // skipped text need not lex, the file is not cached then
+    auto skipped = temporary_file("test_token_cache", "#if 0\nemail me @ foo `bar`\n#endif\nint x;\n");
+    set_token_cache("");
+    check("skipped, no cache", preprocess(skipped), "int x ; ");
+    set_token_cache(dir);
+    check("skipped, miss", preprocess(skipped), "int x ; ");
+    check("skipped, not saved", std::to_string(entries(dir)), "0");
+    check("skipped, miss again", preprocess(skipped), "int x ; ");
+    
+    // text that does not lex is still an error where it is not skipped
+    auto invalid = temporary_file("test_token_cache", "int @;\n");
+    check("invalid, miss", preprocess(invalid), "error");
+    check("invalid, not saved", std::to_string(entries(dir)), "0");
+    
+    auto plain = temporary_file("test_token_cache", "#define N 1\nint y = N + 2;\n");
+    set_token_cache("");
+    auto expected = preprocess(plain);
+    set_token_cache(dir);
+    check("plain, miss", preprocess(plain), expected);
+    check("plain, saved", std::to_string(entries(dir)), "1");
+    check("plain, hit", preprocess(plain), expected);
+    
+    // threads storing the same file write temporary files of their own
+    auto shared = temporary_file("test_token_cache", "#define M(x) x * x\nint z = M(3);\n");
+    set_token_cache("");
+    expected = preprocess(shared);
+    set_token_cache(dir);
+    std::vector<std::string> got(8);
+    std::vector<std::thread> threads{};
+    for(auto &result: got)
+        threads.emplace_back([&result, &shared]() {result = preprocess(shared);});
+    for(auto &thread: threads)
+        thread.join();
+    for(auto &result: got)
+        check("shared, miss", result, expected);
+    check("shared, saved once", std::to_string(entries(dir)), "2");
+    check("shared, hit", preprocess(shared), expected);
+    
+    for(auto path: {skipped, invalid, plain, shared})
+        unlink(path.c_str());
+    if(auto d = opendir(dir.c_str())) {
+        while(auto e = readdir(d)) {
+            if(e->d_name[0] != '.') unlink((dir + "/" + e->d_name).c_str());
+        }
+        closedir(d);
+    }
+    rmdir(dir.c_str());
+    
+    return report();
+}
@@ -0,0 +1,81 @@
+// Helpers of the tests that preprocess files: the files, a unit preprocessed
+// in a context of its own, and the mismatches, counted and reported at the
+// end. A test is a single file, everything here is static.
+
+#ifndef __COMPILER_TEST_UTIL__
+#define __COMPILER_TEST_UTIL__
+
+#include "cpp.hpp"
+#include "source.hpp"
+#include "context.hpp"
+
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+namespace compiler {
+
+static int failures = 0;
+
+// replaced as editors do, a mapping of the old file keeps the old text
+static inline void write_file(const std::string &path, const std::string &text) {
+    auto file = std::fopen((path + ".new").c_str(), "w");
+    std::fwrite(text.data(), 1, text.size(), file);
+    std::fclose(file);
+    std::rename((path + ".new").c_str(), path.c_str());
+}
+
+// a new file of `text` in /tmp named after the test, the caller removes it
+static inline std::string temporary_file(const char *test, const std::string &text) {
+    static int files = 0;
+    auto path = "/tmp/" + std::string(test) + "." + std::to_string(getpid()) + "." + std::to_string(++files) + ".c";
+    write_file(path, text);
+    return path;
+}
+
+// runs `body` in a compilation context of its own, false if it fails
+template <class Body> static inline bool in_context(Body body) {
+    compilation_context context{};
+    context_scope scope(context);
+    try {
+        body();
+        return true;
+    } catch(int) {
+        return false;
+    }
+}
+
+// the tokens out of the preprocessor, each followed by a space, "error" if
+// it fails; `sources` receives the number of sources of the unit
+static inline std::string preprocess(const std::string &path, uint32_t *sources = nullptr) {
+    std::string result{};
+    auto done = in_context([&]() {
+        cpp pp(path.c_str());
+        for(auto tok = pp.get(); !tok->is(Eof); tok = pp.get())
+            result += std::string(tok->to_string()) + " ";
+        if(sources) *sources = source_count();
+    });
+    return done ? result : "error";
+}
+
+static inline void check(const std::string &name, const std::string &got, const std::string &expected) {
+    if(got == expected) return;
+    std::printf("%s: got \"%s\", expected \"%s\"\n", name.c_str(), got.c_str(), expected.c_str());
+    ++failures;
+}
+
+// the exit status of the test
+static inline int report() {
+    if(failures) {
+        std::printf("%d failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("all passed\n");
+    return EXIT_SUCCESS;
+}
+
+} // namespace compiler
+
+#endif // __COMPILER_TEST_UTIL__
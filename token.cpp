@@ -1,15 +1,30 @@
 #include "token.hpp"
 #include "lexer.hpp"
+#include "source.hpp"
+#include "context.hpp"
 #include "mempool.hpp"
+#include "interner.hpp"
 
-#include <unordered_set>
-#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
 
 using namespace compiler;
 
-static mempool<token> token_pool{};
+// the pool of the thread lexing ahead, nullptr for the compilation arena
+static thread_local arena *current_pool = nullptr;
 
-const file_pos* compiler::epos = nullptr;
+static_assert(sizeof(token) == 16, "token is expected to be packed in 16 bytes");
+
+// the quote of a literal, '\0' for other tokens
+static char quote_of(const token*);
+// where the text of a token begins in its source, given where it ends and
+// how much text precedes that; nullptr if it is not spelled there as it is
+static const char* spelled_from(const token*, const char *end, std::size_t before);
+// a literal spelled from its source as above, or from its value without it
+static std::string spell_literal(const token*, char quote, const char *end, std::size_t before);
+
+thread_local const token* compiler::epos = nullptr;
 
 static constexpr auto operator_mask  = 0xff000000U; // requires negated
 static constexpr auto keyword_mask   = 0x01000000U;
@@ -48,199 +63,373 @@ bool compiler::is_directive(uint32_t attr) {
     return attr & directive_mask;
 }
 
-uint32_t compiler::string_to_attr(const std::string &str) {
-    static const std::unordered_map<std::string,token_attr> str_attr {
-        {"auto", KeyAuto},
-        {"break", KeyBreak},
-        {"bool", KeyBool}, // C++ standard here
-        {"case", KeyCase},
-        {"char", KeyChar},
-        {"const", KeyConst},
-        {"continue", KeyContinue},
-        {"default", KeyDefault},
-        {"do", KeyDo},
-        {"double", KeyDouble},
-        {"else", Else},
-        {"enum", KeyEnum},
-        {"extern", KeyExtern},
-        {"false", KeyFalse}, // C++
-        {"float", KeyFloat},
-        {"for", KeyFor},
-        {"goto", KeyGoto},
-        {"if", If},
-        {"inline", KeyInline},
-        {"int", KeyInt},
-        {"long", KeyLong},
-        {"register", KeyRegister},
-        {"restrict", KeyRestrict},
-        {"return", KeyReturn},
-        {"short", KeyShort},
-        {"signed", KeySigned},
-        {"sizeof", KeySizeof},
-        {"static", KeyStatic},
-        {"struct", KeyStruct},
-        {"switch", KeySwitch},
-        {"typedef", KeyTypedef},
-        {"true", KeyTrue}, // C++
-        {"union", KeyUnion},
-        {"unsigned", KeyUnsigned},
-        {"void", KeyVoid},
-        {"volatile", KeyVolatile},
-        {"while", KeyWhile},
-        {"_Complex", KeyComplex},
-        {"_Imaginary", KeyImaginary},   
-        
-        {"__VA_ARGS__", KeyVAArgs},
-        
-        {"include", DirectInclude},
-        {"define", DirectDefine},
-        {"defined", DirectDefined},
-        {"ifdef", DirectIfdef},
-        {"ifndef", DirectIfndef},
-        {"elif", DirectElif},
-        {"endif", DirectEndif},
-        {"line", DirectLine},
-        {"error", DirectError},
-        {"pragma", DirectPragma},    
-    };
+/* Spellings of the tokens that have a fixed one, sorted by attribute so that
+ * attr_to_string is a binary search over a constant array. Keywords and
+ * directives are also found here by string_to_attr through a perfect hash.
+ */
+struct spelling {
+    uint32_t    attr;
+    const char *str;
+};
+
+static constexpr spelling spellings[] = {
+    {LogicalNot, "!"},
+    {Pound, "#"},
+    {Mod, "%"},
+    {Ampersand, "&"},
+    {LeftParen, "("},
+    {RightParen, ")"},
+    {Star, "*"},
+    {Add, "+"},
+    {Comma, ","},
+    {Sub, "-"},
+    {Dot, "."},
+    {Div, "/"},
+    {Colon, ":"},
+    {Semicolon, ";"},
+    {LessThan, "<"},
+    {Assign, "="},
+    {GreaterThan, ">"},
+    {Question, "?"},
+    {LeftSubscript, "["},
+    {Escape, "\\"},
+    {RightSubscript, "]"},
+    {BitXor, "^"},
+    {BlockOpen, "{"},
+    {BitOr, "|"},
+    {BlockClose, "}"},
+    {BitNot, "~"},
+    {NotEqual, "!="},
+    {StringConcat, "##"},
+    {ModAssign, "%="},
+    {LogicalAnd, "&&"},
+    {BitAndAssign, "&="},
+    {MulAssign, "*="},
+    {Inc, "++"},
+    {AddAssign, "+="},
+    {Dec, "--"},
+    {SubAssign, "-="},
+    {MemberPtr, "->"},
+    {DivAssign, "/="},
+    {LeftShift, "<<"},
+    {LessEqual, "<="},
+    {Equal, "=="},
+    {GreaterEqual, ">="},
+    {RightShift, ">>"},
+    {BitXorAssign, "^="},
+    {BitOrAssign, "|="},
+    {LogicalOr, "||"},
+    {Ellipsis, "..."},
+    {LeftShiftAssign, "<<="},
+    {RightShiftAssign, ">>="},
     
-    auto it = str_attr.find(str);
-    return it != str_attr.cend() ? 
-           it->second :
+    {KeyStatic, "static"},
+    {KeyAuto, "auto"},
+    {KeyRegister, "register"},
+    {KeyExtern, "extern"},
+    {KeyInline, "inline"},
+    {KeyTypedef, "typedef"},
+    {KeyVolatile, "volatile"},
+    {KeyConst, "const"},
+    {KeyRestrict, "restrict"},
+    {KeyBool, "bool"}, // C++ standard here
+    {KeyComplex, "_Complex"},
+    {KeyChar, "char"},
+    {KeyDouble, "double"},
+    {KeyEnum, "enum"},
+    {KeyFloat, "float"},
+    {KeyImaginary, "_Imaginary"},
+    {KeyInt, "int"},
+    {KeyLong, "long"},
+    {KeySigned, "signed"},
+    {KeyShort, "short"},
+    {KeyStruct, "struct"},
+    {KeyUnion, "union"},
+    {KeyUnsigned, "unsigned"},
+    {KeyVoid, "void"},
+    {KeyBreak, "break"},
+    {KeyCase, "case"},
+    {KeyContinue, "continue"},
+    {KeyDefault, "default"},
+    {KeyDo, "do"},
+    {KeyFor, "for"},
+    {KeyGoto, "goto"},
+    {KeyReturn, "return"},
+    {KeySwitch, "switch"},
+    {KeyWhile, "while"},
+    {KeySizeof, "sizeof"},
+    {KeyTrue, "true"}, // C++
+    {KeyFalse, "false"}, // C++
+    {KeyVAArgs, "__VA_ARGS__"},
+    
+    {DirectInclude, "include"},
+    {DirectDefine, "define"},
+    {DirectUndef, "undef"},
+    {DirectDefined, "defined"},
+    {DirectIfdef, "ifdef"},
+    {DirectIfndef, "ifndef"},
+    {DirectElif, "elif"},
+    {DirectEndif, "endif"},
+    {DirectLine, "line"},
+    {DirectError, "error"},
+    {DirectPragma, "pragma"},
+    
+    {Newline, "\n"},
+    {If, "if"},
+    {Else, "else"},
+};
+
+static constexpr std::size_t spelling_count = sizeof(spellings) / sizeof(*spellings);
+
+static constexpr bool is_sorted(std::size_t i) {
+    return i + 1 >= spelling_count ||
+           (spellings[i].attr < spellings[i + 1].attr && is_sorted(i + 1));
+}
+
+static_assert(is_sorted(0), "spellings must be sorted by attribute");
+
+// keywords and directives, as opposed to operators and new line
+static constexpr bool is_word(const char *str) {
+    return ('a' <= *str && *str <= 'z') || *str == '_';
+}
+
+static constexpr std::size_t length(const char *str) {
+    return *str ? 1 + length(str + 1) : 0;
+}
+
+// from "do" to "__VA_ARGS__"
+static constexpr std::size_t min_word = 2;
+static constexpr std::size_t max_word = 11;
+
+/* Collision-free over all words in spellings, checked below. Only the length
+ * and three characters are looked at, so an identifier costs a table lookup
+ * and at most one comparison.
+ */
+static constexpr unsigned word_hash(const char *str, std::size_t len) {
+    return (static_cast<unsigned char>(str[0]) +
+            11 * static_cast<unsigned char>(str[1]) +
+            11 * static_cast<unsigned char>(str[len - 1]) + 5 * len) & 0xff;
+}
+
+static constexpr uint8_t no_word = 0xff;
+
+static constexpr uint8_t find_word(unsigned hash, std::size_t i) {
+    return i == spelling_count ? no_word :
+           is_word(spellings[i].str) &&
+           word_hash(spellings[i].str, length(spellings[i].str)) == hash ? i :
+           find_word(hash, i + 1);
+}
+
+// index into spellings for each hash value
+static constexpr uint8_t word_slots[256] = {
+    #define SLOT4(n)   find_word(n, 0), find_word(n + 1, 0), find_word(n + 2, 0), find_word(n + 3, 0)
+    #define SLOT16(n)  SLOT4(n), SLOT4(n + 4), SLOT4(n + 8), SLOT4(n + 12)
+    #define SLOT64(n)  SLOT16(n), SLOT16(n + 16), SLOT16(n + 32), SLOT16(n + 48)
+    SLOT64(0), SLOT64(64), SLOT64(128), SLOT64(192),
+    #undef SLOT64
+    #undef SLOT16
+    #undef SLOT4
+};
+
+static constexpr bool is_perfect(std::size_t i) {
+    return i == spelling_count ||
+           ((!is_word(spellings[i].str) ||
+             (min_word <= length(spellings[i].str) && length(spellings[i].str) <= max_word &&
+              word_slots[word_hash(spellings[i].str, length(spellings[i].str))] == i)) &&
+            is_perfect(i + 1));
+}
+
+static_assert(spelling_count < no_word, "spellings must be indexed by uint8_t");
+static_assert(is_perfect(0), "word_hash collides, pick other coefficients");
+
+uint32_t compiler::string_to_attr(const char *str, std::size_t len) {
+    if(len < min_word || len > max_word)
+        return Error;
+    auto i = word_slots[word_hash(str, len)];
+    if(i == no_word)
+        return Error;
+    // the word is at least len long if strncmp matches
+    auto word = spellings[i].str;
+    return !std::strncmp(word, str, len) && word[len] == '\0' ?
+           spellings[i].attr :
            Error;
 }
 
+uint32_t compiler::string_to_attr(const std::string &str) {
+    return string_to_attr(str.data(), str.size());
+}
+
 const char* compiler::attr_to_string(uint32_t attr) {
-    static const std::unordered_map<uint32_t, std::string> attr_str {
-        {Newline, "\n"},
-        
-        {If, "if"},
-        {Else, "else"},
-        
-        {Pound, "#"},
-        {StringConcat, "##"},
-        {Escape, "\\"},
-        {Dot, "."},
-        {Star, "*"},
-        {Ampersand, "&"},
-        {Ellipsis, "..."},
-        {Semicolon, ";"},
-        {BlockOpen, "{"},
-        {BlockClose, "}"},
-        {LeftParen, "("},
-        {RightParen, ")"},
-        {LeftSubscript, "["},
-        {RightSubscript, "]"},
-        {Question, "?"},
-        {Colon, ":"},
-        {MemberPtr, "->"},
-        {Comma, ","},
-        {Add, "+"},
-        {Sub, "-"},
-        {Div, "/"},
-        {Mod, "%"},
-        {BitOr, "|"},
-        {BitXor, "^"},
-        {BitNot, "~"},
-        {LeftShift, "<<"},
-        {RightShift, ">>"},
-        {LessThan, "<"},
-        {LessEqual, "<="},
-        {GreaterThan, ">"},
-        {GreaterEqual, ">="},
-        {Equal, "=="},
-        {NotEqual, "!="},
-        {LogicalAnd, "&&"},
-        {LogicalOr, "||"},
-        {LogicalNot, "!"},
-        {Inc, "++"},
-        {Dec, "--"},
-        {Assign, "="},
-        {AddAssign, "+="},
-        {SubAssign, "-="},
-        {MulAssign, "*="},
-        {DivAssign, "="},
-        {ModAssign, "%="},
-        {BitAndAssign, "&="},
-        {BitOrAssign, "|="},
-        {BitXorAssign, "^="},
-        {LeftShiftAssign, "<<="},
-        {RightShiftAssign, ">>="},
-        
-        {KeyAuto, "auto"},
-        {KeyBreak, "break"},
-        {KeyCase, "case"},
-        {KeyChar, "char"},
-        {KeyConst, "const"},
-        {KeyContinue, "continue"},
-        {KeyDefault, "default"},
-        {KeyDo, "do"},
-        {KeyDouble, "double"},
-        //{KeyIf, "if"},
-        //{KeyElse, "else"},
-        {KeyTrue, "true"},
-        {KeyFalse, "false"},
-        {KeyEnum, "enum"},
-        {KeyExtern, "extern"},
-        {KeyFloat, "float"},
-        {KeyFor, "for"},
-        {KeyGoto, "goto"},
-        {KeyInline, "inline"},
-        {KeyInt, "int"},
-        {KeyLong, "long"},
-        {KeyRegister, "register"},
-        {KeyRestrict, "restrict"},
-        {KeyReturn, "return"},
-        {KeyShort, "short"},
-        {KeySigned, "signed"},
-        {KeySizeof, "sizeof"},
-        {KeyStatic, "static"},
-        {KeyStruct, "struct"},
-        {KeySwitch, "switch"},
-        {KeyTypedef, "typedef"},
-        {KeyUnion, "union"},
-        {KeyUnsigned, "unsigned"},
-        {KeyVoid, "void"},
-        {KeyVolatile, "volatile"},
-        {KeyWhile, "while"},
-        {KeyBool, "bool"},
-        {KeyComplex, "_Complex"},
-        {KeyImaginary, "_Imaginary"},   
-        
-        {KeyVAArgs, "__VA_ARGS__"},
-        
-        {DirectInclude, "include"},
-        {DirectDefine, "define"},
-        {DirectDefined, "defined"},
-        //{DirectIf, "if"},
-        //{DirectElse, "else"},
-        {DirectIfdef, "ifdef"},
-        {DirectIfndef, "ifndef"},
-        {DirectElif, "elif"},
-        {DirectEndif, "endif"},
-        {DirectLine, "line"},
-        {DirectError, "error"},
-        {DirectPragma, "pragma"},   
-    };
-    
-    auto it = attr_str.find(attr);
-    return it == attr_str.cend() ?
-           "" :
-           it->second.c_str();
+    auto first = spellings, last = spellings + spelling_count;
+    auto it = std::lower_bound(first, last, attr, [](const spelling &s, uint32_t a) {
+        return s.attr < a;
+    });
+    return it != last && it->attr == attr ?
+           it->str :
+           "";
+}
+
+// the table of the thread lexing ahead, nullptr for that of the context
+static thread_local string_table *current_strings = nullptr;
+
+static string_table& strings() {
+    return current_strings ? *current_strings : current_context().m_strings;
+}
+
+uint32_t compiler::intern_string(const std::string &str) {
+    return strings().intern(str.data(), str.size());
+}
+
+uint32_t compiler::intern_string(const char *str, std::size_t len, uint32_t hash) {
+    return strings().intern(str, len, hash);
 }
 
 const char* compiler::insert_string(const std::string &str) {
-    static std::unordered_set<std::string> set{};
-    return set.insert(str).first->c_str();
+    return strings().get(intern_string(str));
+}
+
+const char* compiler::string_of(uint32_t id) {
+    return strings().get(id);
+}
+
+std::size_t compiler::string_length(uint32_t id) {
+    return strings().length(id);
+}
+
+void compiler::use_token_pool(arena *pool) {
+    current_pool = pool;
+}
+
+void compiler::use_string_table(string_table *table) {
+    current_strings = table;
+}
+
+char quote_of(const token *tok) {
+    switch(tok->m_attr) {
+        case String: case WideString: return '"';
+        case Character: case WideCharacter: return '\'';
+        default: return '\0';
+    }
 }
 
-token::token(uint32_t attr, const file_pos &loc, const char *str):
-    m_attr(attr), m_pos(loc), m_str(str) {}
+const char* spelled_from(const token *tok, const char *end, std::size_t before) {
+    auto quote = quote_of(tok);
+    if(!quote) {
+        auto str = tok->to_string();
+        auto len = tok->m_str ? string_length(tok->m_str) : std::strlen(str);
+        return len <= before && !std::memcmp(end - len, str, len) ? end - len : nullptr;
+    }
+    
+    // a literal keeps its value, it is found by its quotes: the opening one is
+    // the first back from the end that is not escaped, on the same line
+    if(!before || end[-1] != quote) return nullptr;
+    auto first = end - before;
+    for(auto p = end - 2; p >= first; --p) {
+        if(*p == '\n' && (p == first || p[-1] != '\\')) return nullptr;
+        if(*p != quote) continue;
+        auto escapes = p;
+        while(escapes != first && escapes[-1] == '\\') --escapes;
+        if((p - escapes) % 2) continue;
+        // a prefix pasted to the literal is not in the source
+        return p != first && p[-1] == 'L' ? p - 1 : p;
+    }
+    return nullptr;
+}
+
+// its text is gone or it is not spelled in its source, assume there is
+bool compiler::space_before(const token *tok) {
+    std::size_t before = 0;
+    auto end = source_at(tok->m_file, tok->m_offset, before);
+    auto begin = end ? spelled_from(tok, end, before) : nullptr;
+    if(!begin) return true;
+    if(begin == end - before) return false;
+    switch(begin[-1]) {
+        case ' ': case '\t': case '\n': case '\v': case '\f': case '\r':
+            return true;
+        case '/':
+            return begin - 2 >= end - before && begin[-2] == '*';
+        default:
+            return false;
+    }
+}
+
+// its text is gone, assume there is
+bool compiler::space_after(const token *tok) {
+    std::size_t before = 0;
+    auto p = source_at(tok->m_file, tok->m_offset, before);
+    if(!p) return true;
+    switch(*p) {
+        case ' ': case '\t': case '\n': case '\v': case '\f': case '\r': case '\\':
+            return true;
+        case '/':
+            return p[1] == '/' || p[1] == '*';
+        default:
+            return false;
+    }
+}
+
+std::string compiler::spelling_of(const token *tok) {
+    auto quote = quote_of(tok);
+    if(!quote) return tok->to_string();
+    std::size_t before = 0;
+    auto end = source_at(tok->m_file, tok->m_offset, before);
+    return spell_literal(tok, quote, end, before);
+}
+
+std::string compiler::spelling_of(const token *tok, const char *text) {
+    auto quote = quote_of(tok);
+    if(!quote) return tok->to_string();
+    return spell_literal(tok, quote, text ? text + tok->m_offset : nullptr, tok->m_offset);
+}
+
+std::string spell_literal(const token *tok, char quote, const char *end, std::size_t before) {
+    auto attr = tok->m_attr;
+    auto wide = attr == WideString || attr == WideCharacter;
+    if(auto begin = end ? spelled_from(tok, end, before) : nullptr) {
+        // as it is written, without line splices
+        std::string result = wide && *begin != 'L' ? "L" : "";
+        for(auto p = begin; p != end; ++p) {
+            if(*p == '\\' && p[1] == '\n') ++p;
+            else result += *p;
+        }
+        return result;
+    }
+    
+    // no source, the value is escaped again; that of a wide literal is UTF-8
+    std::string result = wide ? "L" : "";
+    result += quote;
+    auto str = tok->to_string();
+    auto len = tok->m_str ? string_length(tok->m_str) : std::strlen(str);
+    for(auto p = str; p != str + len; ++p) {
+        auto ch = static_cast<unsigned char>(*p);
+        if(ch == quote || ch == '\\') {
+            result += '\\';
+            result += ch;
+        } else if(ch == '\n')
+            result += "\\n";
+        else if(ch == '\t')
+            result += "\\t";
+        else if(ch < 0x20 || ch == 0x7f || (ch > 0x7f && !wide)) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\%03o", ch);
+            result += buf;
+        } else
+            result += ch;
+    }
+    result += quote;
+    return result;
+}
+
+file_pos token::position() const {
+    return locate(m_file, m_offset);
+}
 
-token* compiler::make_token(uint32_t attr, const file_pos &pos) {
-    return new (token_pool.malloc()) token(attr, pos, attr_to_string(attr));
+token* compiler::make_token(uint32_t attr, uint32_t file, uint32_t offset, uint32_t str) {
+    auto &&pool = current_pool ? *current_pool : compilation_arena();
+    return pool.make<token>(attr, file, offset, str);
 }
 
-token* compiler::make_token(uint32_t attr, const file_pos &pos, std::string &s) {
-    return new (token_pool.malloc()) token(attr, pos, insert_string(s));
+token* compiler::make_token(uint32_t attr, uint32_t file, uint32_t offset, std::string &s) {
+    auto &&pool = current_pool ? *current_pool : compilation_arena();
+    return pool.make<token>(attr, file, offset, intern_string(s));
 }
@@ -2,8 +2,8 @@
 #define __COMPILER_TOKEN__
 
 #include "error.hpp" // file_pos
+#include "token_list.hpp"
 
-#include <list>
 #include <string>
 #include <cstdint>
 
@@ -163,31 +163,69 @@ bool is_type_qualifier(uint32_t);
 bool is_directive(uint32_t);
 
 uint32_t    string_to_attr(const std::string&);
+uint32_t    string_to_attr(const char*, std::size_t); // Error if not a keyword or directive
 const char* attr_to_string(uint32_t);
 
 // insert a string to global string table
 const char* insert_string(const std::string&);
+// same as above, returns the id of the string instead, id 0 is reserved
+uint32_t    intern_string(const std::string&);
+// hash is computed by the caller, see interner.hpp
+uint32_t    intern_string(const char*, std::size_t, uint32_t hash);
+// get a string from global string table
+const char* string_of(uint32_t id);
+// length of the string, it may contain '\0'
+std::size_t string_length(uint32_t id);
 
+class arena;
+class string_table;
+
+// The token pool and the string table are not locked, a thread other than
+// the main one switches to its own before making tokens.
+// tokens made by the calling thread come from `pool`, nullptr for the arena
+// of its compilation_context again; see compilation_context::thread_pool()
+void use_token_pool(arena *pool);
+// strings interned by the calling thread go to `table`, nullptr for the
+// table of its compilation_context again; ids in `table` mean nothing to
+// other threads
+void use_string_table(string_table *table);
+
+// A token is kept in 16 bytes. Its position is stored as a byte offset into
+// its source (see source.hpp), line and column are only computed by
+// `position()` when a message has to be printed.
 struct token {
-    uint32_t    m_attr;
-    file_pos    m_pos;
-    const char *m_str;  // source text
+    uint32_t m_attr;
+    uint32_t m_str;    // id of source text, 0 if it is just the spelling of `m_attr`
+    uint32_t m_offset; // where the token ends in its source
+    uint32_t m_file;   // source id
     
-    token(uint32_t, const file_pos&, const char* = nullptr);
+    token(uint32_t attr, uint32_t file, uint32_t offset, uint32_t str = 0)
+        :m_attr(attr), m_str(str), m_offset(offset), m_file(file) {}
     
-    const char* to_string() const {return m_str;}
+    const char* to_string() const {return m_str ? string_of(m_str) : attr_to_string(m_attr);}
     bool is(uint32_t a) const {return m_attr == a;}
+    
+    file_pos position() const;
 };
 
-token* make_token(uint32_t, const file_pos&); // used for delimiters
-token* make_token(uint32_t, const file_pos&, std::string&); // used for identifiers, keywords, constants
+token* make_token(uint32_t, uint32_t file, uint32_t offset, uint32_t str = 0); // used for delimiters and interned text
+token* make_token(uint32_t, uint32_t file, uint32_t offset, std::string&); // used for identifiers, keywords, constants
 
-typedef std::list<token*>   token_list;
+// the token as it is written in source; a literal is taken from its source
+// as it is, with its escapes, or has its value escaped again if it has none
+std::string spelling_of(const token*);
+// the same with the text of the token's file at hand, nullptr if it has no
+// source; the source table is not looked into, so not for a stream
+std::string spelling_of(const token*, const char *text);
+// if white space or a comment precedes or follows the token in its source;
+// also true if its text is gone, a stream keeps only its window
+bool space_before(const token*);
+bool space_after(const token*);
 
-// global token pointer used as error message locator
-extern const file_pos *epos;
+// token pointer used as error message locator, one per thread
+extern thread_local const token *epos;
 
-inline void mark_pos(const token *tok) {epos = &tok->m_pos;}
+inline void mark_pos(const token *tok) {epos = tok;}
 
 } // namespace compiler 
 #endif // __COMPILER_TOKEN__
@@ -0,0 +1,248 @@
+#include "token_cache.hpp"
+#include "interner.hpp"
+#include "source.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace compiler;
+
+namespace {
+
+/* Layout of an entry, in native byte order:
+ *     header
+ *     record[tokens]
+ *     uint32_t length[strings]  lengths of the strings
+ *     char text[]               the strings back to back, without '\0'
+ *     char path[path_len]       the real path of the file
+ * String 0 is "no string", a record refers to string i by i.
+ */
+struct header {
+    char     magic[4];
+    uint32_t version;
+    uint64_t mtime;    // of the file, in nanoseconds
+    uint64_t size;     // of the file
+    uint64_t hash;     // of the text, see hash_text
+    uint32_t tokens;
+    uint32_t strings;
+    uint32_t text;     // bytes of all strings
+    uint32_t path_len;
+};
+
+struct record {
+    uint32_t attr;
+    uint32_t str;
+    uint32_t offset;
+};
+
+} // anonymous namespace
+
+static constexpr char     cache_magic[4] = {'C', 'T', 'O', 'K'};
+// bump it whenever token_attr, the layout or what the lexer produces changes
+static constexpr uint32_t cache_version = 2;
+
+static std::string initial_dir();
+static uint64_t    hash_text(const char*, std::size_t);
+static std::string real_path(const char*);
+static std::string entry_path(const std::string&);
+static uint64_t    modified(const struct stat&);
+
+static std::string cache_dir = initial_dir();
+
+static std::string initial_dir() {
+    auto dir = std::getenv("CC_TOKEN_CACHE");
+    if(!dir || !*dir) return {};
+    ::mkdir(dir, 0755);
+    return dir;
+}
+
+// not cryptographic, it only tells a changed file from the one cached
+static uint64_t hash_text(const char *text, std::size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    std::size_t i = 0;
+    for(; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, text + i, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
+        hash ^= hash >> 32;
+    }
+    for(; i < size; ++i)
+        hash = (hash ^ static_cast<unsigned char>(text[i])) * 1099511628211ULL;
+    return hash ^ size;
+}
+
+static std::string real_path(const char *location) {
+    std::string result{};
+    if(auto path = ::realpath(location, nullptr)) {
+        result = path;
+        std::free(path);
+    } else
+        result = location;
+    return result;
+}
+
+static std::string entry_path(const std::string &key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.tok",
+                  static_cast<unsigned long long>(hash_text(key.data(), key.size())));
+    return cache_dir + name;
+}
+
+static uint64_t modified(const struct stat &st) {
+    return st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+}
+
+void compiler::set_token_cache(const std::string &dir) {
+    if(!dir.empty())
+        ::mkdir(dir.c_str(), 0755);
+    cache_dir = dir;
+}
+
+bool compiler::token_cache_enabled() {
+    return !cache_dir.empty();
+}
+
+bool compiler::load_tokens(const char *location, std::vector<token*> &tokens) {
+    if(cache_dir.empty()) return false;
+    
+    struct stat st;
+    if(::stat(location, &st) || !S_ISREG(st.st_mode)) return false;
+    auto key = real_path(location);
+    int fd = ::open(entry_path(key).c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    
+    struct stat cache_st;
+    void *mapped = MAP_FAILED;
+    std::size_t length = 0;
+    if(!::fstat(fd, &cache_st) && cache_st.st_size >= static_cast<off_t>(sizeof(header))) {
+        length = cache_st.st_size;
+        mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if(mapped == MAP_FAILED) return false;
+    
+    auto data = static_cast<const char*>(mapped);
+    header head;
+    std::memcpy(&head, data, sizeof(head));
+    
+    auto records = reinterpret_cast<const record*>(data + sizeof(head));
+    auto lengths = reinterpret_cast<const uint32_t*>(records + head.tokens);
+    auto text = reinterpret_cast<const char*>(lengths + head.strings);
+    auto path = text + head.text;
+    // cheap checks first, the content is hashed only if everything else matches
+    bool valid = !std::memcmp(head.magic, cache_magic, sizeof(cache_magic)) &&
+                 head.version == cache_version &&
+                 head.mtime == modified(st) &&
+                 head.size == static_cast<uint64_t>(st.st_size) &&
+                 head.tokens &&
+                 sizeof(head) + head.tokens * sizeof(record) + head.strings * sizeof(uint32_t) +
+                     std::size_t(head.text) + head.path_len == length &&
+                 key.size() == head.path_len && !std::memcmp(path, key.data(), key.size());
+    
+    uint32_t file = 0;
+    if(valid) {
+        file = open_source(location);
+        valid = source_size(file) == head.size &&
+                hash_text(source_text(file), head.size) == head.hash;
+    }
+    
+    if(valid) {
+        std::vector<uint32_t> ids(head.strings + 1, 0);
+        auto str = text;
+        for(uint32_t i = 0; valid && i < head.strings; str += lengths[i++]) {
+            valid = str + lengths[i] <= path;
+            if(valid)
+                ids[i + 1] = intern_string(str, lengths[i], hash_bytes(hash_seed, str, lengths[i]));
+        }
+        
+        valid = valid && records[head.tokens - 1].attr == Eof;
+        tokens.clear();
+        tokens.reserve(head.tokens);
+        for(uint32_t i = 0; valid && i < head.tokens; ++i) {
+            auto &&rec = records[i];
+            valid = rec.str <= head.strings;
+            if(valid)
+                tokens.push_back(make_token(rec.attr, file, rec.offset, ids[rec.str]));
+        }
+        if(!valid) tokens.clear();
+    }
+    
+    ::munmap(mapped, length);
+    return valid;
+}
+
+template <class T> static void append(std::string &out, const T &value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void compiler::store_tokens(const char *location, const std::vector<token*> &tokens) {
+    if(cache_dir.empty() || tokens.empty() || !tokens.back()->is(Eof)) return;
+    
+    struct stat st;
+    if(::stat(location, &st) || !S_ISREG(st.st_mode)) return;
+    auto file = tokens.front()->m_file;
+    if(source_size(file) != static_cast<std::size_t>(st.st_size)) return;
+    
+    // interned ids of this run become indices into the strings of the entry
+    std::unordered_map<uint32_t, uint32_t> index{};
+    std::vector<uint32_t> strings{};
+    std::string body{};
+    body.reserve(tokens.size() * sizeof(record));
+    for(auto tok: tokens) {
+        if(tok->m_file != file) return;
+        record rec = {tok->m_attr, 0, tok->m_offset};
+        if(tok->m_str) {
+            auto it = index.emplace(tok->m_str, strings.size() + 1).first;
+            if(it->second == strings.size() + 1)
+                strings.push_back(tok->m_str);
+            rec.str = it->second;
+        }
+        append(body, rec);
+    }
+    
+    std::string text{};
+    for(auto id: strings) {
+        append(body, static_cast<uint32_t>(string_length(id)));
+        text.append(string_of(id), string_length(id));
+    }
+    
+    auto key = real_path(location);
+    header head = {
+        {cache_magic[0], cache_magic[1], cache_magic[2], cache_magic[3]},
+        cache_version, modified(st), static_cast<uint64_t>(st.st_size),
+        hash_text(source_text(file), source_size(file)),
+        static_cast<uint32_t>(tokens.size()), static_cast<uint32_t>(strings.size()),
+        static_cast<uint32_t>(text.size()), static_cast<uint32_t>(key.size())
+    };
+    
+    std::string out{};
+    out.reserve(sizeof(head) + body.size() + text.size() + key.size());
+    append(out, head);
+    out += body;
+    out += text;
+    out += key;
+    
+    // readers see either the old entry or the complete new one
+    auto path = entry_path(key);
+    // a name of its own for each writer, threads of one process store the same file too
+    auto temp = path + ".XXXXXX";
+    int fd = ::mkstemp(&temp[0]);
+    if(fd < 0) return;
+    ::fchmod(fd, 0644);
+    std::size_t written = 0;
+    while(written < out.size()) {
+        auto n = ::write(fd, out.data() + written, out.size() - written);
+        if(n <= 0) break;
+        written += n;
+    }
+    ::close(fd);
+    if(written != out.size() || ::rename(temp.c_str(), path.c_str()))
+        ::unlink(temp.c_str());
+}
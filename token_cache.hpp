@@ -0,0 +1,43 @@
+#ifndef __COMPILER_TOKEN_CACHE__
+#define __COMPILER_TOKEN_CACHE__
+
+#include "token.hpp"
+
+#include <string>
+#include <vector>
+
+namespace compiler {
+
+/* Tokens of a file are saved to a cache directory the first time it is lexed,
+ * later runs map the saved stream instead of lexing the file again.
+ *
+ * An entry is keyed by the real path of the file and checked against its
+ * modification time, size and a hash of its content; anything that does not
+ * match is a miss and gets overwritten. Entries are written to a temporary
+ * file and renamed, so concurrent runs sharing a directory never see a
+ * partial one. Failing to write is not an error, the cache is only skipped.
+ */
+
+// directory of the cache, created if missing; empty disables the cache.
+// Defaults to $CC_TOKEN_CACHE, disabled if it is not set.
+void set_token_cache(const std::string &dir);
+bool token_cache_enabled();
+
+/**
+ * @brief load the tokens of a file from the cache
+ * @param location location of a regular file
+ * @param tokens receives every token of the file, the last one is Eof
+ * @return false if the cache has no valid entry for the file
+ */
+bool load_tokens(const char *location, std::vector<token*> &tokens);
+
+/**
+ * @brief save the tokens of a file to the cache
+ * @param location location of a regular file
+ * @param tokens every token of the file, ending with Eof
+ */
+void store_tokens(const char *location, const std::vector<token*> &tokens);
+
+} // namespace compiler
+
+#endif // __COMPILER_TOKEN_CACHE__
@@ -0,0 +1,110 @@
+#ifndef __COMPILER_TOKEN_LIST__
+#define __COMPILER_TOKEN_LIST__
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace compiler {
+
+struct token;
+
+// A queue of tokens stored in a contiguous ring buffer.
+// push_front, push_back and pop_front are O(1) and only allocate when the
+// buffer is full, which happens a handful of times for a lookahead buffer.
+class token_list {
+    private:
+        token  **m_data;
+        uint32_t m_head; // index of the front element
+        uint32_t m_size;
+        uint32_t m_cap;  // always 0 or a power of two
+    private:
+        token*& slot(uint32_t i) const {return m_data[(m_head + i) & (m_cap - 1)];}
+        
+        void grow() {
+            auto cap = m_cap ? m_cap << 1 : 16;
+            auto data = new token*[cap];
+            for(uint32_t i = 0; i < m_size; ++i)
+                data[i] = slot(i);
+            delete[] m_data;
+            m_data = data;
+            m_head = 0;
+            m_cap = cap;
+        }
+    public:
+        template <class T> class basic_iterator {
+            friend class token_list;
+            private:
+                const token_list *m_list;
+                uint32_t m_index;
+                
+                basic_iterator(const token_list *l, uint32_t i)
+                    :m_list(l), m_index(i) {}
+            public:
+                T& operator*() const {return m_list->slot(m_index);}
+                basic_iterator& operator++() {++m_index; return *this;}
+                basic_iterator operator++(int) {auto save = *this; ++m_index; return save;}
+                bool operator==(const basic_iterator &o) const {return m_index == o.m_index;}
+                bool operator!=(const basic_iterator &o) const {return m_index != o.m_index;}
+        };
+        typedef basic_iterator<token*>       iterator;
+        typedef basic_iterator<token* const> const_iterator;
+    public:
+        token_list()
+            :m_data(nullptr), m_head(0), m_size(0), m_cap(0) {}
+        
+        token_list(const token_list &o)
+            :m_data(nullptr), m_head(0), m_size(0), m_cap(0) {
+            for(auto &&tok: o) push_back(tok);
+        }
+        
+        token_list(token_list &&o)
+            :m_data(o.m_data), m_head(o.m_head), m_size(o.m_size), m_cap(o.m_cap) {
+            o.m_data = nullptr;
+            o.m_head = o.m_size = o.m_cap = 0;
+        }
+        
+        token_list& operator=(token_list o) {
+            std::swap(m_data, o.m_data);
+            std::swap(m_head, o.m_head);
+            std::swap(m_size, o.m_size);
+            std::swap(m_cap, o.m_cap);
+            return *this;
+        }
+        
+        ~token_list() {delete[] m_data;}
+        
+        bool        empty() const {return !m_size;}
+        std::size_t size() const {return m_size;}
+        
+        token* front() const {return slot(0);}
+        token* back() const {return slot(m_size - 1);}
+        
+        void push_front(token *tok) {
+            if(m_size == m_cap) grow();
+            m_head = (m_head - 1) & (m_cap - 1);
+            m_data[m_head] = tok;
+            ++m_size;
+        }
+        
+        void push_back(token *tok) {
+            if(m_size == m_cap) grow();
+            slot(m_size++) = tok;
+        }
+        
+        void pop_front() {
+            m_head = (m_head + 1) & (m_cap - 1);
+            --m_size;
+        }
+        
+        void clear() {m_head = m_size = 0;}
+        
+        iterator begin() {return {this, 0};}
+        iterator end() {return {this, m_size};}
+        const_iterator begin() const {return {this, 0};}
+        const_iterator end() const {return {this, m_size};}
+};
+
+} // namespace compiler
+
+#endif // __COMPILER_TOKEN_LIST__
@@ -0,0 +1,249 @@
+#include "token_printer.hpp"
+#include "source.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include <unistd.h>
+
+using namespace compiler;
+
+static constexpr unsigned int max_blank_lines = 8;
+
+// if two tokens printed next to each other would be read as one
+static bool would_paste(const token*, char, char);
+// string and character literals are printed as they are spelled
+static bool quoted(const token*);
+
+token_printer::token_printer(int fd)
+    :m_fd(fd), m_buffer(new char[buffer_size]), m_used(0), m_failed(false), m_file(0), m_text(nullptr), m_offset(0),
+     m_line(1), m_line_begin(0), m_left(), m_other_file(0),
+     m_other_text(nullptr), m_last(nullptr), m_last_origin(nullptr), m_last_char('\0') {}
+
+token_printer::~token_printer() {
+    if(m_last) put('\n');
+    drain();
+}
+
+void token_printer::write(const char *str, std::size_t len) {
+    while(len) {
+        if(m_used == buffer_size) drain();
+        auto n = std::min(len, buffer_size - m_used);
+        std::memcpy(m_buffer.get() + m_used, str, n);
+        m_used += n;
+        str += n;
+        len -= n;
+    }
+}
+
+bool token_printer::drain() {
+    std::size_t written = 0;
+    while(!m_failed && written < m_used) {
+        auto n = ::write(m_fd, m_buffer.get() + written, m_used - written);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) m_failed = true;
+        else written += n;
+    }
+    m_used = 0;
+    return !m_failed;
+}
+
+void token_printer::flush() {
+    if(m_last) put('\n');
+    m_last = nullptr;
+    if(!drain())
+        error("Cannot write the output: %s\n", std::strerror(errno));
+}
+
+// switches the output to another file, where it was left if it was before
+void token_printer::enter(uint32_t file) {
+    if(m_file) {
+        if(m_left.size() <= m_file) m_left.resize(m_file + 1);
+        m_left[m_file] = {m_offset, m_line};
+    }
+    
+    m_file = file;
+    m_text = source_text(file);
+    m_offset = 0;
+    m_line = 1;
+    m_line_begin = 0;
+    if(file < m_left.size() && m_left[file].second) {
+        m_offset = m_left[file].first;
+        m_line = m_left[file].second;
+        // the beginning of the line is found again on the next move
+        if(m_text) {
+            auto begin = m_text + m_offset;
+            while(begin != m_text && begin[-1] != '\n') --begin;
+            m_line_begin = begin - m_text;
+        }
+    }
+}
+
+void token_printer::move_to(uint32_t offset) {
+    if(!m_text || offset < m_offset) {
+        // a stream, whose text is gone; or back in the file, which a token from
+        // the source never is
+        auto pos = locate(m_file, offset);
+        // a line before the window of a stream is not known
+        if(pos.m_line) m_line = pos.m_line;
+        m_offset = offset;
+        m_line_begin = pos.m_line ? offset - (pos.m_column - 1) : offset;
+        return;
+    }
+    auto p = m_text + m_offset, end = m_text + offset;
+    while((p = static_cast<const char*>(std::memchr(p, '\n', end - p)))) {
+        ++m_line;
+        m_line_begin = ++p - m_text;
+    }
+    m_offset = offset;
+}
+
+void token_printer::marker() {
+    auto name = source_name(m_file);
+    if(!name) return;
+    char line[32];
+    auto len = std::snprintf(line, sizeof(line), "# %u \"", m_line);
+    write(line, len);
+    for(; *name; ++name) {
+        if(*name == '"' || *name == '\\') put('\\');
+        put(*name);
+    }
+    put('"');
+    put('\n');
+}
+
+void token_printer::print(const token *tok, const token *origin) {
+    auto file = origin ? origin->m_file : 0;
+    if(file && file != m_file) {
+        enter(file);
+        move_to(origin->m_offset);
+        if(m_last) put('\n');
+        marker();
+        m_last = nullptr;
+    } else if(file) {
+        auto line = m_line;
+        auto back = origin->m_offset < m_offset;
+        move_to(origin->m_offset);
+        if(!back && m_line > line && m_line - line <= max_blank_lines) {
+            for(auto n = m_line - line; n; --n)
+                put('\n');
+            m_last = nullptr;
+        } else if(back || m_line != line) {
+            // far ahead, or back when a file is included again
+            if(m_last) put('\n');
+            marker();
+            m_last = nullptr;
+        }
+    }
+    
+    const char *str;
+    std::size_t len;
+    std::string literal{};
+    if(quoted(tok)) {
+        literal = spelling(tok);
+        str = literal.data();
+        len = literal.size();
+    } else {
+        str = tok->to_string();
+        len = tok->m_str ? string_length(tok->m_str) : std::strlen(str);
+    }
+    if(!len) return;
+    
+    if(!m_last) {
+        // the indentation of the source line, of a stream if it is still in the window
+        std::size_t before = 0;
+        auto line = !file || file != m_file ? nullptr :
+                    m_text ? m_text + m_line_begin : source_at(m_file, m_line_begin, before);
+        for(auto p = line; p && (*p == ' ' || *p == '\t'); ++p)
+            put(*p);
+    } else {
+        // what precedes the token in the source or in the macro body, and
+        // what precedes the macro name for the first token of an expansion
+        auto space = origin != tok && origin != m_last_origin ?
+                     space_before(origin, nullptr, 0) :
+                     space_before(tok, str, len);
+        if(space || would_paste(m_last, m_last_char, str[0])) put(' ');
+    }
+    write(str, len);
+    m_last = tok;
+    m_last_origin = origin;
+    m_last_char = str[len - 1];
+}
+
+// white space or a comment before a token, false if it is not spelled in its
+// source as it is printed; without `str` the token is spelled as print() does.
+// The text of a stream is only there while it is in the window
+bool token_printer::space_before(const token *tok, const char *str, std::size_t len) {
+    std::string literal{};
+    if(!str && quoted(tok)) {
+        literal = spelling(tok);
+        str = literal.data();
+        len = literal.size();
+    } else if(!str) {
+        str = tok->to_string();
+        len = tok->m_str ? string_length(tok->m_str) : std::strlen(str);
+    }
+    auto text = text_of(tok->m_file);
+    // a token of no file has no text, assume there is
+    if(!text) return !tok->m_file || compiler::space_before(tok);
+    if(tok->m_offset <= len) return false;
+    auto begin = text + tok->m_offset - len;
+    if(std::memcmp(begin, str, len)) return false;
+    switch(begin[-1]) {
+        case ' ': case '\t': case '\n': case '\v': case '\f': case '\r':
+            return true;
+        case '/':
+            return begin - text >= 2 && begin[-2] == '*';
+        default:
+            return false;
+    }
+}
+
+const char* token_printer::text_of(uint32_t file) {
+    if(file == m_file) return m_text;
+    if(file != m_other_file) {
+        m_other_file = file;
+        m_other_text = file ? source_text(file) : nullptr;
+    }
+    return m_other_text;
+}
+
+std::string token_printer::spelling(const token *tok) {
+    auto text = text_of(tok->m_file);
+    // only the source table knows what is in the window of a stream
+    return text || !tok->m_file ? spelling_of(tok, text) : spelling_of(tok);
+}
+
+bool quoted(const token *tok) {
+    return tok->is(String) || tok->is(WideString) || tok->is(Character) || tok->is(WideCharacter);
+}
+
+bool would_paste(const token *lhs, char last, char first) {
+    auto word = [](char ch) {
+        return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
+    };
+    // pp-numbers take in dots, and signs after an exponent
+    if(lhs->is(PPNumber) || lhs->is(PPFloat)) {
+        if(first == '.') return true;
+        if((first == '+' || first == '-') &&
+           (last == 'e' || last == 'E' || last == 'p' || last == 'P'))
+            return true;
+    }
+    if(word(last)) return word(first) || first == '"' || first == '\'';
+    switch(last) {
+        case '+': return first == '+' || first == '=';
+        case '-': return first == '-' || first == '=' || first == '>';
+        case '&': return first == '&' || first == '=';
+        case '|': return first == '|' || first == '=';
+        case '<': return first == '<' || first == '=' || first == ':' || first == '%';
+        case '>': return first == '>' || first == '=';
+        case '%': return first == '=' || first == '>' || first == ':';
+        case '/': return first == '/' || first == '*' || first == '=';
+        case '*': case '!': case '^': case '=': return first == '=';
+        case ':': return first == '>';
+        case '#': return first == '#';
+        case '.': return first == '.' || (first >= '0' && first <= '9');
+        default:  return false;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef __COMPILER_TOKEN_PRINTER__
+#define __COMPILER_TOKEN_PRINTER__
+
+#include "token.hpp"
+
+#include "concepts/non_copyable.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace compiler {
+
+/* Text of preprocessed tokens, the output of -E.
+ *
+ * A token is printed on the line it comes from, the tokens of an expansion on
+ * the line of the macro name. Lines are kept as they are in the source, a
+ * line begins with the indentation of its source line; as GCC does, more than
+ * 8 lines without tokens are replaced by a line marker `# line "file"`. A
+ * marker is also printed where the file changes. Files are only known by the
+ * tokens printed from them, so markers have no GCC flags for entering and
+ * leaving an include.
+ * A space is printed where the source has white space between the two
+ * tokens, and wherever two tokens would otherwise read as one. A stream keeps
+ * its text in a window only, a space is printed before a token that has left
+ * it. Literals are printed as they are written in the source.
+ *
+ * Text is collected in a buffer of its own and written to a file descriptor
+ * when it is full, without going through stdio.
+ */
+class token_printer: public non_copyable {
+    private:
+        int m_fd;
+        std::unique_ptr<char[]> m_buffer;
+        std::size_t m_used;
+        bool m_failed; // writing has failed, nothing is written any more
+        // position of the output in the source
+        uint32_t     m_file;
+        const char  *m_text;   // of m_file, nullptr for a stream
+        uint32_t     m_offset; // where lines have been counted up to
+        unsigned int m_line;
+        uint32_t     m_line_begin; // offset of the beginning of m_line
+        // where m_offset and m_line were when a file was left, by source id
+        std::vector<std::pair<uint32_t, unsigned int>> m_left;
+        // text of the file of the last token not from m_file, macro bodies
+        // are often in another one
+        uint32_t     m_other_file;
+        const char  *m_other_text;
+        const token *m_last; // printed last on the line, nullptr if none
+        const token *m_last_origin;
+        char         m_last_char;
+    private:
+        void put(char ch) {
+            if(m_used == buffer_size) drain();
+            m_buffer[m_used++] = ch;
+        }
+        void write(const char*, std::size_t);
+        // false if writing fails
+        bool drain();
+        
+        void enter(uint32_t file);
+        // moves the output to the line of `offset` in the current file
+        void move_to(uint32_t offset);
+        void marker();
+        bool space_before(const token*, const char*, std::size_t);
+        // text of the file of a token, nullptr for a stream and for no file;
+        // the source table is looked into only when the file changes
+        const char* text_of(uint32_t file);
+        // a literal as spelling_of() spells it, from the text at hand
+        std::string spelling(const token*);
+    public:
+        static constexpr std::size_t buffer_size = 1 << 20;
+        
+        explicit token_printer(int fd);
+        // what is left is written, errors are ignored
+        ~token_printer();
+        
+        /**
+         * @brief print a token
+         * @param tok the token
+         * @param origin where it comes from, see cpp::origin()
+         */
+        void print(const token *tok, const token *origin);
+        
+        // ends the last line and writes the buffer
+        void flush();
+};
+
+} // namespace compiler
+
+#endif // __COMPILER_TOKEN_PRINTER__
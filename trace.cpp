@@ -0,0 +1,88 @@
+#include "trace.hpp"
+#include "source.hpp"
+#include "context.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace compiler;
+
+namespace {
+
+struct trace_record {
+    uint32_t m_attr;
+    uint32_t m_str;
+    uint32_t m_file;
+    uint32_t m_offset; // where the token ends
+    uint32_t m_context; // id of the context the ids above belong to
+    trace_event m_event;
+};
+
+} // anonymous namespace
+
+static_assert((trace_capacity & (trace_capacity - 1)) == 0, "trace_capacity is a power of 2");
+
+static bool initial_trace();
+
+std::atomic<bool> compiler::trace_enabled{initial_trace()};
+
+static trace_record records[trace_capacity];
+// events recorded so far, the next one goes to records[recorded % trace_capacity]
+static std::atomic<uint64_t> recorded{0};
+
+bool initial_trace() {
+    auto trace = std::getenv("CC_TRACE");
+    return trace && std::strcmp(trace, "0");
+}
+
+void compiler::set_trace(bool enabled) {
+    trace_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void compiler::record_trace(trace_event event, const token *tok) {
+    auto &&r = records[recorded.fetch_add(1, std::memory_order_relaxed) & (trace_capacity - 1)];
+    r.m_event = event;
+    r.m_context = current_context().m_id;
+    if(tok) {
+        r.m_attr = tok->m_attr;
+        r.m_str = tok->m_str;
+        r.m_file = tok->m_file;
+        r.m_offset = tok->m_offset;
+    } else {
+        // nothing left to read
+        r.m_attr = Eof;
+        r.m_str = r.m_file = r.m_offset = 0;
+    }
+}
+
+void compiler::dump_trace(std::FILE *out) {
+    static const char *names[] = {"get", "peek", "unget", "expect", "test"};
+    
+    auto end = recorded.load(std::memory_order_acquire);
+    if(!end) return;
+    auto begin = end > trace_capacity ? end - trace_capacity : 0;
+    // strings and sources of other units are not in this context, or gone
+    auto context = current_context().m_id;
+    uint64_t count = 0;
+    for(auto i = begin; i != end; ++i)
+        count += records[i & (trace_capacity - 1)].m_context == context;
+    if(!count) return;
+    std::fprintf(out, "Trace of the last %llu events of this unit, of %llu:\n",
+                 static_cast<unsigned long long>(count), static_cast<unsigned long long>(end));
+    for(auto i = begin; i != end; ++i) {
+        auto &&r = records[i & (trace_capacity - 1)];
+        if(r.m_context != context) continue;
+        std::fprintf(out, "%-6s ", names[r.m_event]);
+        if(r.m_str)
+            std::fprintf(out, "\"%s\"", string_of(r.m_str));
+        else
+            std::fputs(r.m_attr == Eof ? "end of file" : attr_to_string(r.m_attr), out);
+        auto name = r.m_file ? source_name(r.m_file) : nullptr;
+        if(name) {
+            auto pos = locate(r.m_file, r.m_offset);
+            std::fprintf(out, " %s:%u:%u", name, pos.m_line, pos.m_column);
+        }
+        std::fputc('\n', out);
+    }
+    std::fflush(out);
+}
@@ -0,0 +1,54 @@
+#ifndef __COMPILER_TRACE__
+#define __COMPILER_TRACE__
+
+#include "token.hpp"
+
+#include <atomic>
+#include <cstdio>
+
+namespace compiler {
+
+/* What the parser asks of the preprocessor, kept in memory for debugging.
+ *
+ * Every get, peek, unget, expect and test of cpp is recorded as an event with
+ * the attribute, string and position of the token, in a ring of the last
+ * trace_capacity events. Recording takes a slot with an atomic increment and
+ * never locks or allocates; nothing is printed until the trace is dumped, on
+ * an error in main or on request, e.g. `call compiler::dump_trace()` from a
+ * debugger.
+ *
+ * Every event is tagged with the compilation context it was recorded in, only
+ * those of the current context are dumped: the strings and sources of the
+ * others are not there, or gone with their contexts.
+ * Events recorded while the trace is dumped may be printed half written.
+ */
+
+enum trace_event: unsigned char {
+    TRACE_GET,
+    TRACE_PEEK,
+    TRACE_UNGET,
+    TRACE_EXPECT,
+    TRACE_TEST,
+};
+
+static constexpr std::size_t trace_capacity = 1 << 16;
+
+// Disabled by default, enabled if $CC_TRACE is set to anything but 0. The
+// events recorded so far are kept either way.
+void set_trace(bool enabled);
+// the last events of the current context, oldest first; nothing if none
+// were recorded
+void dump_trace(std::FILE *out = stderr);
+
+extern std::atomic<bool> trace_enabled;
+void record_trace(trace_event, const token*);
+
+// a disabled trace costs a load and a branch
+inline void trace(trace_event event, const token *tok) {
+    if(trace_enabled.load(std::memory_order_relaxed))
+        record_trace(event, tok);
+}
+
+} // namespace compiler
+
+#endif // __COMPILER_TRACE__
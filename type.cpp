@@ -5,12 +5,6 @@
 
 using namespace compiler;
 
-static mempool<type_array>   arr_pool{};
-static mempool<type_pointer> ptr_pool{};
-static mempool<type_struct>  struct_pool{};
-static mempool<type_func>    func_pool{};
-static mempool<type_enum>    enum_pool{};
-
 const qual_type compiler::qual_null{};
 
 // 32-bit machine
@@ -122,7 +116,7 @@ uint32_t compiler::padded_offset(uint32_t offset, uint32_t align) {
  */
 uint8_t compiler::apply_qual(uint8_t lhs, uint32_t rhs) {
     if(lhs & rhs) 
-        warning(*epos, "Duplicate qualifier \"%s\"", qual_to_string(rhs));
+        warning(epos, "Duplicate qualifier \"%s\"", qual_to_string(rhs));
     return lhs |= rhs;
 }
 
@@ -136,9 +130,9 @@ uint8_t compiler::apply_storage(uint8_t lhs, uint32_t rhs) {
     };
     
     if(lhs & ~comp[index(rhs)]) 
-        error(*epos, "Cannot apply storage class specifier \"%s\" to previous one", storage_to_string(rhs));
+        error(epos, "Cannot apply storage class specifier \"%s\" to previous one", storage_to_string(rhs));
     else if(rhs & Register) 
-        warning(*epos, "Deprecated storage class specifier \"register\", it has no effect");
+        warning(epos, "Deprecated storage class specifier \"register\", it has no effect");
     return lhs |= rhs;
 }
 
@@ -160,7 +154,7 @@ uint32_t compiler::apply_spec(uint32_t lhs, uint32_t rhs) {
     
     // incompatible two specifiers
     if(lhs & ~comp[index(rhs)])
-        error(*epos, "Cannot apply specifier \"%s\" to previous combination", spec_to_string(rhs));
+        error(epos, "Cannot apply specifier \"%s\" to previous combination", spec_to_string(rhs));
     
     if((lhs & Long) && (rhs & Long)) {
         lhs ^= Long;
@@ -315,7 +309,7 @@ std::string type_array::to_string() const {
 type_array* type_array::copy() const {
     if(is_complete()) 
         return const_cast<type_array*>(this);
-    return new (arr_pool.malloc()) type_array(m_base, m_len);
+    return compilation_arena().make<type_array>(m_base, m_len);
 }
 
 unsigned int type_pointer::size() const {return size_ptr;}
@@ -476,7 +470,7 @@ type_arith* compiler::make_arith(uint32_t tp) {
         case Double: return &double_type;
         case Long|Double: return &ldouble_type;
         // case Float|Complex: case Double|Complex: case Long|Double|Complex:
-        default: error(*epos, "Invalid type-specifier combination for arithmetic type"); return nullptr;
+        default: error(epos, "Invalid type-specifier combination for arithmetic type"); return nullptr;
     }
 }
 
@@ -492,12 +486,12 @@ qual_type compiler::max_type(type_arith *lhs, type_arith *rhs) {
 }
 
 qual_type compiler::make_array(qual_type base, unsigned int len) {
-    auto arr = new (arr_pool.malloc()) type_array(base, len);
+    auto arr = compilation_arena().make<type_array>(base, len);
     return make_qual(arr);
 }
 
 type_pointer* compiler::make_pointer(type *base, uint8_t base_qual) {
-    return new (ptr_pool.malloc()) type_pointer(base, base_qual);
+    return compilation_arena().make<type_pointer>(base, base_qual);
 }
 
 qual_type compiler::qual_pointer(qual_type base, uint8_t qual) {
@@ -506,18 +500,18 @@ qual_type compiler::qual_pointer(qual_type base, uint8_t qual) {
 }
 
 type_struct* compiler::make_struct(scope *s) {
-    return new (struct_pool.malloc()) type_struct(s);
+    return compilation_arena().make<type_struct>(s);
 }
 
 type_struct* compiler::make_struct(scope *s, member_list &&m) {
-    return new (struct_pool.malloc()) type_struct(s, std::move(m));
+    return compilation_arena().make<type_struct>(s, std::move(m));
 }
 
 type_enum* compiler::make_enum() {
-    return new (enum_pool.malloc()) type_enum();
+    return compilation_arena().make<type_enum>();
 }
 
 qual_type compiler::make_func(qual_type ret, param_list &&par, bool va, bool unspecified) {
-    auto func = new (func_pool.malloc()) type_func(ret, std::move(par), va, unspecified);
+    auto func = compilation_arena().make<type_func>(ret, std::move(par), va, unspecified);
     return make_qual(func);
 }
@@ -1,7 +1,8 @@
 #ifndef __COMPILER_TYPE__
 #define __COMPILER_TYPE__
 
-#include <list>
+#include "mempool.hpp"
+
 #include <string>
 #include <cassert>
 #include <cstdint>
@@ -85,8 +86,8 @@ class type_struct;
 class type_enum;
 class type_func;
 
-typedef std::list<ast_object*> param_list;
-typedef std::list<ast_object*> member_list;
+typedef pool_vector<ast_object*> param_list;
+typedef pool_vector<ast_object*> member_list;
 
 // as long as the size of underlying object is greater than 8 bytes,
 // the lower 3 bits of its memory address is always 0
@@ -107,12 +108,12 @@ class qual_type {
         uint8_t qual() const {return m_ptr & Qual;}
         uintptr_t ptr() const {return m_ptr;}
         
-        type* get() {return reinterpret_cast<type*>(m_ptr & ~Qual);}
-        const type* get() const {return reinterpret_cast<const type*>(m_ptr & ~Qual);}
+        type* get() {return reinterpret_cast<type*>(m_ptr & ~uintptr_t(Qual));}
+        const type* get() const {return reinterpret_cast<const type*>(m_ptr & ~uintptr_t(Qual));}
         
         void reset(type *base, uint8_t qual = 0) {m_ptr = reinterpret_cast<uintptr_t>(base) | qual;}
         
-        bool is_null() const {return !(m_ptr & ~Qual);}
+        bool is_null() const {return !(m_ptr & ~uintptr_t(Qual));}
         
         bool is_const() const {return m_ptr & Const;}
         bool is_volatile() const {return m_ptr & Volatile;}
@@ -133,7 +134,7 @@ class qual_type {
          */
         qual_type decay() const;
         
-        void set_qual(uint8_t qual) {m_ptr &= ~Qual; m_ptr |= qual;}
+        void set_qual(uint8_t qual) {m_ptr &= ~uintptr_t(Qual); m_ptr |= qual;}
         void add_qual(uint8_t qual) {m_ptr |= qual;}
         
         void set_base(type *tp) {
@@ -554,6 +555,11 @@ qual_type make_func(qual_type, param_list&&, bool = false, bool = true);
 #define STATIC_ASSERT(type) static_assert(!(sizeof(type) % 8), "")
 ITERATE_TYPES(STATIC_ASSERT);
 #undef STATIC_ASSERT
+
+// types of nothing but pointers and values, their destructors are only virtual
+template <> struct arena_destroyed<type_array>: std::false_type {};
+template <> struct arena_destroyed<type_pointer>: std::false_type {};
+template <> struct arena_destroyed<type_enum>: std::false_type {};
 } // namespace compiler
 
 #endif // __COMPILER_TYPE__